@@ -1,522 +1,7791 @@
-//DISCRETE STRUCTURE 2 - FINAL PROJECT "NOTATION CONVERTION FOR INFIX, PREFIX AND POSTFIX"
-// BSCS 2A
-
-/*
-MEMBERS: 
-    BRUTAS, LOUISE
-    MORGA, CHRISTIAN
-    NACARIO, CARL JOSEPH
-*/
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include <stdbool.h>
-
-#define MAX 100  //Maximum stack size
-
-//Node for expression tree
-typedef struct Node {
-    char value[10];           //Stores operator or operand
-    struct Node* left;        //Left child
-    struct Node* right;       //Right child
-} Node;
-
-//Token structure- holds a string and whether it is an operator
-typedef struct {
-    char* value;
-    bool isOperator;
-} Token;
-
-//Stack structure used for building trees
-typedef struct Stack {
-    Node* data[MAX];
-    int top;
-} Stack;
-
-// ----------- Stack Operations -----------
-
-//Initializes the stack
-void initStack(Stack* s) { s->top = -1; }
-
-//Checks if the stack is empty
-bool isEmpty(Stack* s) { return s->top == -1; }
-
-//Push a node onto the stack, with overflow error check
-void push(Stack* s, Node* node) {
-    if (s->top >= MAX - 1) {
-        printf("Error: Stack overflow\n");
-        exit(1);
-    }
-    s->data[++(s->top)] = node;
-}
-
-//Pops a node from the stack, with underflow error check
-Node* pop(Stack* s) {
-    if (isEmpty(s)) {
-        printf("Error: Stack underflow\n");
-        exit(1);
-    }
-    return s->data[(s->top)--];
-}
-
-//Peeks at the top node of the stack without removing it
-Node* peek(Stack* s) {
-    return isEmpty(s) ? NULL : s->data[s->top];
-}
-
-//Creates a new expression tree node
-Node* createNode(const char* val) {
-    Node* node = (Node*)malloc(sizeof(Node));
-    if (!node) {
-        printf("Error: Memory allocation failed\n");
-        exit(1);
-    }
-    strncpy(node->value, val, sizeof(node->value) - 1);
-    node->value[sizeof(node->value) - 1] = '\0'; // Ensure null termination
-    node->left = node->right = NULL;
-    return node;
-}
-
-//Checks if a token is an operator
-bool isOperator(const char* token) {
-    return strlen(token) == 1 && strchr("+-*/", token[0]);
-}
-
-//Checks if a token is a valid operand (alphanumeric string)
-bool isOperand(const char* token) {
-    for (int i = 0; token[i]; i++) {
-        if (!isalnum(token[i])) return false;
-    }
-    return strlen(token) > 0;
-}
-
-//Verifies if a token is valid (operand, operator, or parenthesis)
-bool isValidToken(const char* token) {
-    return isOperand(token) || isOperator(token) ||
-           strcmp(token, "(") == 0 || strcmp(token, ")") == 0;
-}
-
-//Splits the input string into tokens and identifies operators
-int tokenize(char* input, Token* tokens, int maxTokens) {
-    int tokenCount = 0;
-    char* token = strtok(input, " ");
-    while (token && tokenCount < maxTokens) {
-        if (!isValidToken(token)) {
-            printf("Error: Invalid token '%s'\n", token);
-            return -1;
-        }
-        tokens[tokenCount].value = strdup(token); //Dynamic copy of token
-        if (!tokens[tokenCount].value) {
-            printf("Error: Memory allocation failed\n");
-            return -1;
-        }
-        tokens[tokenCount].isOperator = isOperator(token);
-        tokenCount++;
-        token = strtok(NULL, " ");
-    }
-    if (tokenCount == 0) {
-        printf("Error: No valid tokens found\n");
-        return -1;
-    }
-    return tokenCount;
-}
-
-//Frees memory allocated for tokens
-void freeTokens(Token* tokens, int tokenCount) {
-    for (int i = 0; i < tokenCount; i++) {
-        free(tokens[i].value);
-    }
-}
-
-//Recursively frees memory for the expression tree
-void freeTree(Node* root) {
-    if (!root) return;
-    freeTree(root->left);
-    freeTree(root->right);
-    free(root);
-}
-
-// ----------- Tree Traversal -----------
-
-//Preorder: root-left-right (used for prefix output)
-void preorder(Node* root) {
-    if (root) {
-        printf("%s ", root->value);
-        preorder(root->left);
-        preorder(root->right);
-    }
-}
-
-//Inorder: left-root-right (used for infix output with parentheses)
-void inorder(Node* root) {
-    if (root) {
-        if (root->left && root->right) printf("( ");
-        inorder(root->left);
-        printf("%s ", root->value);
-        inorder(root->right);
-        if (root->left && root->right) printf(") ");
-    }
-}
-
-//Postorder: left-right-root (used for postfix output)
-void postorder(Node* root) {
-    if (root) {
-        postorder(root->left);
-        postorder(root->right);
-        printf("%s ", root->value);
-    }
-}
-
-// ----------- PREFIX Handling -----------
-
-//Recursively validate prefix structure (each operator must have two children)
-bool validatePrefixStructure(Token* tokens, int* index, int tokenCount) {
-    if (*index >= tokenCount) return false;
-
-    if (tokens[*index].isOperator) {
-        (*index)++;
-        return validatePrefixStructure(tokens, index, tokenCount) &&
-               validatePrefixStructure(tokens, index, tokenCount);
-    } else {
-        (*index)++;
-        return true;
-    }
-}
-
-//Checks if entire prefix expression is valid
-int validatePrefix(Token* tokens, int tokenCount) {
-    int index = 0;
-    if (!validatePrefixStructure(tokens, &index, tokenCount)) return 0;
-    return index == tokenCount;
-}
-
-//Builds tree from prefix tokens using recursion
-Node* buildTreeFromPrefix(Token* tokens, int* index, int tokenCount) {
-    if (*index >= tokenCount) return NULL;
-    Node* node = createNode(tokens[*index].value);
-    (*index)++;
-    if (isOperator(node->value)) {
-        node->left = buildTreeFromPrefix(tokens, index, tokenCount);
-        node->right = buildTreeFromPrefix(tokens, index, tokenCount);
-    }
-    return node;
-}
-
-// ----------- POSTFIX Handling -----------
-
-//Validates if postfix expression has enough operands for each operator
-int validatePostfix(Token* tokens, int tokenCount) {
-    int operandCount = 0;
-    for (int i = 0; i < tokenCount; i++) {
-        if (!tokens[i].isOperator) operandCount++;
-        else {
-            if (operandCount < 2) return 0;
-            operandCount--;
-        }
-    }
-    return operandCount == 1;
-}
-
-//Builds tree from postfix tokens using stack
-Node* buildTreeFromPostfix(Token* tokens, int tokenCount) {
-    Stack s;
-    initStack(&s);
-    for (int i = 0; i < tokenCount; i++) {
-        Node* node = createNode(tokens[i].value);
-        if (!tokens[i].isOperator) {
-            push(&s, node);
-        } else {
-            node->right = pop(&s);
-            node->left = pop(&s);
-            push(&s, node);
-        }
-    }
-    return pop(&s);
-}
-
-// ----------- INFIX Handling -----------
-
-//Defines operator precedence for infix expressions
-int precedence(char op) {
-    if (op == '+' || op == '-') return 1;
-    if (op == '*' || op == '/') return 2;
-    return 0;
-}
-
-//Converts infix expression string into an expression tree
-Node* buildTreeFromInfix(const char* expr) {
-    Stack ops, nodes;
-    initStack(&ops);
-    initStack(&nodes);
-
-    char exprCopy[256];
-    strncpy(exprCopy, expr, sizeof(exprCopy) - 1);
-    exprCopy[sizeof(exprCopy) - 1] = '\0';
-
-    char* tok = strtok(exprCopy, " ");
-    while (tok) {
-        if (!isValidToken(tok) && strcmp(tok, "(") != 0 && strcmp(tok, ")") != 0) {
-            printf("Error: Invalid token '%s'\n", tok);
-            return NULL;
-        }
-        if (isOperand(tok)) {
-            push(&nodes, createNode(tok));
-        } else if (strcmp(tok, "(") == 0) {
-            push(&ops, createNode(tok));
-        } else if (strcmp(tok, ")") == 0) {
-            // Process until opening parenthesis
-            bool foundOpen = false;
-            while (!isEmpty(&ops)) {
-                Node* top = pop(&ops);
-                if (strcmp(top->value, "(") == 0) {
-                    foundOpen = true;
-                    free(top);
-                    break;
-                }
-                if (isEmpty(&nodes)) {
-                    printf("Error: Too few operands for operator '%s'\n", top->value);
-                    free(top);
-                    return NULL;
-                }
-                Node* right = pop(&nodes);
-                if (isEmpty(&nodes)) {
-                    printf("Error: Too few operands for operator '%s'\n", top->value);
-                    free(top);
-                    free(right);
-                    return NULL;
-                }
-                Node* left = pop(&nodes);
-                top->left = left;
-                top->right = right;
-                push(&nodes, top);
-            }
-            if (!foundOpen) {
-                printf("Error: Unbalanced parentheses\n");
-                return NULL;
-            }
-        } else if (isOperator(tok)) {
-            while (!isEmpty(&ops) && isOperator(peek(&ops)->value) &&
-                   precedence(peek(&ops)->value[0]) >= precedence(tok[0])) {
-                Node* op = pop(&ops);
-                if (isEmpty(&nodes)) {
-                    printf("Error: Too few operands for operator '%s'\n", op->value);
-                    free(op);
-                    return NULL;
-                }
-                Node* right = pop(&nodes);
-                if (isEmpty(&nodes)) {
-                    printf("Error: Too few operands for operator '%s'\n", op->value);
-                    free(op);
-                    free(right);
-                    return NULL;
-                }
-                Node* left = pop(&nodes);
-                op->left = left;
-                op->right = right;
-                push(&nodes, op);
-            }
-            push(&ops, createNode(tok));
-        }
-        tok = strtok(NULL, " ");
-    }
-
-    //Final merge of remaining operators
-    while (!isEmpty(&ops)) {
-        Node* op = pop(&ops);
-        if (strcmp(op->value, "(") == 0 || strcmp(op->value, ")") == 0) {
-            printf("Error: Unbalanced parentheses\n");
-            free(op);
-            return NULL;
-        }
-        if (isEmpty(&nodes)) {
-            printf("Error: Too few operands for operator '%s'\n", op->value);
-            free(op);
-            return NULL;
-        }
-        Node* right = pop(&nodes);
-        if (isEmpty(&nodes)) {
-            printf("Error: Too few operands for operator '%s'\n", op->value);
-            free(op);
-            free(right);
-            return NULL;
-        }
-        Node* left = pop(&nodes);
-        op->left = left;
-        op->right = right;
-        push(&nodes, op);
-    }
-
-    //Only one tree should remain
-    if (nodes.top != 0) {
-        printf("Error: Too many operands\n");
-        return NULL;
-    }
-
-    return pop(&nodes);
-}
-
-// ----------- MAIN Function -----------
-
-//Entry point for the program
-int main(int argc, char *argv[]) {
-    if (argc == 2 && strcmp(argv[1], "--help") == 0) {
-        printf("\nFor Linux:");
-        printf("\nUsage: ./<program> \"<expression>\" <input_type> <output_type>\n");
-
-        printf("\nFor Windows:");
-        printf("\nUsage: <program.exe> \"<expression>\" <input_type> <output_type>\n");
-
-        printf("\nTypes:\n  infix\n  prefix\n  postfix\n");
-
-        printf("\nExamples:\n");
-        printf("  ./program \"a + b * c\" infix postfix\n");
-        printf("  ./program \"+ a * b c\" prefix infix\n");
-        printf("  ./program \"a b c * +\" postfix infix\n");
-
-        printf("\nErrors and Format Rules:\n");
-
-        printf("\n[ General Errors ]\n");
-        printf("  - Error: No valid tokens found\n");
-        printf("    ---> Make sure your expression has valid operands/operators separated by spaces.\n");
-        printf("  - Error: Invalid token '<token>'\n");
-        printf("    ---> Expression contains an invalid character or unrecognized symbol.\n");
-        printf("  - Error: Unknown output type\n");
-        printf("    ---> The third argument must be one of: infix, prefix, postfix\n");
-
-        printf("\n[ Infix Expression Rules ]\n");
-        printf("  - Must be properly parenthesized if necessary (e.g., ( a + b ) * c)\n");
-        printf("  - Operators: + - * /\n");
-        printf("  - Operands must be alphanumeric (e.g., a, b1, X99)\n");
-        printf("  - Error: Infix expression cannot start or end with an operator\n");
-        printf("  - Error: Unbalanced parentheses\n");
-        printf("  - Error: Too few operands for operator '+' or other operator\n");
-        printf("  - Error: Too many operands\n");
-
-        printf("\n[ Prefix Expression Rules ]\n");
-        printf("  - Format: <operator> <operand1> <operand2> [...]\n");
-        printf("  - Each operator must have exactly two operands\n");
-        printf("  - Error: Invalid prefix expression format\n");
-        printf("    ---> Too many or too few operands for the given operators\n");
-
-        printf("\n[ Postfix Expression Rules ]\n");
-        printf("  - Format: <operand1> <operand2> <operator>\n");
-        printf("  - Each operator must apply to the two previous operands\n");
-        printf("  - Error: Invalid postfix expression format\n");
-        printf("    ---> Too many or too few operands for the given operators\n");
-
-        printf("\nHelpful Tip:\n");
-        printf("  All expressions must be space-separated.\n");
-        printf("  Use double quotes around expressions to avoid shell issues.\n");
-
-        printf("\n");
-        return 0;
-    }
-
-    if (argc == 2 && strcmp(argv[1], "--guide") == 0) {
-        printf("\nFor Linux:");
-        printf("\nUsage: ./<program> \"<expression>\" <input_type> <output_type>\n");
-
-        printf("\nFor Windows:");
-        printf("\nUsage: <program.exe> \"<expression>\" <input_type> <output_type>\n");
-
-        printf("\nTypes:\n  infix\n  prefix\n  postfix\n");
-        printf("\nExample: ./Convert \"a + b * c\" infix postfix\n");
-        printf("\nExample: Convert.exe \"a + b * c\" infix postfix\n\n");
-        return 0;
-    }
-
-    if (argc != 4) {
-        printf("\nHi, To convert a Notation please Enter \"--guide\" or \"--help\".\n");
-        printf("\nFor Linux:");
-        printf("\n\tUsage: ./<program_name> \"--help\".\n");
-        printf("\t\t---> For user error and format rules\n");
-        printf("\tUsage: ./<program_name> \"--guide\".\n");
-        printf("\t\t---> How to run this program\n");
-
-        printf("\nFor Windows:");
-        printf("\n\tUsage: <program_name.exe> \"--help\".\n");
-        printf("\t\t---> For user error and format rules\n");
-        printf("\tUsage: <program_name.exe> \"--guide\".\n");
-        printf("\t\t---> How to run this program\n");
-
-        printf("\nHelpful Tip:\n");
-        printf("\n\tRead the help and guide first to properly run this program. Thank you!!\n");
-        return 1;
-    }
-
-    char input[256];
-    strncpy(input, argv[1], sizeof(input) - 1);
-    input[sizeof(input) - 1] = '\0';
-
-    const char* inputType = argv[2];
-    const char* outputType = argv[3];
-    Node* root = NULL;
-    Token tokens[100];
-    int tokenCount = 0;
-
-    if (strcmp(inputType, "infix") == 0) {
-        //Invalid infix format chevking
-        char firstChar = input[0];
-        char lastChar = input[strlen(input) - 1];
-        if (firstChar == '+' || firstChar == '-' || firstChar == '*' || firstChar == '/' ||
-            lastChar == '+' || lastChar == '-' || lastChar == '*' || lastChar == '/') {
-            printf("\nError: Infix expression cannot start or end with an operator\n");
-            return 1;
-        }
-        root = buildTreeFromInfix(input);
-        if (!root) return 1;
-    } else {
-        tokenCount = tokenize(input, tokens, 100);
-        if (tokenCount < 0) return 1;
-
-        if (strcmp(inputType, "prefix") == 0) {
-            if (!validatePrefix(tokens, tokenCount)) {
-                printf("\nError: Invalid prefix expression format\n");
-                printf("\nThere's seems to be a problem, To convert a Notation please press \"--help\".\n");
-                printf("Usage: ./<program_name> \"--help\".\n\n");
-                freeTokens(tokens, tokenCount);
-                return 1;
-            }
-            int index = 0;
-            root = buildTreeFromPrefix(tokens, &index, tokenCount);
-        } else if (strcmp(inputType, "postfix") == 0) {
-            if (!validatePostfix(tokens, tokenCount)) {
-                printf("\nError: Invalid postfix expression format\n");
-                printf("\nThere's seems to be a problem, To convert a Notation please press \"--help\".\n");
-                printf("Usage: ./<program_name> \"--help\".\n\n");
-                freeTokens(tokens, tokenCount);
-                return 1;
-            }
-            root = buildTreeFromPostfix(tokens, tokenCount);
-        }
-    }
-
-    //Output conversion based on user's choice
-    printf("\n");
-    if (strcmp(outputType, "infix") == 0) {
-        printf("Infix Expression: ");
-        inorder(root);
-    } else if (strcmp(outputType, "prefix") == 0) {
-        printf("Prefix Expression: ");
-        preorder(root);
-    } else if (strcmp(outputType, "postfix") == 0) {
-        printf("Postfix Expression: ");
-        postorder(root);
-    } else {
-        printf("\nError: Unknown output type\n");
-        printf("\nThere's seems to be a problem, To convert a Notation please press \"--help\".\n");
-        printf("Usage: ./<program_name> \"--guide\".\n");
-        printf("Usage: <program_name.exe> \"--guide\".\n\n");
-        freeTree(root);
-        return 1;
-    }
-    printf("\n");
-
-    // Cleanup
-    freeTree(root);
-    if (strcmp(inputType, "prefix") == 0 || strcmp(inputType, "postfix") == 0)
-        freeTokens(tokens, tokenCount);
-    return 0;
-}
+//DISCRETE STRUCTURE 2 - FINAL PROJECT "NOTATION CONVERTION FOR INFIX, PREFIX AND POSTFIX"
+// BSCS 2A
+
+/*
+MEMBERS: 
+    BRUTAS, LOUISE
+    MORGA, CHRISTIAN
+    NACARIO, CARL JOSEPH
+*/
+
+#define _FILE_OFFSET_BITS 64  //Large temporary files in out-of-core mode
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/file.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1  //Bulk directory mode submits its file I/O through io_uring
+#endif
+#if __has_include(<linux/perf_event.h>)
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#define HAVE_PERF_EVENTS 1  //--perf reads hardware counters around each phase
+#endif
+#endif
+#ifdef CONVERT_WITH_ZLIB
+#include <zlib.h>        //gzip input and output for --stream (link with -lz)
+#endif
+#ifdef CONVERT_WITH_ZSTD
+#include <zstd.h>        //zstd input and output for --stream (link with -lzstd)
+#endif
+
+#define MAX 100  //Stack slots kept inline before a stack moves to the heap
+#define LEGACY_INFIX_BYTES 256  //Input bytes the original infix builder copied
+
+#ifdef _WIN32
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#define off_t long long
+#define strtok_r strtok_s
+struct iovec {
+    void* iov_base;
+    size_t iov_len;
+};
+#endif
+
+//Node for expression tree
+typedef struct Node {
+    char value[10];           //Stores operator or operand
+    struct Node* left;        //Left child
+    struct Node* right;       //Right child
+} Node;
+
+//Token structure- holds a string and whether it is an operator
+typedef struct {
+    char* value;
+    bool isOperator;
+} Token;
+
+//Stack structure used for building trees. The first MAX slots are
+//inline; a deeper expression moves it to the heap (release with freeStack)
+typedef struct Stack {
+    Node** data;
+    int top;
+    int capacity;
+    Node* inlineData[MAX];
+} Stack;
+
+// ----------- Error Reporting -----------
+
+//Parse errors go through reportError. A thread that converts many
+//expressions sets errorCapture to keep the first message for the current
+//expression instead of printing it, so it stays in order with the output.
+#define ERROR_CAPTURE_SIZE 128
+static _Thread_local char* errorCapture;
+
+//Prints a parse error, or stores it in errorCapture when one is set
+void reportError(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    if (!errorCapture) {
+        vprintf(format, args);
+    } else if (!errorCapture[0]) {
+        vsnprintf(errorCapture, ERROR_CAPTURE_SIZE, format, args);
+        //Keep the message itself, without the blank lines around it
+        size_t start = strspn(errorCapture, "\n"), len = strlen(errorCapture);
+        while (len > start && errorCapture[len - 1] == '\n') len--;
+        memmove(errorCapture, errorCapture + start, len - start);
+        errorCapture[len - start] = '\0';
+    }
+    va_end(args);
+}
+
+// ----------- Stack Operations -----------
+
+//Initializes the stack
+void initStack(Stack* s) {
+    s->data = s->inlineData;
+    s->top = -1;
+    s->capacity = MAX;
+}
+
+//Releases the heap slots of a stack that outgrew its inline ones
+void freeStack(Stack* s) {
+    if (s->data != s->inlineData) free(s->data);
+    initStack(s);
+}
+
+//Checks if the stack is empty
+bool isEmpty(Stack* s) { return s->top == -1; }
+
+//Push a node onto the stack, doubling it when full
+void push(Stack* s, Node* node) {
+    if (s->top == s->capacity - 1) {
+        Node** grown = (Node**)malloc(sizeof(Node*) * (size_t)s->capacity * 2);
+        if (!grown) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        memcpy(grown, s->data, sizeof(Node*) * (size_t)s->capacity);
+        if (s->data != s->inlineData) free(s->data);
+        s->data = grown;
+        s->capacity *= 2;
+    }
+    s->data[++(s->top)] = node;
+}
+
+//Pops a node from the stack, with underflow error check
+Node* pop(Stack* s) {
+    if (isEmpty(s)) {
+        printf("Error: Stack underflow\n");
+        exit(1);
+    }
+    return s->data[(s->top)--];
+}
+
+//Peeks at the top node of the stack without removing it
+Node* peek(Stack* s) {
+    return isEmpty(s) ? NULL : s->data[s->top];
+}
+
+//Doubles an array when it is full; exits like createNode without memory
+static void* growArray(void* items, int count, int* capacity, size_t size) {
+    if (count < *capacity) return items;
+    *capacity = *capacity ? *capacity * 2 : 64;
+    items = realloc(items, size * (size_t)*capacity);
+    if (!items) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return items;
+}
+
+//Creates a new expression tree node
+Node* createNode(const char* val) {
+    Node* node = (Node*)malloc(sizeof(Node));
+    if (!node) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    strncpy(node->value, val, sizeof(node->value) - 1);
+    node->value[sizeof(node->value) - 1] = '\0'; // Ensure null termination
+    node->left = node->right = NULL;
+    return node;
+}
+
+//Checks if a token is an operator
+bool isOperator(const char* token) {
+    return strlen(token) == 1 && strchr("+-*/", token[0]);
+}
+
+//Checks if a character is an operator symbol
+bool isOperatorChar(char c) {
+    return c == '+' || c == '-' || c == '*' || c == '/';
+}
+
+//Checks if a token is a valid operand (alphanumeric string)
+bool isOperand(const char* token) {
+    for (int i = 0; token[i]; i++) {
+        if (!isalnum(token[i])) return false;
+    }
+    return strlen(token) > 0;
+}
+
+//Verifies if a token is valid (operand, operator, or parenthesis)
+bool isValidToken(const char* token) {
+    return isOperand(token) || isOperator(token) ||
+           strcmp(token, "(") == 0 || strcmp(token, ")") == 0;
+}
+
+void freeTokens(Token* tokens, int tokenCount);
+
+//Splits the input string into tokens and identifies operators. On an
+//error the tokens copied so far are freed and -1 is returned.
+int tokenize(char* input, Token* tokens, int maxTokens) {
+    int tokenCount = 0;
+    char* save;
+    char* token = strtok_r(input, " ", &save); //Reentrant, conversions may run on several threads
+    while (token && tokenCount < maxTokens) {
+        if (!isValidToken(token)) {
+            reportError("Error: Invalid token '%s'\n", token);
+            freeTokens(tokens, tokenCount);
+            return -1;
+        }
+        tokens[tokenCount].value = strdup(token); //Dynamic copy of token
+        if (!tokens[tokenCount].value) {
+            printf("Error: Memory allocation failed\n");
+            freeTokens(tokens, tokenCount);
+            return -1;
+        }
+        tokens[tokenCount].isOperator = isOperator(token);
+        tokenCount++;
+        token = strtok_r(NULL, " ", &save);
+    }
+    if (tokenCount == 0) {
+        reportError("Error: No valid tokens found\n");
+        return -1;
+    }
+    return tokenCount;
+}
+
+//Frees memory allocated for tokens
+void freeTokens(Token* tokens, int tokenCount) {
+    for (int i = 0; i < tokenCount; i++) {
+        free(tokens[i].value);
+    }
+}
+
+//Frees the expression tree without recursion: a left child is rotated
+//up over its parent until the root has none, then the root is freed
+void freeTree(Node* root) {
+    while (root) {
+        Node* next;
+        if (root->left) {
+            next = root->left;
+            root->left = next->right;
+            next->right = root;
+        } else {
+            next = root->right;
+            free(root);
+        }
+        root = next;
+    }
+}
+
+//Byte stack that keeps at most two blocks in memory and spills the
+//older block to a temporary file when it grows past that
+typedef struct {
+    char* window;        //Two blocks of in-memory stack space
+    size_t blockSize;
+    size_t count;        //Bytes currently held in the window
+    long long spilled;   //Number of blocks written to the spill file
+    FILE* file;          //Opened lazily on the first spill
+} SpillStack;
+
+//Aborts on temporary file I/O failure, like the allocation checks above
+void oocIoError(void) {
+    printf("Error: Temporary file I/O failed\n");
+    exit(1);
+}
+
+void initSpillStack(SpillStack* s, size_t blockSize) {
+    s->window = (char*)malloc(blockSize * 2);
+    if (!s->window) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    s->blockSize = blockSize;
+    s->count = 0;
+    s->spilled = 0;
+    s->file = NULL;
+}
+
+void freeSpillStack(SpillStack* s) {
+    free(s->window);
+    if (s->file) fclose(s->file);
+}
+
+bool spillIsEmpty(SpillStack* s) { return s->count == 0 && s->spilled == 0; }
+
+//Pushes a byte, writing the lower block out once the window is full
+void spillPush(SpillStack* s, char c) {
+    if (s->count == s->blockSize * 2) {
+        if (!s->file && !(s->file = tmpfile())) oocIoError();
+        if (fseeko(s->file, (off_t)s->spilled * (off_t)s->blockSize, SEEK_SET) != 0 ||
+            fwrite(s->window, 1, s->blockSize, s->file) != s->blockSize) oocIoError();
+        memmove(s->window, s->window + s->blockSize, s->blockSize);
+        s->count = s->blockSize;
+        s->spilled++;
+    }
+    s->window[s->count++] = c;
+}
+
+//Pops a byte, reading the most recently spilled block back when needed
+char spillPop(SpillStack* s) {
+    if (s->count == 0) {
+        if (s->spilled == 0) {
+            printf("Error: Stack underflow\n");
+            exit(1);
+        }
+        s->spilled--;
+        if (fseeko(s->file, (off_t)s->spilled * (off_t)s->blockSize, SEEK_SET) != 0 ||
+            fread(s->window, 1, s->blockSize, s->file) != s->blockSize) oocIoError();
+        s->count = s->blockSize;
+    }
+    return s->window[--(s->count)];
+}
+
+//Peeks at the top byte, 0 if the stack is empty
+char spillPeek(SpillStack* s) {
+    if (s->count) return s->window[s->count - 1];
+    if (spillIsEmpty(s)) return 0;
+    char c = spillPop(s);
+    s->window[s->count++] = c;
+    return c;
+}
+
+// ----------- Buffered Output -----------
+
+//Output notations, in the order they are named on the command line
+enum { NOTATION_PREFIX, NOTATION_INFIX, NOTATION_POSTFIX };
+
+//Maps an output type name to its notation, -1 if unknown
+int notationOf(const char* type) {
+    if (strcmp(type, "prefix") == 0) return NOTATION_PREFIX;
+    if (strcmp(type, "infix") == 0) return NOTATION_INFIX;
+    if (strcmp(type, "postfix") == 0) return NOTATION_POSTFIX;
+    return -1;
+}
+
+//Exact number of bytes the printf traversal for this notation would print.
+//The order of the nodes does not matter, so any walk will do.
+size_t renderedSize(Node* root, int notation) {
+    size_t size = 0;
+    Stack pending;          //Right subtrees still to count
+    initStack(&pending);
+    Node* node = root;
+    while (node) {
+        size += strlen(node->value) + 1;
+        if (node->left && node->right) {
+            if (notation == NOTATION_INFIX) size += 4; //"( " and ") "
+            push(&pending, node->right);
+        }
+        node = node->left ? node->left : node->right;
+        if (!node && !isEmpty(&pending)) node = pop(&pending);
+    }
+    freeStack(&pending);
+    return size;
+}
+
+//Copies one token and its trailing space, returning the next write position
+char* putToken(char* out, const char* value) {
+    size_t len = strlen(value);
+    memcpy(out, value, len);
+    out[len] = ' ';
+    return out + len + 1;
+}
+
+//Writes the whole buffer to stdout, with a single write() where possible
+void writeOutput(const char* text, size_t length) {
+    fflush(stdout);
+#ifndef _WIN32
+    while (length > 0) {
+        ssize_t n = write(STDOUT_FILENO, text, length);
+        if (n <= 0) return;
+        text += n;
+        length -= (size_t)n;
+    }
+#else
+    fwrite(text, 1, length, stdout);
+    fflush(stdout);
+#endif
+}
+
+//Token bytes (the prefix and postfix length) and operator count of a
+//tree; the infix form adds "( " and ") " for every operator
+void measureAll(Node* root, size_t* tokenBytes, size_t* operators) {
+    Stack pending;          //Right subtrees still to count
+    initStack(&pending);
+    Node* node = root;
+    while (node) {
+        *tokenBytes += strlen(node->value) + 1;
+        if (node->left && node->right) {
+            (*operators)++;
+            push(&pending, node->right);
+        }
+        node = node->left ? node->left : node->right;
+        if (!node && !isEmpty(&pending)) node = pop(&pending);
+    }
+    freeStack(&pending);
+}
+
+//Header printed before each notation, indexed by NOTATION_*
+const char* notationHeader[] = {"Prefix Expression: ", "Infix Expression: ", "Postfix Expression: "};
+
+// ----------- TOKEN Iterator -----------
+
+//Pull-based output: yields the tokens of one notation one at a time, in
+//the same order renderTree writes them, without an output buffer. Walks
+//with an explicit stack of (node, step) frames; the first
+//ITERATOR_INLINE_DEPTH levels need no allocation. A caller can stop
+//early, interleave iterators over several trees, or send each token
+//straight to its own sink.
+
+#define ITERATOR_INLINE_DEPTH 64
+
+typedef struct {
+    Node* node;
+    int step;               //0 enter, 1 left, 2 between, 3 right, 4 leave
+} IteratorFrame;
+
+typedef struct {
+    int notation;
+    int top;
+    int capacity;
+    IteratorFrame* frames;  //inlineFrames until the tree gets deeper
+    IteratorFrame inlineFrames[ITERATOR_INLINE_DEPTH];
+} TokenIterator;
+
+//Starts an iterator over root; release it with freeTokenIterator
+void initTokenIterator(TokenIterator* it, Node* root, int notation) {
+    it->notation = notation;
+    it->frames = it->inlineFrames;
+    it->capacity = ITERATOR_INLINE_DEPTH;
+    it->top = -1;
+    if (root) {
+        it->frames[0].node = root;
+        it->frames[0].step = 0;
+        it->top = 0;
+    }
+}
+
+static void iteratorDescend(TokenIterator* it, Node* child) {
+    if (it->top + 1 == it->capacity) {
+        int capacity = it->capacity * 2;
+        IteratorFrame* frames = (IteratorFrame*)malloc(sizeof(IteratorFrame) * (size_t)capacity);
+        if (!frames) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        memcpy(frames, it->frames, sizeof(IteratorFrame) * (size_t)it->capacity);
+        if (it->frames != it->inlineFrames) free(it->frames);
+        it->frames = frames;
+        it->capacity = capacity;
+    }
+    it->top++;
+    it->frames[it->top].node = child;
+    it->frames[it->top].step = 0;
+}
+
+//Returns the next output token ("(" and ")" included for infix), or NULL
+//at the end. The string belongs to the tree and lives as long as it does.
+const char* nextToken(TokenIterator* it) {
+    while (it->top >= 0) {
+        IteratorFrame* frame = &it->frames[it->top];
+        Node* node = frame->node;
+        bool parens = it->notation == NOTATION_INFIX && node->left && node->right;
+        switch (frame->step) {
+            case 0:
+                frame->step = 1;
+                if (it->notation == NOTATION_PREFIX) return node->value;
+                if (parens) return "(";
+                //fall through
+            case 1:
+                frame->step = 2;
+                if (node->left) {
+                    iteratorDescend(it, node->left);
+                    continue;
+                }
+                //fall through
+            case 2:
+                frame->step = 3;
+                if (it->notation == NOTATION_INFIX) return node->value;
+                //fall through
+            case 3:
+                frame->step = 4;
+                if (node->right) {
+                    iteratorDescend(it, node->right);
+                    continue;
+                }
+                //fall through
+            default:
+                it->top--;
+                if (parens) return ")";
+                if (it->notation == NOTATION_POSTFIX) return node->value;
+        }
+    }
+    return NULL;
+}
+
+void freeTokenIterator(TokenIterator* it) {
+    if (it->frames != it->inlineFrames) free(it->frames);
+    it->frames = it->inlineFrames;
+    it->top = -1;
+}
+
+//Stack entries of renderTree are subtrees still to walk, or with one of
+//these tags in the low bits (nodes are at least 4-byte aligned) a node
+//whose token waits for the subtree before it
+#define RENDER_VALUE 1      //node->value, then (infix) its right subtree
+#define RENDER_CLOSE 2      //")"
+
+static Node* renderEntry(Node* node, uintptr_t tag) {
+    return (Node*)((uintptr_t)node | tag);
+}
+
+//Receives the tokens of walkTree in output order: a node's own token with
+//the node, "(" and ")" with NULL. When cut is set it is asked first about
+//every node reached; true means it has written whatever stands for the
+//subtree, and the walk goes on after it.
+typedef struct {
+    void (*token)(void* ctx, Node* node, const char* text);
+    bool (*cut)(void* ctx, Node* node);
+    void* ctx;
+} TokenSink;
+
+//The one walk behind every renderer: the order of preorder/inorder/postorder,
+//with an explicit stack, so the depth of the tree does not matter. It is
+//inlined into each renderer, so the sink calls become direct ones.
+static inline __attribute__((always_inline)) void walkTree(Node* root, int notation, const TokenSink* sink) {
+    Stack pending;
+    initStack(&pending);
+    Node* node = root;
+    for (;;) {
+        while (node) {
+            if (sink->cut && sink->cut(sink->ctx, node)) break;
+            if (!node->left && !node->right) {
+                sink->token(sink->ctx, node, node->value);
+                break;
+            }
+            bool parens = node->left && node->right;
+            if (notation == NOTATION_PREFIX) {
+                sink->token(sink->ctx, node, node->value);
+                if (parens) push(&pending, node->right);
+                node = node->left ? node->left : node->right;
+            } else if (notation == NOTATION_INFIX) {
+                if (parens) {
+                    sink->token(sink->ctx, NULL, "(");
+                    push(&pending, renderEntry(node, RENDER_CLOSE));
+                }
+                push(&pending, renderEntry(node, RENDER_VALUE));
+                node = node->left;
+            } else {
+                push(&pending, renderEntry(node, RENDER_VALUE));
+                if (parens) push(&pending, node->right);
+                node = node->left ? node->left : node->right;
+            }
+        }
+        if (isEmpty(&pending)) break;
+        Node* entry = pending.data[pending.top--];
+        uintptr_t tag = (uintptr_t)entry & 3;
+        node = (Node*)((uintptr_t)entry - tag);
+        if (tag == RENDER_CLOSE) {
+            sink->token(sink->ctx, NULL, ")");
+            node = NULL;
+        } else if (tag == RENDER_VALUE) {
+            sink->token(sink->ctx, node, node->value);
+            node = notation == NOTATION_INFIX ? node->right : NULL;
+        }
+    }
+    freeStack(&pending);
+}
+
+static void renderToken(void* ctx, Node* node, const char* text) {
+    (void)node;
+    char** out = (char**)ctx;
+    *out = putToken(*out, text);
+}
+
+//Renders a subtree exactly as preorder/inorder/postorder would print it
+char* renderTree(Node* root, int notation, char* out) {
+    TokenSink sink = {renderToken, NULL, &out};
+    walkTree(root, notation, &sink);
+    return out;
+}
+
+//Renders all three notations in one walk: prefix on entry, infix between
+//the subtrees and postfix on exit, each at its own cursor
+void renderAll(Node* root, char** prefix, char** infix, char** postfix) {
+    TokenIterator it;       //Only its frame stack is used
+    initTokenIterator(&it, root, NOTATION_INFIX);
+    while (it.top >= 0) {
+        IteratorFrame* frame = &it.frames[it.top];
+        Node* node = frame->node;
+        bool parens = node->left && node->right;
+        Node* child = NULL;
+        if (frame->step == 0) {
+            frame->step = 1;
+            *prefix = putToken(*prefix, node->value);
+            if (parens) *infix = putToken(*infix, "(");
+            child = node->left;
+        } else if (frame->step == 1) {
+            frame->step = 2;
+            *infix = putToken(*infix, node->value);
+            child = node->right;
+        } else {
+            it.top--;
+            if (parens) *infix = putToken(*infix, ")");
+            *postfix = putToken(*postfix, node->value);
+        }
+        if (child) iteratorDescend(&it, child);
+    }
+    freeTokenIterator(&it);
+}
+
+//Per-token printf output (preorder, inorder or postorder), kept as the
+//baseline for the benchmarks
+void printTraversal(Node* root, int notation) {
+    TokenIterator it;
+    initTokenIterator(&it, root, notation);
+    const char* token;
+    printf("\n%s", notationHeader[notation]);
+    while ((token = nextToken(&it))) printf("%s ", token);
+    printf("\n");
+    freeTokenIterator(&it);
+}
+
+// ----------- PREFIX Handling -----------
+
+//Checks if entire prefix expression is valid (each operator must have
+//two children). need counts the operands still owed: an operator owes
+//one more, an operand settles one, and nothing may follow a full tree.
+int validatePrefix(Token* tokens, int tokenCount) {
+    long long need = 1;
+    for (int i = 0; i < tokenCount; i++) {
+        if (need == 0) return 0;
+        need += tokens[i].isOperator ? 1 : -1;
+    }
+    return need == 0;
+}
+
+//Builds tree from prefix tokens starting at *index, keeping the operators
+//that still miss a child on a stack instead of recursing
+Node* buildTreeFromPrefix(Token* tokens, int* index, int tokenCount) {
+    Node* root = NULL;
+    Stack open;
+    initStack(&open);
+    while (*index < tokenCount) {
+        Node* node = createNode(tokens[*index].value);
+        (*index)++;
+        if (isEmpty(&open)) {
+            root = node;
+        } else if (!peek(&open)->left) {
+            peek(&open)->left = node;
+        } else {
+            pop(&open)->right = node;
+        }
+        if (isOperator(node->value)) push(&open, node);
+        if (isEmpty(&open)) break;
+    }
+    freeStack(&open);
+    return root;
+}
+
+// ----------- POSTFIX Handling -----------
+
+//Validates if postfix expression has enough operands for each operator
+int validatePostfix(Token* tokens, int tokenCount) {
+    int operandCount = 0;
+    for (int i = 0; i < tokenCount; i++) {
+        if (!tokens[i].isOperator) operandCount++;
+        else {
+            if (operandCount < 2) return 0;
+            operandCount--;
+        }
+    }
+    return operandCount == 1;
+}
+
+//Builds tree from postfix tokens using stack
+Node* buildTreeFromPostfix(Token* tokens, int tokenCount) {
+    Stack s;
+    initStack(&s);
+    for (int i = 0; i < tokenCount; i++) {
+        Node* node = createNode(tokens[i].value);
+        if (!tokens[i].isOperator) {
+            push(&s, node);
+        } else {
+            node->right = pop(&s);
+            node->left = pop(&s);
+            push(&s, node);
+        }
+    }
+    Node* root = pop(&s);
+    freeStack(&s);
+    return root;
+}
+
+// ----------- INFIX Handling -----------
+
+//Defines operator precedence for infix expressions
+int precedence(char op) {
+    if (op == '+' || op == '-') return 1;
+    if (op == '*' || op == '/') return 2;
+    return 0;
+}
+
+//Converts infix expression string into an expression tree
+Node* buildTreeFromInfix(const char* expr) {
+    Stack ops, nodes;
+    initStack(&ops);
+    initStack(&nodes);
+
+    char* exprCopy = strdup(expr); //Heap copy, expressions are not length-limited
+    if (!exprCopy) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+
+    char* save;
+    char* tok = strtok_r(exprCopy, " ", &save);
+    while (tok) {
+        if (!isValidToken(tok) && strcmp(tok, "(") != 0 && strcmp(tok, ")") != 0) {
+            reportError("Error: Invalid token '%s'\n", tok);
+            goto fail;
+        }
+        if (isOperand(tok)) {
+            push(&nodes, createNode(tok));
+        } else if (strcmp(tok, "(") == 0) {
+            push(&ops, createNode(tok));
+        } else if (strcmp(tok, ")") == 0) {
+            // Process until opening parenthesis
+            bool foundOpen = false;
+            while (!isEmpty(&ops)) {
+                Node* top = pop(&ops);
+                if (strcmp(top->value, "(") == 0) {
+                    foundOpen = true;
+                    free(top);
+                    break;
+                }
+                if (isEmpty(&nodes)) {
+                    reportError("Error: Too few operands for operator '%s'\n", top->value);
+                    free(top);
+                    goto fail;
+                }
+                Node* right = pop(&nodes);
+                if (isEmpty(&nodes)) {
+                    reportError("Error: Too few operands for operator '%s'\n", top->value);
+                    free(top);
+                    freeTree(right);
+                    goto fail;
+                }
+                Node* left = pop(&nodes);
+                top->left = left;
+                top->right = right;
+                push(&nodes, top);
+            }
+            if (!foundOpen) {
+                reportError("Error: Unbalanced parentheses\n");
+                goto fail;
+            }
+        } else if (isOperator(tok)) {
+            while (!isEmpty(&ops) && isOperator(peek(&ops)->value) &&
+                   precedence(peek(&ops)->value[0]) >= precedence(tok[0])) {
+                Node* op = pop(&ops);
+                if (isEmpty(&nodes)) {
+                    reportError("Error: Too few operands for operator '%s'\n", op->value);
+                    free(op);
+                    goto fail;
+                }
+                Node* right = pop(&nodes);
+                if (isEmpty(&nodes)) {
+                    reportError("Error: Too few operands for operator '%s'\n", op->value);
+                    free(op);
+                    freeTree(right);
+                    goto fail;
+                }
+                Node* left = pop(&nodes);
+                op->left = left;
+                op->right = right;
+                push(&nodes, op);
+            }
+            push(&ops, createNode(tok));
+        }
+        tok = strtok_r(NULL, " ", &save);
+    }
+
+    //Final merge of remaining operators
+    while (!isEmpty(&ops)) {
+        Node* op = pop(&ops);
+        if (strcmp(op->value, "(") == 0 || strcmp(op->value, ")") == 0) {
+            reportError("Error: Unbalanced parentheses\n");
+            free(op);
+            goto fail;
+        }
+        if (isEmpty(&nodes)) {
+            reportError("Error: Too few operands for operator '%s'\n", op->value);
+            free(op);
+            goto fail;
+        }
+        Node* right = pop(&nodes);
+        if (isEmpty(&nodes)) {
+            reportError("Error: Too few operands for operator '%s'\n", op->value);
+            free(op);
+            freeTree(right);
+            goto fail;
+        }
+        Node* left = pop(&nodes);
+        op->left = left;
+        op->right = right;
+        push(&nodes, op);
+    }
+
+    //Only one tree should remain
+    if (nodes.top != 0) {
+        reportError("Error: Too many operands\n");
+        goto fail;
+    }
+
+    free(exprCopy);
+    Node* root = pop(&nodes);
+    freeStack(&nodes);
+    freeStack(&ops);
+    return root;
+
+fail:
+    //Partial trees and pending operators are freed, not leaked
+    while (!isEmpty(&nodes)) freeTree(pop(&nodes));
+    while (!isEmpty(&ops)) freeTree(pop(&ops));
+    freeStack(&nodes);
+    freeStack(&ops);
+    free(exprCopy);
+    return NULL;
+}
+
+
+// ----------- PRATT Infix -----------
+
+//Infix parser by precedence climbing (Pratt parsing). Operators are small
+//codes with their binding power in a table, a parenthesis is only a frame
+//on an explicit stack (never a Node), and tokens are classified in place
+//without strdup or strcmp. The stack grows as needed, so nesting is not
+//limited by MAX, and every error path frees the partial trees.
+
+enum { OP_NONE, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_OPEN };
+static const char* const opText[] = {"", "+", "-", "*", "/"};
+
+//Left binding power. The right operand is parsed with one more, so equal
+//operators group to the left, as in buildTreeFromInfix
+static const unsigned char bindingPower[] = {0, 1, 1, 2, 2};
+
+//An operator waiting for its right operand, or an open parenthesis
+typedef struct {
+    Node* left;                  //NULL for a parenthesis
+    unsigned char op;            //OP_* or OP_OPEN
+    unsigned char minPower;      //What the enclosing expression accepted
+} PrattFrame;
+
+enum { PRATT_END, PRATT_OPERAND, PRATT_OPERATOR, PRATT_OPEN, PRATT_CLOSE, PRATT_INVALID };
+
+//Classifies the token at text (len bytes); op gets the operator code
+static int prattToken(const char* text, size_t len, int* op) {
+    *op = OP_NONE;
+    if (len == 0) return PRATT_END;
+    if (len == 1) {
+        switch (text[0]) {
+            case '+': *op = OP_ADD; return PRATT_OPERATOR;
+            case '-': *op = OP_SUB; return PRATT_OPERATOR;
+            case '*': *op = OP_MUL; return PRATT_OPERATOR;
+            case '/': *op = OP_DIV; return PRATT_OPERATOR;
+            case '(': return PRATT_OPEN;
+            case ')': return PRATT_CLOSE;
+        }
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!isalnum((unsigned char)text[i])) return PRATT_INVALID;
+    }
+    return PRATT_OPERAND;
+}
+
+#define PRATT_INLINE_FRAMES 64
+
+//Returns a new top frame, moving the stack to the heap once the inline
+//frames are full
+static PrattFrame* prattPush(PrattFrame** frames, int* top, int* capacity, PrattFrame* inlineFrames) {
+    if (*top == *capacity) {
+        *capacity *= 2;
+        PrattFrame* grown = (PrattFrame*)(*frames == inlineFrames ? malloc(sizeof(PrattFrame) * (size_t)*capacity)
+                                                                 : realloc(*frames, sizeof(PrattFrame) * (size_t)*capacity));
+        if (!grown) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        if (*frames == inlineFrames) memcpy(grown, inlineFrames, sizeof(PrattFrame) * PRATT_INLINE_FRAMES);
+        *frames = grown;
+    }
+    return &(*frames)[(*top)++];
+}
+
+//Parses expr; reports the first error it finds and returns NULL
+static Node* prattParse(const char* expr) {
+    PrattFrame inlineFrames[PRATT_INLINE_FRAMES];
+    PrattFrame* frames = inlineFrames;
+    int top = 0, capacity = PRATT_INLINE_FRAMES;
+    Node* operand = NULL;        //The finished left-hand side, if any
+    int minPower = 0;
+    bool seen = false;
+    const char* p = expr;
+
+    for (;;) {
+        while (*p == ' ') p++;
+        const char* text = p;
+        while (*p && *p != ' ') p++;
+        int op;
+        int kind = prattToken(text, (size_t)(p - text), &op);
+        if (kind == PRATT_INVALID) {
+            reportError("Error: Invalid token '%.*s'\n", (int)(p - text < 64 ? p - text : 64), text);
+            goto fail;
+        }
+        bool first = !seen;
+        seen = seen || kind != PRATT_END;
+
+        if (!operand) {
+            //An operand or "(" must come next
+            if (kind == PRATT_OPERAND) {
+                operand = createNode("");
+                size_t keep = (size_t)(p - text);
+                if (keep > sizeof(operand->value) - 1) keep = sizeof(operand->value) - 1;
+                memcpy(operand->value, text, keep);
+                operand->value[keep] = '\0';
+                continue;
+            }
+            if (kind == PRATT_OPEN) {
+                PrattFrame* f = prattPush(&frames, &top, &capacity, inlineFrames);
+                f->left = NULL;
+                f->op = OP_OPEN;
+                f->minPower = (unsigned char)minPower;
+                minPower = 0;
+                continue;
+            }
+            if (first && kind == PRATT_END) {
+                reportError("Error: No valid tokens found\n");
+            } else if (kind == PRATT_OPERATOR && (top == 0 || frames[top - 1].op == OP_OPEN)) {
+                reportError("Error: Too few operands for operator '%s'\n", opText[op]);
+            } else if (top > 0 && frames[top - 1].op != OP_OPEN) {
+                reportError("Error: Too few operands for operator '%s'\n", opText[frames[top - 1].op]);
+            } else if (kind == PRATT_CLOSE) {
+                reportError("Error: Too many operands\n"); //"( )", as the stack builder reports it
+            } else {
+                reportError("Error: Unbalanced parentheses\n");
+            }
+            goto fail;
+        }
+
+        if (kind == PRATT_OPERAND || kind == PRATT_OPEN) {
+            reportError("Error: Too many operands\n");
+            goto fail;
+        }
+        //An operator, ")" or the end: first finish every pending operator
+        //that binds at least as tightly (all of them for ")" and the end)
+        int power = kind == PRATT_OPERATOR ? bindingPower[op] : 0;
+        while (top > 0 && frames[top - 1].op != OP_OPEN && (kind != PRATT_OPERATOR || power < minPower)) {
+            PrattFrame* f = &frames[--top];
+            Node* node = createNode(opText[f->op]);
+            node->left = f->left;
+            node->right = operand;
+            operand = node;
+            minPower = f->minPower;
+        }
+        if (kind == PRATT_OPERATOR) {
+            PrattFrame* f = prattPush(&frames, &top, &capacity, inlineFrames);
+            f->left = operand;
+            f->op = (unsigned char)op;
+            f->minPower = (unsigned char)minPower;
+            minPower = power + 1;
+            operand = NULL;
+        } else if (kind == PRATT_CLOSE) {
+            if (top == 0) {
+                reportError("Error: Unbalanced parentheses\n");
+                goto fail;
+            }
+            minPower = frames[--top].minPower;
+        } else {
+            if (top > 0) {
+                reportError("Error: Unbalanced parentheses\n");
+                goto fail;
+            }
+            if (frames != inlineFrames) free(frames);
+            return operand;
+        }
+    }
+
+fail:
+    freeTree(operand);
+    while (top > 0) freeTree(frames[--top].left);
+    if (frames != inlineFrames) free(frames);
+    return NULL;
+}
+
+//Builds the tree of an infix expression with prattParse. When it fails
+//on a line the original program read whole (shorter than its 256-byte
+//copy), the stack builder is rerun so the error (or the few inputs it
+//tolerates, such as "a ( )") stay exactly as before. A longer line was
+//cut short by that copy, so prattParse's error stands.
+Node* buildTreeFromInfixPratt(const char* expr) {
+    char message[ERROR_CAPTURE_SIZE] = "";
+    char* outerCapture = errorCapture;
+    errorCapture = message;
+    Node* root = prattParse(expr);
+    errorCapture = outerCapture;
+    if (root) return root;
+    if (strlen(expr) < LEGACY_INFIX_BYTES) return buildTreeFromInfix(expr);
+    reportError("%s\n", message);
+    return NULL;
+}
+
+//prattParse for tokens that come one at a time and are not kept. Its
+//errors depend only on the last token and the open parentheses, so the
+//check needs no stack. Writing the postfix form also needs the pending
+//operators: one byte each on a spill stack, the operator code (or
+//OP_OPEN) and the binding power the enclosing expression accepted.
+#define PRATT_FRAME(op, power) ((char)((op) | (power) << 3))
+#define PRATT_FRAME_OP(frame) ((frame) & 7)
+#define PRATT_FRAME_POWER(frame) ((frame) >> 3 & 3)
+
+typedef struct {
+    bool operand;        //A finished left-hand side is waiting
+    int last;            //OP_* of the last token, OP_OPEN for "(", else OP_NONE
+    long long open;      //Parentheses still open
+    SpillStack* frames;  //NULL when only checking
+    int minPower;
+} PrattStream;
+
+//Starts an expression; frames (if set) must be empty
+void initPrattStream(PrattStream* p, SpillStack* frames) {
+    p->operand = false;
+    p->last = OP_NONE;
+    p->open = 0;
+    p->frames = frames;
+    p->minPower = 0;
+}
+
+//Reports the error prattParse gives for a token the stream cannot take
+static void prattStreamError(PrattStream* p, int kind, int op, const char* text, size_t len) {
+    if (kind == PRATT_INVALID) {
+        reportError("Error: Invalid token '%.*s'\n", (int)(len < 64 ? len : 64), text);
+    } else if (!p->operand) {
+        //The top frame is the last token: an operator, "(" or none
+        if (kind == PRATT_OPERATOR && (p->last == OP_NONE || p->last == OP_OPEN)) {
+            reportError("Error: Too few operands for operator '%s'\n", opText[op]);
+        } else if (p->last != OP_NONE && p->last != OP_OPEN) {
+            reportError("Error: Too few operands for operator '%s'\n", opText[p->last]);
+        } else if (kind == PRATT_CLOSE) {
+            reportError("Error: Too many operands\n");
+        } else {
+            reportError("Error: Unbalanced parentheses\n");
+        }
+    } else if (kind == PRATT_OPERAND || kind == PRATT_OPEN) {
+        reportError("Error: Too many operands\n");
+    } else {
+        reportError("Error: Unbalanced parentheses\n");
+    }
+}
+
+//Whether prattParse takes a token of this kind next. Where an operand is
+//expected, an operand or "(" may come; after one, an operator, ")" or the
+//end. It is one lookup and no branches on kind, which a random expression
+//would mispredict.
+static inline bool prattAccepts(const PrattStream* p, int kind) {
+    static const unsigned char allowed[2] = {
+        1 << PRATT_OPERAND | 1 << PRATT_OPEN,
+        1 << PRATT_OPERATOR | 1 << PRATT_CLOSE | 1 << PRATT_END,
+    };
+    return (allowed[p->operand] >> kind & 1) & !((kind == PRATT_CLOSE) & (p->open == 0)) &
+           !((kind == PRATT_END) & (p->open > 0));
+}
+
+//Moves past a token that prattAccepts took
+static inline void prattAdvance(PrattStream* p, int kind, int op) {
+    p->open += (kind == PRATT_OPEN) - (kind == PRATT_CLOSE);
+    p->operand = kind == PRATT_OPERAND || kind == PRATT_CLOSE;
+    p->last = kind == PRATT_OPERATOR ? op : kind == PRATT_OPEN ? OP_OPEN : OP_NONE;
+}
+
+//Takes the next token as prattToken classified it (PRATT_END after the
+//last one). With frames, the postfix tokens it completes are written to
+//out, if out is set. Errors go through reportError with prattParse's
+//text, and false is returned.
+bool prattStreamToken(PrattStream* p, int kind, int op, const char* text, size_t len, FILE* out) {
+    if (!prattAccepts(p, kind)) {
+        prattStreamError(p, kind, op, text, len);
+        return false;
+    }
+
+    if (p->frames) {
+        if (kind == PRATT_OPERAND) {
+            if (out) {
+                fwrite(text, 1, len, out);
+                putc(' ', out);
+            }
+        } else if (kind == PRATT_OPEN) {
+            spillPush(p->frames, PRATT_FRAME(OP_OPEN, p->minPower));
+            p->minPower = 0;
+        } else {
+            //An operator, ")" or the end: first finish every pending operator
+            //that binds at least as tightly (all of them for ")" and the end)
+            int power = kind == PRATT_OPERATOR ? bindingPower[op] : 0;
+            while (!spillIsEmpty(p->frames) && PRATT_FRAME_OP(spillPeek(p->frames)) != OP_OPEN &&
+                   (kind != PRATT_OPERATOR || power < p->minPower)) {
+                char frame = spillPop(p->frames);
+                if (out) {
+                    fputs(opText[PRATT_FRAME_OP(frame)], out);
+                    putc(' ', out);
+                }
+                p->minPower = PRATT_FRAME_POWER(frame);
+            }
+            if (kind == PRATT_OPERATOR) {
+                spillPush(p->frames, PRATT_FRAME(op, p->minPower));
+                p->minPower = power + 1;
+            } else if (kind == PRATT_CLOSE) {
+                p->minPower = PRATT_FRAME_POWER(spillPop(p->frames));
+            }
+        }
+    }
+    prattAdvance(p, kind, op);
+    return true;
+}
+
+// ----------- CONVERSION Driver -----------
+
+//Prints the same hint as the in-memory path for a malformed expression
+void printFormatError(const char* type) {
+    reportError("\nError: Invalid %s expression format\n", type);
+    if (errorCapture) return;
+    printf("\nThere's seems to be a problem, To convert a Notation please press \"--help\".\n");
+    printf("Usage: ./<program_name> \"--help\".\n\n");
+}
+
+//Validates the input and builds its tree with the sequential builders.
+//Token values are kept in tokens (tokenCount is 0 for infix) until the
+//caller is done with the tree. Returns NULL after printing the error.
+Node* parseExpression(char* input, const char* inputType, Token* tokens, int maxTokens, int* tokenCount) {
+    *tokenCount = 0;
+    if (strcmp(inputType, "infix") == 0) {
+        //Invalid infix format chevking
+        char firstChar = input[0];
+        char lastChar = input[strlen(input) - 1];
+        if (firstChar == '+' || firstChar == '-' || firstChar == '*' || firstChar == '/' ||
+            lastChar == '+' || lastChar == '-' || lastChar == '*' || lastChar == '/') {
+            reportError("\nError: Infix expression cannot start or end with an operator\n");
+            return NULL;
+        }
+        return buildTreeFromInfixPratt(input);
+    }
+    if (strcmp(inputType, "prefix") != 0 && strcmp(inputType, "postfix") != 0) {
+        reportError("\nError: Unknown input type\n");
+        return NULL;
+    }
+
+    int count = tokenize(input, tokens, maxTokens);
+    if (count < 0) return NULL;
+
+    Node* root;
+    if (strcmp(inputType, "prefix") == 0) {
+        if (!validatePrefix(tokens, count)) {
+            printFormatError("prefix");
+            freeTokens(tokens, count);
+            return NULL;
+        }
+        int index = 0;
+        root = buildTreeFromPrefix(tokens, &index, count);
+    } else {
+        if (!validatePostfix(tokens, count)) {
+            printFormatError("postfix");
+            freeTokens(tokens, count);
+            return NULL;
+        }
+        root = buildTreeFromPostfix(tokens, count);
+    }
+    *tokenCount = count;
+    return root;
+}
+
+//Prints the unknown output type error used by every conversion mode
+void printOutputTypeError(void) {
+    printf("\nError: Unknown output type\n");
+    printf("\nThere's seems to be a problem, To convert a Notation please press \"--help\".\n");
+    printf("Usage: ./<program_name> \"--guide\".\n");
+    printf("Usage: <program_name.exe> \"--guide\".\n\n");
+}
+
+//Prints prefix, infix and postfix from one sizing walk and one rendering
+//walk into a single buffer
+void printAllNotations(Node* root) {
+    size_t tokenBytes = 0, operators = 0;
+    measureAll(root, &tokenBytes, &operators);
+    size_t sizes[] = {tokenBytes, tokenBytes + 4 * operators, tokenBytes};
+    size_t length = 0;
+    for (int n = NOTATION_PREFIX; n <= NOTATION_POSTFIX; n++) {
+        length += 1 + strlen(notationHeader[n]) + sizes[n] + 1;
+    }
+    char* text = (char*)malloc(length);
+    if (!text) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+
+    //Lay out "\n<header><expression>\n" three times and keep each cursor
+    char* cursor[3];
+    char* out = text;
+    for (int n = NOTATION_PREFIX; n <= NOTATION_POSTFIX; n++) {
+        size_t headerLen = strlen(notationHeader[n]);
+        *out++ = '\n';
+        memcpy(out, notationHeader[n], headerLen);
+        cursor[n] = out + headerLen;
+        out = cursor[n] + sizes[n];
+        *out++ = '\n';
+    }
+    renderAll(root, &cursor[NOTATION_PREFIX], &cursor[NOTATION_INFIX], &cursor[NOTATION_POSTFIX]);
+    writeOutput(text, length);
+    free(text);
+}
+
+//Prints the tree in the requested notation ("all" prints all three);
+//false for an unknown type.
+//The output is sized first, rendered into one buffer and written at once.
+bool printExpression(Node* root, const char* outputType) {
+    if (strcmp(outputType, "all") == 0) {
+        printAllNotations(root);
+        return true;
+    }
+    int notation = notationOf(outputType);
+    if (notation < 0) {
+        printf("\n");
+        printOutputTypeError();
+        return false;
+    }
+    size_t headerLen = strlen(notationHeader[notation]);
+    size_t length = 1 + headerLen + renderedSize(root, notation) + 1;
+    char* text = (char*)malloc(length);
+    if (!text) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    text[0] = '\n';
+    memcpy(text + 1, notationHeader[notation], headerLen);
+    *renderTree(root, notation, text + 1 + headerLen) = '\n';
+    writeOutput(text, length);
+    free(text);
+    return true;
+}
+
+//Prints only the first count tokens of the converted expression, pulled
+//one at a time so the rest of the output is never rendered
+int convertHead(char* input, const char* inputType, const char* outputType, long long count) {
+    int notation = notationOf(outputType);
+    if (notation < 0) {
+        printOutputTypeError();
+        return 1;
+    }
+    int maxTokens = (int)(strlen(input) / 2 + 1);
+    Token* tokens = (Token*)malloc(sizeof(Token) * (size_t)maxTokens);
+    if (!tokens) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int tokenCount;
+    Node* root = parseExpression(input, inputType, tokens, maxTokens, &tokenCount);
+    if (!root) {
+        free(tokens);
+        return 1;
+    }
+
+    TokenIterator it;
+    initTokenIterator(&it, root, notation);
+    printf("\n%s", notationHeader[notation]);
+    const char* token;
+    long long printed = 0;
+    while (printed < count && (token = nextToken(&it))) {
+        fputs(token, stdout);
+        putchar(' ');
+        printed++;
+    }
+    if (nextToken(&it)) fputs("...", stdout);
+    printf("\n");
+    freeTokenIterator(&it);
+
+    freeTree(root);
+    freeTokens(tokens, tokenCount);
+    free(tokens);
+    return 0;
+}
+
+// ----------- CANONICAL Form -----------
+
+//128-bit structural fingerprint: two independently seeded 64-bit hashes
+typedef struct {
+    unsigned long long hi, lo;
+} Fingerprint;
+
+//splitmix64 finalizer
+static unsigned long long mix64(unsigned long long x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+//Fingerprint of an operand: FNV-1a of its text in both lanes
+Fingerprint leafFingerprint(const char* value) {
+    unsigned long long hi = 0xcbf29ce484222325ULL, lo = 0x84222325cbf29ce4ULL;
+    for (const unsigned char* p = (const unsigned char*)value; *p; p++) {
+        hi = (hi ^ *p) * 0x100000001b3ULL;
+        lo = (lo ^ *p) * 0x100000001b3ULL;
+    }
+    Fingerprint fp = {mix64(hi), mix64(lo ^ 0x5bd1e995ULL)};
+    return fp;
+}
+
+//Fingerprint of an operator node; order-sensitive in its children
+Fingerprint combineFingerprint(char op, Fingerprint left, Fingerprint right) {
+    Fingerprint fp;
+    fp.hi = mix64(mix64(left.hi ^ (unsigned long long)op) + right.hi * 0x9e3779b97f4a7c15ULL);
+    fp.lo = mix64(mix64(left.lo + (unsigned long long)op * 0xc2b2ae3d27d4eb4fULL) ^ right.lo);
+    return fp;
+}
+
+//Total order on trees by structure, used when fingerprints collide:
+//node values in preorder, a missing child first. Pairs of subtrees still
+//to compare wait on a stack, so deep trees are fine.
+int compareTrees(Node* a, Node* b) {
+    Stack pending;
+    initStack(&pending);
+    int c;
+    for (;;) {
+        if (!a || !b) {
+            c = (a != NULL) - (b != NULL);
+        } else if (!(c = strcmp(a->value, b->value))) {
+            push(&pending, b->right); //The right pair after the left one
+            push(&pending, a->right);
+            a = a->left;
+            b = b->left;
+            continue;
+        }
+        if (c || isEmpty(&pending)) break;
+        a = pop(&pending);
+        b = pop(&pending);
+    }
+    freeStack(&pending);
+    return c;
+}
+
+//Operand of a flattened chain, with its canonical fingerprint
+typedef struct {
+    Node* node;
+    Fingerprint fp;
+} ChainOperand;
+
+static int compareChainOperands(const void* x, const void* y) {
+    const ChainOperand* a = (const ChainOperand*)x;
+    const ChainOperand* b = (const ChainOperand*)y;
+    if (a->fp.hi != b->fp.hi) return a->fp.hi < b->fp.hi ? -1 : 1;
+    if (a->fp.lo != b->fp.lo) return a->fp.lo < b->fp.lo ? -1 : 1;
+    return compareTrees(a->node, b->node);
+}
+
+//One chain (or - / node) whose operands are being canonicalized
+typedef struct {
+    int result;             //Operand slot of the parent chain, -1 for the root
+    int firstOperand, nextOperand;
+    int firstOp;
+    char op;
+} ChainFrame;
+
+//Explicit stacks of canonicalize, as in balanceChains
+typedef struct {
+    ChainFrame* frames;
+    int frameCount, frameCapacity;
+    Node** walk;            //Chain nodes still to visit
+    int walkCount, walkCapacity;
+    ChainOperand* operands; //Operands of the open chains, in order
+    int operandCount, operandCapacity;
+    Node** ops;             //Operator nodes of the open chains
+    int opCount, opCapacity;
+} Chain;
+
+static void addChainOperand(Chain* chain, Node* node) {
+    chain->operands = (ChainOperand*)growArray(chain->operands, chain->operandCount, &chain->operandCapacity,
+                                               sizeof(ChainOperand));
+    chain->operands[chain->operandCount++].node = node;
+}
+
+static void addChainOp(Chain* chain, Node* node) {
+    chain->ops = (Node**)growArray(chain->ops, chain->opCount, &chain->opCapacity, sizeof(Node*));
+    chain->ops[chain->opCount++] = node;
+}
+
+//Opens a frame for the operator node that goes in operand slot result:
+//the operands and operator nodes of its maximal chain of + or *, left to
+//right, or its two children and itself for - and /
+static void collectChain(Chain* chain, Node* node, int result) {
+    chain->frames = (ChainFrame*)growArray(chain->frames, chain->frameCount, &chain->frameCapacity, sizeof(ChainFrame));
+    ChainFrame* frame = &chain->frames[chain->frameCount++];
+    frame->result = result;
+    frame->firstOperand = frame->nextOperand = chain->operandCount;
+    frame->firstOp = chain->opCount;
+    frame->op = node->value[0];
+    if (frame->op != '+' && frame->op != '*') {
+        addChainOperand(chain, node->left);
+        addChainOperand(chain, node->right);
+        addChainOp(chain, node);
+        return;
+    }
+    chain->walk[chain->walkCount++] = node;
+    while (chain->walkCount) {
+        Node* next = chain->walk[--chain->walkCount];
+        if (next->left && next->right && next->value[0] == frame->op && next->value[1] == '\0') {
+            addChainOp(chain, next);
+            chain->walk = (Node**)growArray(chain->walk, chain->walkCount + 1, &chain->walkCapacity, sizeof(Node*));
+            chain->walk[chain->walkCount++] = next->right;
+            chain->walk[chain->walkCount++] = next->left; //Left side comes off first
+        } else {
+            addChainOperand(chain, next);
+        }
+    }
+}
+
+//Rewrites the tree in place into its canonical form and returns the new
+//root. Chains of the associative, commutative + and * are flattened,
+//their operands sorted by fingerprint (then structure) and relinked as a
+//left-deep chain using the same operator nodes; - and / keep their
+//operand order. Equivalent inputs give identical trees and fingerprints.
+//Chains are opened on explicit stacks, so depth is not limited.
+Node* canonicalize(Node* root, Fingerprint* fp) {
+    if (!root->left || !root->right) {
+        *fp = leafFingerprint(root->value);
+        return root;
+    }
+    Chain chain = {0};
+    chain.walk = (Node**)growArray(NULL, 0, &chain.walkCapacity, sizeof(Node*));
+    collectChain(&chain, root, -1);
+    while (chain.frameCount) {
+        ChainFrame* frame = &chain.frames[chain.frameCount - 1];
+        if (frame->nextOperand < chain.operandCount) {
+            ChainOperand* operand = &chain.operands[frame->nextOperand];
+            if (operand->node->left && operand->node->right) {
+                collectChain(&chain, operand->node, frame->nextOperand++);
+            } else {
+                operand->fp = leafFingerprint(operand->node->value);
+                frame->nextOperand++;
+            }
+            continue;
+        }
+
+        //Every operand is canonical; sort a chain's, then relink them
+        int first = frame->firstOperand, count = chain.operandCount - first;
+        ChainOperand* operands = chain.operands + first;
+        Node** ops = chain.ops + frame->firstOp;
+        if (frame->op == '+' || frame->op == '*') {
+            qsort(operands, (size_t)count, sizeof(ChainOperand), compareChainOperands);
+        }
+        Node* acc = operands[0].node;
+        Fingerprint accFp = operands[0].fp;
+        for (int k = 1; k < count; k++) {
+            Node* node = ops[k - 1];
+            node->left = acc;
+            node->right = operands[k].node;
+            accFp = combineFingerprint(frame->op, accFp, operands[k].fp);
+            acc = node;
+        }
+        int result = frame->result;
+        chain.operandCount = first;
+        chain.opCount = frame->firstOp;
+        chain.frameCount--;
+        if (result < 0) {
+            root = acc;
+            *fp = accFp;
+        } else {
+            chain.operands[result].node = acc;
+            chain.operands[result].fp = accFp;
+        }
+    }
+    free(chain.frames);
+    free(chain.walk);
+    free(chain.operands);
+    free(chain.ops);
+    return root;
+}
+
+//Canonical mode: ./Convert --canonical "<expression>" <input_type> <output_type>
+int convertCanonical(char* input, const char* inputType, const char* outputType) {
+    int maxTokens = (int)(strlen(input) / 2 + 1);
+    Token* tokens = (Token*)malloc(sizeof(Token) * (size_t)maxTokens);
+    if (!tokens) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int tokenCount;
+    Node* root = parseExpression(input, inputType, tokens, maxTokens, &tokenCount);
+    if (!root) {
+        free(tokens);
+        return 1;
+    }
+
+    Fingerprint fp;
+    root = canonicalize(root, &fp);
+    bool printed = printExpression(root, outputType);
+    if (printed) printf("Fingerprint: %016llx%016llx\n", fp.hi, fp.lo);
+    freeTree(root);
+    freeTokens(tokens, tokenCount);
+    free(tokens);
+    return printed ? 0 : 1;
+}
+
+// ----------- STACK-ORDER Postfix -----------
+
+//Postfix that needs the smallest evaluation stack (Sethi-Ullman order).
+//A subtree's Ershov number is the stack depth its evaluation needs: 1
+//for an operand; for an operator, the larger of its children's numbers,
+//plus one if they are equal. Emitting the more demanding child first
+//keeps the stack at that depth, O(log n) for balanced trees instead of
+//O(n) for right-leaning ones. When the right child goes first, + and *
+//are unchanged, and - and / are written as the reverse operators ~- and
+//~/ ("x y ~-" is y - x).
+
+typedef struct {
+    int* need;              //Ershov number, by preorder position
+    int* size;              //Subtree node count, by preorder position
+} StackOrder;
+
+//Fills need and size for the subtree at preorder position i. Returns its
+//size; leftFirst gets the stack depth of plain left-first postfix.
+static int measureStackOrder(StackOrder* so, Node* node, int i, int* leftFirst) {
+    if (!node->left || !node->right) {
+        so->need[i] = 1;
+        so->size[i] = 1;
+        *leftFirst = 1;
+        return 1;
+    }
+    int leftDepth, rightDepth;
+    int leftSize = measureStackOrder(so, node->left, i + 1, &leftDepth);
+    int rightSize = measureStackOrder(so, node->right, i + 1 + leftSize, &rightDepth);
+    int l = so->need[i + 1], r = so->need[i + 1 + leftSize];
+    so->need[i] = l == r ? l + 1 : (l > r ? l : r);
+    so->size[i] = 1 + leftSize + rightSize;
+    *leftFirst = leftDepth > rightDepth + 1 ? leftDepth : rightDepth + 1;
+    return so->size[i];
+}
+
+static char* renderStackOrder(StackOrder* so, Node* node, int i, char* out) {
+    if (!node->left || !node->right) return putToken(out, node->value);
+    int left = i + 1, right = i + 1 + so->size[i + 1];
+    if (so->need[left] >= so->need[right]) {
+        out = renderStackOrder(so, node->left, left, out);
+        out = renderStackOrder(so, node->right, right, out);
+        return putToken(out, node->value);
+    }
+    out = renderStackOrder(so, node->right, right, out);
+    out = renderStackOrder(so, node->left, left, out);
+    if (node->value[0] == '-' || node->value[0] == '/') *out++ = '~';
+    return putToken(out, node->value);
+}
+
+//Prints the stack-order postfix of an expression and the evaluation
+//stack depth it needs, compared with plain left-first postfix
+int convertStackOrder(char* input, const char* inputType) {
+    int maxTokens = (int)(strlen(input) / 2 + 1);
+    Token* tokens = (Token*)malloc(sizeof(Token) * (size_t)maxTokens);
+    if (!tokens) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int tokenCount;
+    Node* root = parseExpression(input, inputType, tokens, maxTokens, &tokenCount);
+    if (!root) {
+        free(tokens);
+        return 1;
+    }
+
+    //Node count and operator count bound the output (each ~ adds a byte)
+    size_t tokenBytes = 0, operators = 0;
+    measureAll(root, &tokenBytes, &operators);
+    int nodes = (int)(2 * operators + 1);
+    StackOrder so;
+    so.need = (int*)malloc(sizeof(int) * (size_t)nodes);
+    so.size = (int*)malloc(sizeof(int) * (size_t)nodes);
+    char* text = (char*)malloc(tokenBytes + operators + 1);
+    if (!so.need || !so.size || !text) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int leftFirst;
+    measureStackOrder(&so, root, 0, &leftFirst);
+    char* end = renderStackOrder(&so, root, 0, text);
+
+    printf("\nPostfix Expression (stack order): ");
+    writeOutput(text, (size_t)(end - text));
+    printf("\nStack depth: %d (left-first postfix needs %d)\n", so.need[0], leftFirst);
+
+    free(text);
+    free(so.need);
+    free(so.size);
+    freeTree(root);
+    freeTokens(tokens, tokenCount);
+    free(tokens);
+    return 0;
+}
+
+// ----------- BALANCED Chains -----------
+
+//Rebuilds every maximal chain of one associative operator as a shallow
+//tree: a + b + c + d, parsed as ( ( a + b ) + c ) + d, becomes
+//( a + b ) + ( c + d ), so a chain of n operands is about log2 n deep
+//instead of n - 1. Operands keep their left-to-right order (only
+//associativity is used, never commutativity), and the chain's own
+//operator nodes are relinked, so nothing is allocated per node.
+//Operands are balanced first, and a chain is then joined by repeatedly
+//merging the adjacent pair whose taller member is shortest (leftmost
+//first). That gives the lowest tree possible for those operands in that
+//order, so balancing never makes a tree deeper.
+//- and / are not associative: a - b - c is not a - ( b - c ). Their
+//chains are kept as they are and only their operands are balanced.
+//Everything uses explicit stacks, since the trees worth balancing are
+//the ones too deep to walk recursively.
+
+//One chain (or - / node) whose operands are being balanced
+typedef struct {
+    int result;             //Operand slot of the parent chain, -1 for the root
+    int firstOperand, nextOperand;
+    int firstOp;
+    char op;
+} BalanceFrame;
+
+typedef struct {
+    BalanceFrame* frames;
+    int frameCount, frameCapacity;
+    Node** walk;            //Chain nodes still to visit
+    int walkCount, walkCapacity;
+    Node** operands;        //Operands of the open chains, in order
+    int* heights;           //Height of each operand once balanced
+    int operandCount, operandCapacity;
+    Node** ops;             //Operator nodes of the open chains
+    int opCount, opCapacity;
+} BalanceWork;
+
+//Height of a tree, counting an operand as 1
+int treeDepth(Node* root) {
+    if (!root) return 0;
+    typedef struct {
+        Node* node;
+        int depth;
+    } DepthFrame;
+    int count = 0, capacity = 0, depth = 0;
+    DepthFrame* stack = (DepthFrame*)growArray(NULL, 0, &capacity, sizeof(DepthFrame));
+    stack[count].node = root;
+    stack[count++].depth = 1;
+    while (count) {
+        DepthFrame frame = stack[--count];
+        if (frame.depth > depth) depth = frame.depth;
+        if (!frame.node->left || !frame.node->right) continue;
+        stack = (DepthFrame*)growArray(stack, count + 1, &capacity, sizeof(DepthFrame));
+        stack[count].node = frame.node->left;
+        stack[count++].depth = frame.depth + 1;
+        stack[count].node = frame.node->right;
+        stack[count++].depth = frame.depth + 1;
+    }
+    free(stack);
+    return depth;
+}
+
+static void addBalanceOperand(BalanceWork* w, Node* node) {
+    if (w->operandCount == w->operandCapacity) {
+        int capacity = w->operandCapacity;
+        w->operands = (Node**)growArray(w->operands, w->operandCount, &w->operandCapacity, sizeof(Node*));
+        w->heights = (int*)growArray(w->heights, w->operandCount, &capacity, sizeof(int));
+    }
+    w->operands[w->operandCount++] = node;
+}
+
+static void addBalanceOp(BalanceWork* w, Node* node) {
+    w->ops = (Node**)growArray(w->ops, w->opCount, &w->opCapacity, sizeof(Node*));
+    w->ops[w->opCount++] = node;
+}
+
+//Opens a frame for the operator node that goes in operand slot result:
+//the operands and operator nodes of its chain of + or *, or its two
+//children and itself for - and /
+static void openBalanceFrame(BalanceWork* w, Node* node, int result) {
+    w->frames = (BalanceFrame*)growArray(w->frames, w->frameCount, &w->frameCapacity, sizeof(BalanceFrame));
+    BalanceFrame* frame = &w->frames[w->frameCount++];
+    frame->result = result;
+    frame->firstOperand = frame->nextOperand = w->operandCount;
+    frame->firstOp = w->opCount;
+    frame->op = node->value[0];
+    if (frame->op != '+' && frame->op != '*') {
+        addBalanceOperand(w, node->left);
+        addBalanceOperand(w, node->right);
+        addBalanceOp(w, node);
+        return;
+    }
+    w->walk[w->walkCount++] = node;
+    while (w->walkCount) {
+        Node* next = w->walk[--w->walkCount];
+        if (next->left && next->right && next->value[0] == frame->op && next->value[1] == '\0') {
+            addBalanceOp(w, next);
+            w->walk = (Node**)growArray(w->walk, w->walkCount + 1, &w->walkCapacity, sizeof(Node*));
+            w->walk[w->walkCount++] = next->right;
+            w->walk[w->walkCount++] = next->left; //Left side comes off first
+        } else {
+            addBalanceOperand(w, next);
+        }
+    }
+}
+
+//Joins count balanced operands (with their heights) into one tree with
+//the chain's operator nodes. Each pass over the row merges, left to
+//right, the adjacent pairs no taller than level, the lowest level any
+//pair has; merged pairs are taller than level, so they wait for a later
+//pass. Returns the root and sets its height.
+static Node* joinLowest(BalanceWork* w, Node** items, int* heights, int count, int* height) {
+    while (count > 1) {
+        int level = INT_MAX;
+        for (int i = 0; i + 1 < count; i++) {
+            int pair = heights[i] > heights[i + 1] ? heights[i] : heights[i + 1];
+            if (pair < level) level = pair;
+        }
+        int kept = 0;
+        for (int i = 0; i < count; i++, kept++) {
+            if (i + 1 < count && heights[i] <= level && heights[i + 1] <= level) {
+                Node* node = w->ops[--w->opCount];
+                node->left = items[i];
+                node->right = items[i + 1];
+                items[kept] = node;
+                heights[kept] = level + 1;
+                i++;
+            } else {
+                items[kept] = items[i];
+                heights[kept] = heights[i];
+            }
+        }
+        count = kept;
+    }
+    *height = heights[0];
+    return items[0];
+}
+
+//Balances every + and * chain of the tree in place and returns the new
+//root, which evaluates the same operands in the same order. depth (if
+//not NULL) gets the height of the result.
+Node* balanceChains(Node* root, int* depth) {
+    int height = 1;
+    if (root && root->left && root->right) {
+        BalanceWork w = {0};
+        w.walk = (Node**)growArray(NULL, 0, &w.walkCapacity, sizeof(Node*));
+        openBalanceFrame(&w, root, -1);
+        while (w.frameCount) {
+            BalanceFrame* frame = &w.frames[w.frameCount - 1];
+            if (frame->nextOperand < w.operandCount) {
+                int i = frame->nextOperand++;
+                Node* operand = w.operands[i];
+                w.heights[i] = 1;
+                if (operand->left && operand->right) openBalanceFrame(&w, operand, i);
+                continue;
+            }
+
+            //Every operand is balanced; join them
+            Node* joined;
+            int first = frame->firstOperand;
+            if (frame->op == '+' || frame->op == '*') {
+                joined = joinLowest(&w, w.operands + first, w.heights + first, w.operandCount - first, &height);
+            } else {
+                joined = w.ops[frame->firstOp];
+                joined->left = w.operands[first];
+                joined->right = w.operands[first + 1];
+                height = (w.heights[first] > w.heights[first + 1] ? w.heights[first] : w.heights[first + 1]) + 1;
+            }
+            int result = frame->result;
+            w.operandCount = first;
+            w.opCount = frame->firstOp;
+            w.frameCount--;
+            if (result < 0) {
+                root = joined;
+            } else {
+                w.operands[result] = joined;
+                w.heights[result] = height;
+            }
+        }
+        free(w.frames);
+        free(w.walk);
+        free(w.operands);
+        free(w.heights);
+        free(w.ops);
+    }
+    if (depth) *depth = root ? height : 0;
+    return root;
+}
+
+//Balanced mode: prints the expression with its + and * chains balanced,
+//and the tree depth before and after
+int convertBalanced(char* input, const char* inputType, const char* outputType) {
+    int maxTokens = (int)(strlen(input) / 2 + 1);
+    Token* tokens = (Token*)malloc(sizeof(Token) * (size_t)maxTokens);
+    if (!tokens) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int tokenCount;
+    Node* root = parseExpression(input, inputType, tokens, maxTokens, &tokenCount);
+    if (!root) {
+        free(tokens);
+        return 1;
+    }
+
+    int before = treeDepth(root), after;
+    root = balanceChains(root, &after);
+    bool printed = printExpression(root, outputType);
+    if (printed) printf("Tree depth: %d (was %d before balancing)\n", after, before);
+
+    freeTree(root);
+    freeTokens(tokens, tokenCount);
+    free(tokens);
+    return printed ? 0 : 1;
+}
+
+// ----------- LATENCY Metrics -----------
+
+//Counters for the long-running modes (--stream, --push, --schedule):
+//latency histograms per conversion pair and per input size, requests,
+//errors by kind and bytes in and out. Each thread records into its own
+//block through a thread-local pointer, with plain relaxed stores and no
+//shared cache lines. Blocks are linked into a lock-free list on first
+//use and summed when the stats are dumped, as one JSON line on stderr:
+//on SIGUSR1 while a mode runs, and at the end of --stream --stats.
+
+//Log-linear (HDR style) buckets: exact below 8 ns, then 8 sub-buckets
+//per power of two up to 2^40 ns, so a bucket is within 12.5% of its values
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((40 - HIST_SUB_BITS + 1) * HIST_SUB)
+#define METRIC_PAIRS 9               //Input notation * 3 + output notation
+#define METRIC_SIZES 5
+
+static const char* metricSizeName[METRIC_SIZES] = {"<64B", "<1KiB", "<16KiB", "<256KiB", ">=256KiB"};
+
+//Error kinds, told apart by the text of the "Error:" message
+enum { ERRKIND_TOKEN, ERRKIND_EMPTY, ERRKIND_FEW, ERRKIND_MANY, ERRKIND_PARENS, ERRKIND_EDGE,
+       ERRKIND_FORMAT, ERRKIND_OTHER, ERROR_KINDS };
+static const char* errorKindName[ERROR_KINDS] = {"invalid_token", "no_tokens", "too_few_operands",
+                                                 "too_many_operands", "unbalanced_parentheses",
+                                                 "operator_at_edge", "invalid_format", "other"};
+static const char* errorKindText[ERRKIND_OTHER] = {"Invalid token", "No valid tokens", "Too few operands",
+                                                   "Too many operands", "Unbalanced parentheses",
+                                                   "start or end with an operator", "expression format"};
+
+typedef struct MetricsBlock {
+    atomic_ullong pairHist[METRIC_PAIRS][HIST_BUCKETS];
+    atomic_ullong sizeHist[METRIC_SIZES][HIST_BUCKETS];
+    atomic_ullong pairNs[METRIC_PAIRS];  //Summed latency, for the mean
+    atomic_ullong sizeNs[METRIC_SIZES];
+    atomic_ullong errors[ERROR_KINDS];
+    atomic_ullong bytesIn, bytesOut;
+    struct MetricsBlock* next;
+} MetricsBlock;
+
+static _Atomic(MetricsBlock*) metricsBlocks;
+static _Thread_local MetricsBlock* metricsLocal;
+static atomic_bool metricsDumpRequested, metricsDumperStop;
+static pthread_t metricsDumper;
+
+unsigned long long metricsNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static int histBucket(unsigned long long ns) {
+    if (ns < HIST_SUB) return (int)ns;
+    int e = 63 - __builtin_clzll(ns);
+    if (e >= 40) return HIST_BUCKETS - 1;
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + (int)((ns >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+//Highest value that falls into a bucket
+static unsigned long long histBucketTop(int bucket) {
+    if (bucket < HIST_SUB) return (unsigned long long)bucket;
+    int shift = bucket / HIST_SUB - 1;
+    return ((unsigned long long)(HIST_SUB + bucket % HIST_SUB + 1) << shift) - 1;
+}
+
+//Only the owning thread writes a block, so a load and a store will do
+static inline void bump(atomic_ullong* counter, unsigned long long n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+static MetricsBlock* localMetrics(void) {
+    if (!metricsLocal) {
+        MetricsBlock* block = (MetricsBlock*)calloc(1, sizeof(MetricsBlock));
+        if (!block) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        block->next = atomic_load(&metricsBlocks);
+        while (!atomic_compare_exchange_weak(&metricsBlocks, &block->next, block)) {}
+        metricsLocal = block;
+    }
+    return metricsLocal;
+}
+
+//Records one converted (or failed, with its message) expression
+void recordConversion(int inputNotation, int outputNotation, size_t bytesIn, size_t bytesOut,
+                      unsigned long long ns, const char* error) {
+    MetricsBlock* m = localMetrics();
+    int pair = inputNotation * 3 + outputNotation;
+    int size = bytesIn < 64 ? 0 : bytesIn < 1024 ? 1 : bytesIn < 16384 ? 2 : bytesIn < 262144 ? 3 : 4;
+    int bucket = histBucket(ns);
+    bump(&m->pairHist[pair][bucket], 1);
+    bump(&m->sizeHist[size][bucket], 1);
+    bump(&m->pairNs[pair], ns);
+    bump(&m->sizeNs[size], ns);
+    bump(&m->bytesIn, bytesIn);
+    bump(&m->bytesOut, bytesOut);
+    if (error) {
+        int kind = 0;
+        while (kind < ERRKIND_OTHER && !strstr(error, errorKindText[kind])) kind++;
+        bump(&m->errors[kind], 1);
+    }
+}
+
+//Prints a histogram's count, mean and quantiles (bucket tops) as JSON
+static void printHistogram(FILE* out, const unsigned long long* hist, unsigned long long ns) {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    static const char* names[] = {"p50", "p90", "p99", "p999"};
+    unsigned long long count = 0, seen = 0;
+    int top = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        count += hist[b];
+        if (hist[b]) top = b;
+    }
+    fprintf(out, "{\"count\":%llu,\"mean_ns\":%llu", count, count ? ns / count : 0);
+    int q = 0;
+    for (int b = 0; b < HIST_BUCKETS && q < 4; b++) {
+        seen += hist[b];
+        while (q < 4 && seen > 0 && seen >= quantiles[q] * count) {
+            fprintf(out, ",\"%s_ns\":%llu", names[q++], histBucketTop(b));
+        }
+    }
+    fprintf(out, ",\"max_ns\":%llu}", histBucketTop(top));
+}
+
+//Sums every thread's block and writes one JSON line
+void dumpMetrics(FILE* out) {
+    static unsigned long long pairHist[METRIC_PAIRS][HIST_BUCKETS], sizeHist[METRIC_SIZES][HIST_BUCKETS];
+    unsigned long long pairNs[METRIC_PAIRS] = {0}, sizeNs[METRIC_SIZES] = {0};
+    unsigned long long errors[ERROR_KINDS] = {0}, bytesIn = 0, bytesOut = 0, requests = 0, failed = 0;
+    memset(pairHist, 0, sizeof(pairHist));
+    memset(sizeHist, 0, sizeof(sizeHist));
+    for (MetricsBlock* m = atomic_load(&metricsBlocks); m; m = m->next) {
+        for (int p = 0; p < METRIC_PAIRS; p++) {
+            pairNs[p] += atomic_load_explicit(&m->pairNs[p], memory_order_relaxed);
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                pairHist[p][b] += atomic_load_explicit(&m->pairHist[p][b], memory_order_relaxed);
+            }
+        }
+        for (int s = 0; s < METRIC_SIZES; s++) {
+            sizeNs[s] += atomic_load_explicit(&m->sizeNs[s], memory_order_relaxed);
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                sizeHist[s][b] += atomic_load_explicit(&m->sizeHist[s][b], memory_order_relaxed);
+            }
+        }
+        for (int k = 0; k < ERROR_KINDS; k++) errors[k] += atomic_load_explicit(&m->errors[k], memory_order_relaxed);
+        bytesIn += atomic_load_explicit(&m->bytesIn, memory_order_relaxed);
+        bytesOut += atomic_load_explicit(&m->bytesOut, memory_order_relaxed);
+    }
+    for (int p = 0; p < METRIC_PAIRS; p++) {
+        for (int b = 0; b < HIST_BUCKETS; b++) requests += pairHist[p][b];
+    }
+    for (int k = 0; k < ERROR_KINDS; k++) failed += errors[k];
+
+    static const char* notationName[] = {"prefix", "infix", "postfix"};
+    fprintf(out, "{\"requests\":%llu,\"errors\":%llu,\"bytes_in\":%llu,\"bytes_out\":%llu,\"errors_by_kind\":{",
+            requests, failed, bytesIn, bytesOut);
+    for (int k = 0; k < ERROR_KINDS; k++) fprintf(out, "%s\"%s\":%llu", k ? "," : "", errorKindName[k], errors[k]);
+    fprintf(out, "},\"latency_by_pair\":{");
+    bool first = true;
+    for (int p = 0; p < METRIC_PAIRS; p++) {
+        bool empty = true;
+        for (int b = 0; b < HIST_BUCKETS && empty; b++) empty = !pairHist[p][b];
+        if (empty) continue;
+        fprintf(out, "%s\"%s->%s\":", first ? "" : ",", notationName[p / 3], notationName[p % 3]);
+        printHistogram(out, pairHist[p], pairNs[p]);
+        first = false;
+    }
+    fprintf(out, "},\"latency_by_size\":{");
+    first = true;
+    for (int s = 0; s < METRIC_SIZES; s++) {
+        bool empty = true;
+        for (int b = 0; b < HIST_BUCKETS && empty; b++) empty = !sizeHist[s][b];
+        if (empty) continue;
+        fprintf(out, "%s\"%s\":", first ? "" : ",", metricSizeName[s]);
+        printHistogram(out, sizeHist[s], sizeNs[s]);
+        first = false;
+    }
+    fprintf(out, "}}\n");
+    fflush(out);
+}
+
+#ifdef SIGUSR1
+static void requestMetricsDump(int sig) {
+    (void)sig;
+    atomic_store(&metricsDumpRequested, true);
+}
+#endif
+
+//Dumps the metrics when SIGUSR1 has asked for them; the handler only
+//sets a flag, the printing happens here
+static void* runMetricsDumper(void* arg) {
+    (void)arg;
+    struct timespec tick = {0, 50 * 1000 * 1000};
+    while (!atomic_load(&metricsDumperStop)) {
+        nanosleep(&tick, NULL);
+        if (atomic_exchange(&metricsDumpRequested, false)) dumpMetrics(stderr);
+    }
+    return NULL;
+}
+
+//Lets `kill -USR1 <pid>` dump the metrics while a long-running mode works
+void startMetricsDumper(void) {
+#ifdef SIGUSR1
+    signal(SIGUSR1, requestMetricsDump);
+    atomic_store(&metricsDumperStop, false);
+    pthread_create(&metricsDumper, NULL, runMetricsDumper, NULL);
+#endif
+}
+
+void stopMetricsDumper(void) {
+#ifdef SIGUSR1
+    atomic_store(&metricsDumperStop, true);
+    pthread_join(metricsDumper, NULL);
+    if (atomic_exchange(&metricsDumpRequested, false)) dumpMetrics(stderr);
+#endif
+}
+
+// ----------- PUSH Parser -----------
+
+//Incremental parser for input that arrives in pieces, e.g. from a socket.
+//The caller feeds chunks of any size, which may end in the middle of a
+//token, and each call returns once an expression is complete or known to
+//be wrong. Lines are never reassembled and no thread waits for input.
+//Expressions end at '\n' (or at pushFinish). The prefix, postfix and
+//shunting-yard stacks are kept in the parser between calls.
+//Errors are the ones parseExpression reports for the same line. The
+//checks on the whole line (a blank line, the infix start/end operator,
+//an invalid prefix or postfix token anywhere) come first, so an error is
+//returned at the end of its line. Infix tokens also go through a
+//PrattStream that only checks, whose error a line of LEGACY_INFIX_BYTES
+//or more gets, as in buildTreeFromInfixPratt.
+
+#define PUSH_TOKEN_KEEP ERROR_CAPTURE_SIZE  //Characters of a token kept for error messages
+
+//Result of pushParse and pushFinish
+enum { PUSH_NEED_MORE, PUSH_DONE, PUSH_ERROR };
+
+//Growable node stack; expressions are not limited to MAX tokens here
+typedef struct {
+    Node** data;
+    int top, capacity;
+} PushStack;
+
+typedef struct {
+    int notation;                    //Input notation
+    PushStack nodes;                 //Subtrees (infix, postfix) or operators
+                                     //still missing a child (prefix)
+    PushStack ops;                   //Infix operators and open parentheses
+    Node* root;                      //Prefix tree being filled; the result
+    char token[PUSH_TOKEN_KEEP];     //Current token, possibly cut short
+    size_t tokenLen;
+    bool tokenAlnum;
+    size_t length;                   //Bytes of the line so far
+    bool blank;                      //Only spaces and tabs so far
+    char firstChar, lastChar;        //Of the line, for the start/end check
+    bool pendingCR;                  //A '\r', dropped if '\n' follows
+    bool failed;                     //error is set; the line is only checked
+    bool invalidToken;               //error is for an invalid token
+    bool ended;                      //The last call returned DONE or ERROR
+    char error[ERROR_CAPTURE_SIZE];  //Message for PUSH_ERROR
+    PrattStream pratt;               //Infix only: the line as prattParse sees it
+    bool prattFailed;
+    char prattError[ERROR_CAPTURE_SIZE];
+} PushParser;
+
+static void pushStackPush(PushStack* s, Node* node) {
+    if (s->top + 1 == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 64;
+        s->data = (Node**)realloc(s->data, sizeof(Node*) * (size_t)s->capacity);
+        if (!s->data) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    s->data[++s->top] = node;
+}
+
+//Sets up a parser for prefix, infix or postfix input; false if unknown
+bool initPushParser(PushParser* p, const char* inputType) {
+    memset(p, 0, sizeof(*p));
+    p->nodes.top = p->ops.top = -1;
+    p->tokenAlnum = true;
+    p->blank = true;
+    p->notation = notationOf(inputType);
+    if (p->notation < 0) {
+        reportError("\nError: Unknown input type\n");
+        return false;
+    }
+    initPrattStream(&p->pratt, NULL);
+    return true;
+}
+
+//Frees the partial expression and gets ready for the next one
+static void pushClear(PushParser* p) {
+    if (p->notation == NOTATION_PREFIX) {
+        freeTree(p->root); //The waiting operators are all inside root
+    } else {
+        for (int i = 0; i <= p->nodes.top; i++) freeTree(p->nodes.data[i]);
+        for (int i = 0; i <= p->ops.top; i++) free(p->ops.data[i]);
+        freeTree(p->root);
+    }
+    p->root = NULL;
+    p->nodes.top = p->ops.top = -1;
+    p->tokenLen = 0;
+    p->tokenAlnum = true;
+    p->length = 0;
+    p->pendingCR = p->failed = p->invalidToken = false;
+    p->blank = true;
+    initPrattStream(&p->pratt, NULL);
+    p->prattFailed = false;
+    p->prattError[0] = '\0';
+}
+
+//Checks one token with the PrattStream, keeping the first error
+static inline void pushPratt(PushParser* p, int kind, int op, const char* text) {
+    if (p->prattFailed) return;
+    if (prattAccepts(&p->pratt, kind)) {
+        prattAdvance(&p->pratt, kind, op);
+        return;
+    }
+    char* outerCapture = errorCapture;
+    errorCapture = p->prattError;
+    prattStreamError(&p->pratt, kind, op, text, strlen(text));
+    errorCapture = outerCapture;
+    p->prattFailed = true;
+}
+
+//Pops two subtrees into op; false if there are not two
+static bool pushReduce(PushParser* p, Node* op) {
+    if (p->nodes.top < 1) {
+        reportError("Error: Too few operands for operator '%s'\n", op->value);
+        free(op);
+        return false;
+    }
+    op->right = p->nodes.data[p->nodes.top--];
+    op->left = p->nodes.data[p->nodes.top--];
+    pushStackPush(&p->nodes, op);
+    return true;
+}
+
+//Applies the token that just ended; false (after reporting) on an error
+static bool pushToken(PushParser* p) {
+    char* tok = p->token;
+    tok[p->tokenLen < PUSH_TOKEN_KEEP ? p->tokenLen : PUSH_TOKEN_KEEP - 1] = '\0';
+    bool single = p->tokenLen == 1;
+    bool isOp = single && tok[0] && strchr("+-*/", tok[0]);
+    bool isParen = single && (tok[0] == '(' || tok[0] == ')');
+    bool alnum = p->tokenAlnum;
+    p->tokenLen = 0;
+    p->tokenAlnum = true;
+    if (p->notation == NOTATION_INFIX) {
+        //Classified from the flags, since tok may be cut short
+        int op = OP_NONE;
+        int kind = alnum ? PRATT_OPERAND : PRATT_INVALID;
+        if (isOp || isParen) kind = prattToken(tok, 1, &op);
+        pushPratt(p, kind, op, tok);
+    }
+    if (!isOp && !isParen && !alnum) {
+        //tokenize reports the first invalid prefix or postfix token before
+        //any format error; infix is parsed left to right
+        if (!p->failed || (p->notation != NOTATION_INFIX && !p->invalidToken)) {
+            p->error[0] = '\0';
+            reportError("Error: Invalid token '%s'\n", tok);
+            p->invalidToken = true;
+        }
+        return false;
+    }
+    if (p->failed) return false;
+
+    if (p->notation == NOTATION_PREFIX) {
+        //Each token is the next missing child of the newest open operator
+        Node* node = createNode(tok);
+        if (!p->root) {
+            p->root = node;
+        } else if (p->nodes.top < 0) {
+            printFormatError("prefix");
+            free(node);
+            return false;
+        } else {
+            Node* parent = p->nodes.data[p->nodes.top];
+            if (!parent->left) {
+                parent->left = node;
+            } else {
+                parent->right = node;
+                p->nodes.top--;
+            }
+        }
+        if (isOp) pushStackPush(&p->nodes, node);
+        return true;
+    }
+
+    if (p->notation == NOTATION_POSTFIX) {
+        Node* node = createNode(tok);
+        if (isOp && p->nodes.top < 1) {
+            printFormatError("postfix");
+            free(node);
+            return false;
+        }
+        if (isOp) {
+            node->right = p->nodes.data[p->nodes.top--];
+            node->left = p->nodes.data[p->nodes.top--];
+        }
+        pushStackPush(&p->nodes, node);
+        return true;
+    }
+
+    //Infix: the shunting-yard steps of buildTreeFromInfix, one token at a time
+    if (!isOp && !isParen) {
+        pushStackPush(&p->nodes, createNode(tok));
+    } else if (tok[0] == '(') {
+        pushStackPush(&p->ops, createNode(tok));
+    } else if (tok[0] == ')') {
+        for (;;) {
+            if (p->ops.top < 0) {
+                reportError("Error: Unbalanced parentheses\n");
+                return false;
+            }
+            Node* top = p->ops.data[p->ops.top--];
+            if (top->value[0] == '(') {
+                free(top);
+                break;
+            }
+            if (!pushReduce(p, top)) return false;
+        }
+    } else {
+        while (p->ops.top >= 0 && isOperator(p->ops.data[p->ops.top]->value) &&
+               precedence(p->ops.data[p->ops.top]->value[0]) >= precedence(tok[0])) {
+            if (!pushReduce(p, p->ops.data[p->ops.top--])) return false;
+        }
+        pushStackPush(&p->ops, createNode(tok));
+    }
+    return true;
+}
+
+//Completes the expression at the end of a line; the tree is left in root
+static bool pushEnd(PushParser* p) {
+    if (p->blank) {
+        p->error[0] = '\0';
+        reportError("Error: No valid tokens found\n");
+        return false;
+    }
+    if (p->notation == NOTATION_INFIX && (isOperatorChar(p->firstChar) || isOperatorChar(p->lastChar))) {
+        p->error[0] = '\0';
+        reportError("\nError: Infix expression cannot start or end with an operator\n");
+        return false;
+    }
+    if (p->notation == NOTATION_INFIX && p->length >= LEGACY_INFIX_BYTES) {
+        //A long line gets prattParse's error, a short one the stack builder's
+        pushPratt(p, PRATT_END, OP_NONE, "");
+        if (p->prattFailed) {
+            memcpy(p->error, p->prattError, sizeof(p->error));
+            return false;
+        }
+    }
+    if (p->failed) return false;
+    if (p->notation == NOTATION_PREFIX) {
+        if (p->nodes.top >= 0) {
+            printFormatError("prefix");
+            return false;
+        }
+        return true;
+    }
+    if (p->notation == NOTATION_POSTFIX) {
+        if (p->nodes.top != 0) {
+            printFormatError("postfix");
+            return false;
+        }
+    } else {
+        while (p->ops.top >= 0) {
+            Node* op = p->ops.data[p->ops.top--];
+            if (op->value[0] == '(') {
+                reportError("Error: Unbalanced parentheses\n");
+                free(op);
+                return false;
+            }
+            if (!pushReduce(p, op)) return false;
+        }
+        if (p->nodes.top != 0) {
+            reportError("Error: Too many operands\n");
+            return false;
+        }
+    }
+    p->root = p->nodes.data[p->nodes.top--];
+    return true;
+}
+
+//Adds a byte of the line other than the '\n' that ends it
+static inline void pushByte(PushParser* p, char c) {
+    if (!p->length++) p->firstChar = c;
+    p->lastChar = c;
+    if (c == ' ') {
+        if (p->tokenLen && !pushToken(p)) p->failed = true;
+        return;
+    }
+    if (c != '\t') p->blank = false;
+    if (p->tokenLen < PUSH_TOKEN_KEEP - 1) p->token[p->tokenLen] = c;
+    p->tokenLen++;
+    if (!isalnum((unsigned char)c)) p->tokenAlnum = false;
+}
+
+//Feeds the next length bytes. Returns PUSH_NEED_MORE once the whole chunk
+//is used, or PUSH_DONE / PUSH_ERROR at the end of an expression, with
+//consumed telling how much of the chunk was used. After PUSH_DONE the tree
+//is taken with takePushResult, after PUSH_ERROR the message is in error;
+//either is dropped by the next call. An error ends its line like an
+//expression does, so the caller may simply keep feeding.
+int pushParse(PushParser* p, const char* chunk, size_t length, size_t* consumed) {
+    if (p->ended) {
+        pushClear(p);
+        p->error[0] = '\0';
+        p->ended = false;
+    }
+    char* outerCapture = errorCapture;
+    errorCapture = p->error;
+    int status = PUSH_NEED_MORE;
+    size_t i = 0;
+
+    while (i < length && status == PUSH_NEED_MORE) {
+        char c = chunk[i++];
+        if (c == '\n') {
+            p->pendingCR = false; //--stream drops a '\r' before '\n' too
+            if (p->tokenLen && !pushToken(p)) p->failed = true;
+            status = pushEnd(p) ? PUSH_DONE : PUSH_ERROR;
+            continue;
+        }
+        //Anywhere else a '\r' is part of a token, as on a --stream line
+        if (p->pendingCR) {
+            pushByte(p, '\r');
+            p->pendingCR = false;
+        }
+        if (c == '\r') {
+            p->pendingCR = true;
+            continue;
+        }
+        pushByte(p, c);
+    }
+
+    errorCapture = outerCapture;
+    p->ended = status != PUSH_NEED_MORE;
+    *consumed = i;
+    return status;
+}
+
+//Ends the input: completes an unterminated last expression. Returns
+//PUSH_NEED_MORE when no expression was left.
+int pushFinish(PushParser* p) {
+    bool pending = !p->ended && (p->length || p->pendingCR);
+    if (!pending) return PUSH_NEED_MORE;
+    size_t consumed;
+    return pushParse(p, "\n", 1, &consumed);
+}
+
+//Hands the finished tree to the caller, who frees it
+Node* takePushResult(PushParser* p) {
+    Node* root = p->root;
+    p->root = NULL;
+    return root;
+}
+
+void freePushParser(PushParser* p) {
+    pushClear(p);
+    free(p->nodes.data);
+    free(p->ops.data);
+}
+
+//Converts a file (or stdin) fed to a push parser chunkSize bytes at a
+//time, with the same output lines as --stream
+int convertPushed(const char* path, const char* inputType, const char* outputType, size_t chunkSize) {
+    int notation = notationOf(outputType);
+    if (notation < 0) {
+        printOutputTypeError();
+        return 1;
+    }
+    PushParser parser;
+    if (!initPushParser(&parser, inputType)) return 1;
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        printf("Error: Cannot open input file '%s'\n", path);
+        freePushParser(&parser);
+        return 1;
+    }
+    if (chunkSize == 0) chunkSize = 4096;
+    char* chunk = (char*)malloc(chunkSize);
+    char* text = NULL;
+    size_t textCap = 0;
+    if (!chunk) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+
+    //Latency is the time spent in the parser and renderer for a line
+    int inputNotation = notationOf(inputType);
+    unsigned long long busy = 0;
+    size_t bytesIn = 0;
+    startMetricsDumper();
+
+    bool failed = false, eof = false;
+    while (!eof) {
+        size_t length = fread(chunk, 1, chunkSize, file);
+        eof = length < chunkSize;
+        size_t pos = 0;
+        for (;;) {
+            unsigned long long begin = metricsNow();
+            int status = PUSH_NEED_MORE;
+            if (pos < length) {
+                size_t used;
+                status = pushParse(&parser, chunk + pos, length - pos, &used);
+                pos += used;
+                bytesIn += used;
+            }
+            if (status == PUSH_NEED_MORE && eof) status = pushFinish(&parser);
+            busy += metricsNow() - begin;
+            if (status == PUSH_NEED_MORE) break;
+            if (status == PUSH_ERROR) {
+                printf("%s\n", parser.error);
+                recordConversion(inputNotation, notation, bytesIn, strlen(parser.error) + 1, busy, parser.error);
+                busy = 0;
+                bytesIn = 0;
+                failed = true;
+                continue;
+            }
+            begin = metricsNow();
+            Node* root = takePushResult(&parser);
+            size_t size = renderedSize(root, notation) + 1;
+            if (size > textCap) {
+                textCap = size;
+                text = (char*)realloc(text, textCap);
+                if (!text) {
+                    printf("Error: Memory allocation failed\n");
+                    exit(1);
+                }
+            }
+            char* end = renderTree(root, notation, text);
+            if (end > text && end[-1] == ' ') end--; //No trailing space, as in --stream
+            *end++ = '\n';
+            fwrite(text, 1, (size_t)(end - text), stdout);
+            freeTree(root);
+            recordConversion(inputNotation, notation, bytesIn, (size_t)(end - text), busy + metricsNow() - begin, NULL);
+            busy = 0;
+            bytesIn = 0;
+        }
+    }
+    stopMetricsDumper();
+
+    free(text);
+    free(chunk);
+    freePushParser(&parser);
+    if (file != stdin) fclose(file);
+    return failed;
+}
+
+// ----------- OUT-OF-CORE Handling -----------
+
+//Default working-memory budget for out-of-core mode (bytes)
+#define OOC_DEFAULT_LIMIT (64LL * 1024 * 1024)
+//Smallest budget accepted, keeps blocks large enough for sequential I/O
+#define OOC_MIN_LIMIT (64LL * 1024)
+
+//Budget split: the reader, the writer and the spill stack each get a share
+typedef struct {
+    size_t bufferSize;   //Token reader and output buffer size
+    size_t blockSize;    //Spill stack block size
+} OocConfig;
+
+//Streams whitespace-separated tokens from a file through a fixed buffer,
+//either front to back or back to front (used for stream reversal)
+typedef struct {
+    FILE* file;
+    char* buf;           //cap + 1 bytes so a token can always be terminated
+    size_t cap;
+    size_t start, end;   //Unread region of buf
+    long long filePos;   //Reverse mode: file offset of buf[0]
+    bool reverse;
+    bool eof;
+} TokenReader;
+
+//Opens a reader; reverse readers need a seekable file
+void initReader(TokenReader* r, FILE* file, size_t cap, bool reverse) {
+    r->buf = (char*)malloc(cap + 1);
+    if (!r->buf) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    r->file = file;
+    r->cap = cap;
+    r->start = r->end = 0;
+    r->reverse = reverse;
+    r->eof = false;
+    r->filePos = 0;
+    if (reverse) {
+        if (fseeko(file, 0, SEEK_END) != 0) oocIoError();
+        r->filePos = (long long)ftello(file);
+    }
+}
+
+void freeReader(TokenReader* r) { free(r->buf); }
+
+//Forward refill: keep the unread tail and append fresh bytes after it
+static void readerFill(TokenReader* r) {
+    memmove(r->buf, r->buf + r->start, r->end - r->start);
+    r->end -= r->start;
+    r->start = 0;
+    size_t n = fread(r->buf + r->end, 1, r->cap - r->end, r->file);
+    if (n == 0) {
+        if (ferror(r->file)) oocIoError();
+        r->eof = true;
+    }
+    r->end += n;
+}
+
+//Reverse refill: reload a window that ends where the unread region ends
+static void readerFillBack(TokenReader* r) {
+    long long windowEnd = r->filePos + (long long)r->end;
+    long long windowStart = windowEnd > (long long)r->cap ? windowEnd - (long long)r->cap : 0;
+    size_t len = (size_t)(windowEnd - windowStart);
+    if (fseeko(r->file, (off_t)windowStart, SEEK_SET) != 0 ||
+        fread(r->buf, 1, len, r->file) != len) oocIoError();
+    r->filePos = windowStart;
+    r->end = len;
+}
+
+//Returns the next token (NUL-terminated, valid until the next call),
+//or NULL at the end of the stream
+char* readerNext(TokenReader* r) {
+    if (r->reverse) {
+        for (;;) {
+            while (r->end > 0 && (isspace((unsigned char)r->buf[r->end - 1]) || r->buf[r->end - 1] == '\0'))
+                r->end--;
+            if (r->end == 0) {
+                if (r->filePos == 0) return NULL;
+                readerFillBack(r);
+                continue;
+            }
+            size_t s = r->end;
+            while (s > 0 && !isspace((unsigned char)r->buf[s - 1]) && r->buf[s - 1] != '\0') s--;
+            if (s == 0 && r->filePos > 0) {
+                if (r->end == r->cap) {
+                    printf("Error: Token longer than the out-of-core buffer\n");
+                    exit(1);
+                }
+                readerFillBack(r);
+                continue;
+            }
+            r->buf[r->end] = '\0';
+            r->end = s;
+            return r->buf + s;
+        }
+    }
+    for (;;) {
+        while (r->start < r->end && (isspace((unsigned char)r->buf[r->start]) || r->buf[r->start] == '\0'))
+            r->start++;
+        if (r->start == r->end) {
+            if (r->eof) return NULL;
+            readerFill(r);
+            continue;
+        }
+        size_t e = r->start;
+        while (e < r->end && !isspace((unsigned char)r->buf[e]) && r->buf[e] != '\0') e++;
+        if (e == r->end && !r->eof) {
+            if (r->start == 0 && r->end == r->cap) {
+                printf("Error: Token longer than the out-of-core buffer\n");
+                exit(1);
+            }
+            readerFill(r);
+            continue;
+        }
+        char* tok = r->buf + r->start;
+        r->buf[e] = '\0';
+        r->start = e < r->end ? e + 1 : e;
+        return tok;
+    }
+}
+
+//Writes one output token followed by a space, as the traversals do
+void writeToken(FILE* out, const char* tok) {
+    fputs(tok, out);
+    putc(' ', out);
+}
+
+//Creates a temporary file with a write buffer sized from the budget
+FILE* oocTempFile(const OocConfig* cfg) {
+    FILE* f = tmpfile();
+    if (!f) oocIoError();
+    setvbuf(f, NULL, _IOFBF, cfg->bufferSize);
+    return f;
+}
+
+//Flushes a finished stage so it can be read back
+void oocRewind(FILE* f) {
+    if (fflush(f) != 0 || ferror(f)) oocIoError();
+    rewind(f);
+}
+
+//Classifies a token of the expression and hands it to prattStreamToken
+static bool oocPrattToken(PrattStream* p, const char* text, size_t len, FILE* out) {
+    int op;
+    int kind = prattToken(text, len, &op);
+    return prattStreamToken(p, kind, op, text, len, out);
+}
+
+//Feeds the space separated tokens of line to oocPrattToken, then the end
+//if last is set; *lastChar gets the last character of the last token
+static bool oocPrattLine(PrattStream* p, const char* line, size_t used, bool last, char* lastChar, FILE* out) {
+    for (const char* t = line; t < line + used;) {
+        const char* e = memchr(t, ' ', (size_t)(line + used - t));
+        *lastChar = e[-1];
+        if (!oocPrattToken(p, t, (size_t)(e - t), out)) return false;
+        t = e + 1;
+    }
+    return !last || oocPrattToken(p, "", 0, out);
+}
+
+//Infix -> postfix by a streamed prattParse, so the errors are the ones the
+//in-memory path prints for the tokens written with single spaces. The
+//start of that line is kept: one shorter than LEGACY_INFIX_BYTES is the
+//in-memory path's short line, whose errors come from parseExpression
+//itself; past that the errors are prattParse's, and the start/end check
+//still wins as in parseExpression.
+bool oocInfixToPostfix(TokenReader* in, FILE* out, const OocConfig* cfg) {
+    char line[LEGACY_INFIX_BYTES];
+    size_t used = 0;
+    char* tok;
+    while ((tok = readerNext(in))) {
+        size_t len = strlen(tok);
+        if (used + len >= LEGACY_INFIX_BYTES) break;
+        memcpy(line + used, tok, len);
+        used += len;
+        line[used++] = ' ';
+    }
+    if (used == 0 && !tok) {
+        printf("Error: Too many operands\n"); //As parseExpression's caller reports ""
+        return false;
+    }
+
+    char message[ERROR_CAPTURE_SIZE] = "";
+    char* outerCapture = errorCapture;
+    errorCapture = message;
+    SpillStack frames;
+    initSpillStack(&frames, cfg->blockSize);
+    PrattStream p;
+    initPrattStream(&p, NULL);
+    char firstChar = used ? line[0] : tok[0], lastChar = 0;
+    bool ok;
+
+    if (!tok) {
+        //The whole expression is short: check it, then write it out
+        ok = oocPrattLine(&p, line, used, true, &lastChar, NULL);
+        errorCapture = outerCapture;
+        if (ok) {
+            initPrattStream(&p, &frames);
+            oocPrattLine(&p, line, used, true, &lastChar, out);
+        }
+        freeSpillStack(&frames);
+        if (!ok) {
+            line[used - 1] = '\0';
+            int tokenCount;
+            Node* root = parseExpression(line, "infix", NULL, 0, &tokenCount);
+            if (root) {
+                //A line the stack builder tolerates, such as "a ( )"
+                TokenIterator it;
+                initTokenIterator(&it, root, NOTATION_POSTFIX);
+                const char* value;
+                while ((value = nextToken(&it))) writeToken(out, value);
+                freeTokenIterator(&it);
+                freeTree(root);
+                ok = true;
+            }
+        }
+        return ok;
+    }
+
+    initPrattStream(&p, &frames);
+    ok = oocPrattLine(&p, line, used, false, &lastChar, out);
+    //After an error the rest is read only for its last character
+    for (; tok; tok = readerNext(in)) {
+        size_t len = strlen(tok);
+        lastChar = tok[len - 1];
+        if (ok) ok = oocPrattToken(&p, tok, len, out);
+    }
+    if (ok) ok = oocPrattToken(&p, "", 0, out);
+    errorCapture = outerCapture;
+    freeSpillStack(&frames);
+
+    if (!ok) {
+        if (isOperatorChar(firstChar) || isOperatorChar(lastChar)) {
+            printf("\nError: Infix expression cannot start or end with an operator\n");
+        } else {
+            printf("%s\n", message);
+        }
+    }
+    return ok;
+}
+
+//Marks an operator on the prefix stack whose left operand is complete
+#define OOC_LEFT_DONE 0x80
+
+//Streams prefix -> postfix (toInfix false) or prefix -> infix (toInfix true).
+//The stack holds one byte per pending operator: the operator and whether
+//its left operand has been seen. Errors are printed as the in-memory path
+//prints them: an invalid token anywhere comes first, so after a malformed
+//token the rest is still read, only to check the tokens.
+bool oocFromPrefix(TokenReader* in, FILE* out, const OocConfig* cfg, bool toInfix) {
+    SpillStack ops;
+    initSpillStack(&ops, cfg->blockSize);
+    bool complete = false, malformed = false;
+    long long count = 0;
+    char* tok;
+
+    while ((tok = readerNext(in))) {
+        if (!isValidToken(tok)) {
+            printf("Error: Invalid token '%s'\n", tok);
+            freeSpillStack(&ops);
+            return false;
+        }
+        count++;
+        if (malformed) continue;
+        if (complete) {
+            malformed = true; //Tokens after a finished expression
+            continue;
+        }
+        if (isOperator(tok)) {
+            if (toInfix) writeToken(out, "(");
+            spillPush(&ops, tok[0]);
+            continue;
+        }
+        writeToken(out, tok);
+        //An operand completes subtrees until an operator still needs its right side
+        complete = true;
+        while (!spillIsEmpty(&ops)) {
+            char top = spillPop(&ops);
+            if (!(top & OOC_LEFT_DONE)) {
+                if (toInfix) {
+                    putc(top, out);
+                    putc(' ', out);
+                }
+                spillPush(&ops, (char)(top | OOC_LEFT_DONE));
+                complete = false;
+                break;
+            }
+            top &= ~OOC_LEFT_DONE;
+            if (toInfix) writeToken(out, ")");
+            else {
+                putc(top, out);
+                putc(' ', out);
+            }
+        }
+    }
+    freeSpillStack(&ops);
+    if (count == 0) {
+        printf("Error: No valid tokens found\n");
+        return false;
+    }
+    if (malformed || !complete) {
+        printFormatError("prefix");
+        return false;
+    }
+    return true;
+}
+
+//Validates postfix and copies it as single-space separated tokens. Errors
+//are printed in the same order as in oocFromPrefix.
+bool oocCheckPostfix(TokenReader* in, FILE* out) {
+    long long operandCount = 0, count = 0;
+    bool malformed = false;
+    char* tok;
+    while ((tok = readerNext(in))) {
+        if (!isValidToken(tok)) {
+            printf("Error: Invalid token '%s'\n", tok);
+            return false;
+        }
+        count++;
+        if (malformed) continue;
+        if (!isOperator(tok)) operandCount++;
+        else if (operandCount < 2) {
+            malformed = true;
+            continue;
+        } else {
+            operandCount--;
+        }
+        writeToken(out, tok);
+    }
+    if (count == 0) {
+        printf("Error: No valid tokens found\n");
+        return false;
+    }
+    if (malformed || operandCount != 1) {
+        printFormatError("postfix");
+        return false;
+    }
+    return true;
+}
+
+//Converts an expression of any size from a file (or "-" for stdin).
+//Every pair is reduced to stack-only streaming passes over temporary files:
+//  infix   -> postfix : a streamed prattParse
+//  prefix  -> postfix/infix : one pass with a stack of pending operators
+//  postfix -> prefix  : reversed postfix is the prefix form of the mirrored
+//                       tree; converting that to postfix and reversing the
+//                       result gives the prefix form of the original tree
+//Working memory stays within memLimit regardless of expression size.
+int convertOutOfCore(const char* path, const char* inputType, const char* outputType, long long memLimit) {
+    if (strcmp(outputType, "infix") != 0 && strcmp(outputType, "prefix") != 0 &&
+        strcmp(outputType, "postfix") != 0) {
+        printf("\nError: Unknown output type\n");
+        return 1;
+    }
+    if (strcmp(inputType, "infix") != 0 && strcmp(inputType, "prefix") != 0 &&
+        strcmp(inputType, "postfix") != 0) {
+        printf("\nError: Unknown input type\n");
+        return 1;
+    }
+    if (memLimit < OOC_MIN_LIMIT) memLimit = OOC_MIN_LIMIT;
+
+    //At most one reader, one spill stack (two blocks), one writer and the
+    //stdout buffer are live at once
+    OocConfig cfg;
+    cfg.bufferSize = (size_t)(memLimit / 8);
+    cfg.blockSize = (size_t)(memLimit / 8);
+
+    FILE* input = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!input) {
+        printf("Error: Cannot open input file '%s'\n", path);
+        return 1;
+    }
+
+    TokenReader reader;
+    FILE* result = oocTempFile(&cfg);
+    bool ok;
+
+    if (strcmp(inputType, "prefix") == 0 && strcmp(outputType, "postfix") != 0 &&
+        strcmp(outputType, "prefix") != 0) {
+        //prefix -> infix needs no intermediate file
+        initReader(&reader, input, cfg.bufferSize, false);
+        ok = oocFromPrefix(&reader, result, &cfg, true);
+        freeReader(&reader);
+    } else {
+        //Stage 1: normalise the input into a validated postfix stream
+        FILE* post = strcmp(outputType, "postfix") == 0 ? result : oocTempFile(&cfg);
+        initReader(&reader, input, cfg.bufferSize, false);
+        if (strcmp(inputType, "infix") == 0) {
+            ok = oocInfixToPostfix(&reader, post, &cfg);
+        } else if (strcmp(inputType, "prefix") == 0) {
+            ok = oocFromPrefix(&reader, post, &cfg, false);
+        } else {
+            ok = oocCheckPostfix(&reader, post);
+        }
+        freeReader(&reader);
+
+        if (ok && post != result) {
+            //Stage 2: reversed postfix -> mirrored postfix
+            FILE* mirrored = oocTempFile(&cfg);
+            oocRewind(post);
+            initReader(&reader, post, cfg.bufferSize, true);
+            oocFromPrefix(&reader, mirrored, &cfg, false);
+            freeReader(&reader);
+            fclose(post);
+
+            //Stage 3: reversed mirrored postfix is the prefix form
+            oocRewind(mirrored);
+            initReader(&reader, mirrored, cfg.bufferSize, true);
+            if (strcmp(outputType, "prefix") == 0) {
+                char* tok;
+                while ((tok = readerNext(&reader))) writeToken(result, tok);
+            } else {
+                oocFromPrefix(&reader, result, &cfg, true);
+            }
+            freeReader(&reader);
+            fclose(mirrored);
+        } else if (post != result) {
+            fclose(post);
+        }
+    }
+    if (input != stdin) fclose(input);
+
+    if (ok) {
+        //Copy the finished body to stdout in the in-memory output format
+        oocRewind(result);
+        char* chunk = (char*)malloc(cfg.bufferSize);
+        if (!chunk) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        printf("\n%c%s Expression: ", toupper((unsigned char)outputType[0]), outputType + 1);
+        size_t n;
+        while ((n = fread(chunk, 1, cfg.bufferSize, result)) > 0) fwrite(chunk, 1, n, stdout);
+        printf("\n");
+        free(chunk);
+    }
+    fclose(result);
+    return ok ? 0 : 1;
+}
+
+//Parses a byte count with an optional K, M or G suffix
+long long parseMemLimit(const char* text) {
+    char* end;
+    long long value = strtoll(text, &end, 10);
+    if (*end == 'K' || *end == 'k') value *= 1024LL;
+    else if (*end == 'M' || *end == 'm') value *= 1024LL * 1024;
+    else if (*end == 'G' || *end == 'g') value *= 1024LL * 1024 * 1024;
+    return value;
+}
+
+// ----------- PARALLEL Parsing -----------
+
+#define PAR_MAX_THREADS 64
+
+//Growable list of token positions
+typedef struct {
+    int* data;
+    int size;
+    int capacity;
+} IntList;
+
+void intListPush(IntList* list, int value) {
+    if (list->size == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->data = (int*)realloc(list->data, sizeof(int) * (size_t)list->capacity);
+        if (!list->data) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    list->data[list->size++] = value;
+}
+
+//Shared state for a multi-threaded parse of one expression.
+//Every token owns the node at the same index of one contiguous block, so
+//chunks link subtrees by index and never allocate per node.
+typedef struct {
+    Token* tokens;
+    int tokenCount;
+    int threads;
+    bool infix;
+    bool reverse;                       //Prefix: walk back to front as mirrored postfix
+    Node* nodes;
+    int* level;                         //Stack height (prefix/postfix) or binding key (infix)
+    int* leftLink;                      //Matched position to the left, -1 if none
+    int* rightLink;                     //Matched position to the right, -1 if none
+    long long offset[PAR_MAX_THREADS];  //Chunk delta sum, then running value at chunk start
+    int minLevel[PAR_MAX_THREADS];
+    bool valid[PAR_MAX_THREADS];
+    int firstOp[PAR_MAX_THREADS], lastOp[PAR_MAX_THREADS];
+    int opBefore[PAR_MAX_THREADS], opAfter[PAR_MAX_THREADS];
+    IntList open[PAR_MAX_THREADS];      //Positions whose match lies in an earlier chunk
+    IntList openRight[PAR_MAX_THREADS]; //Positions whose match lies in a later chunk
+    IntList stack[PAR_MAX_THREADS];     //Candidates left unmatched at chunk end
+    IntList stackRight[PAR_MAX_THREADS];
+    int root;
+} ParallelParse;
+
+//Runs fn(ctx, t) for t = 0..threads-1, chunk 0 on the calling thread
+typedef struct {
+    void (*fn)(void*, int);
+    void* ctx;
+    int t;
+} ParallelTask;
+
+static void* runParallelTask(void* arg) {
+    ParallelTask* task = (ParallelTask*)arg;
+    task->fn(task->ctx, task->t);
+    return NULL;
+}
+
+void parallelFor(int threads, void (*fn)(void*, int), void* ctx) {
+    pthread_t ids[PAR_MAX_THREADS];
+    ParallelTask tasks[PAR_MAX_THREADS];
+    bool started[PAR_MAX_THREADS];
+    for (int t = 1; t < threads; t++) {
+        tasks[t].fn = fn;
+        tasks[t].ctx = ctx;
+        tasks[t].t = t;
+        started[t] = pthread_create(&ids[t], NULL, runParallelTask, &tasks[t]) == 0;
+        if (!started[t]) fn(ctx, t); //Fall back to running the chunk inline
+    }
+    fn(ctx, 0);
+    for (int t = 1; t < threads; t++) {
+        if (started[t]) pthread_join(ids[t], NULL);
+    }
+}
+
+//First position of chunk t
+static int chunkStart(const ParallelParse* p, int t) {
+    return (int)((long long)p->tokenCount * t / p->threads);
+}
+
+//Token position of the k-th token in processing order
+static int parPos(const ParallelParse* p, int k) {
+    return p->reverse ? p->tokenCount - 1 - k : k;
+}
+
+//Last entry of a chunk's candidate stack whose level is <= v (< v if strict).
+//Matching entries always form a prefix of the stack, so binary search works.
+static int findCandidate(const ParallelParse* p, const IntList* cand, int v, bool strict) {
+    int lo = 0, hi = cand->size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int lv = p->level[cand->data[mid]];
+        if (strict ? lv < v : lv <= v) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 ? cand->data[lo - 1] : -1;
+}
+
+//Copies a token into its node slot, as createNode does
+static void parInitNode(ParallelParse* p, int i) {
+    Node* node = &p->nodes[i];
+    strncpy(node->value, p->tokens[i].value, sizeof(node->value) - 1);
+    node->value[sizeof(node->value) - 1] = '\0';
+    node->left = node->right = NULL;
+}
+
+// Prefix / postfix: the stack height after each token is a prefix sum of
+// +1 (operand) / -1 (operator). An operator's right child is the previous
+// token and its left child is the nearest earlier token at the same or a
+// lower height. Prefix is handled as the mirrored postfix read backwards.
+
+static void stackPhaseSum(void* ctx, int t) {
+    ParallelParse* p = (ParallelParse*)ctx;
+    long long sum = 0;
+    for (int k = chunkStart(p, t); k < chunkStart(p, t + 1); k++) {
+        int i = parPos(p, k);
+        parInitNode(p, i);
+        sum += p->tokens[i].isOperator ? -1 : 1;
+    }
+    p->offset[t] = sum;
+}
+
+static void stackPhaseMatch(void* ctx, int t) {
+    ParallelParse* p = (ParallelParse*)ctx;
+    long long height = p->offset[t];
+    int minLevel = INT_MAX;
+    IntList* stack = &p->stack[t];
+    for (int k = chunkStart(p, t); k < chunkStart(p, t + 1); k++) {
+        height += p->tokens[parPos(p, k)].isOperator ? -1 : 1;
+        p->level[k] = (int)height;
+        if (p->level[k] < minLevel) minLevel = p->level[k];
+        if (p->tokens[parPos(p, k)].isOperator) {
+            while (stack->size && p->level[stack->data[stack->size - 1]] > p->level[k]) stack->size--;
+            if (stack->size) p->leftLink[k] = stack->data[stack->size - 1];
+            else intListPush(&p->open[t], k);
+        }
+        intListPush(stack, k);
+    }
+    p->minLevel[t] = minLevel;
+}
+
+static void stackPhaseLink(void* ctx, int t) {
+    ParallelParse* p = (ParallelParse*)ctx;
+    for (int u = 0; u < p->open[t].size; u++) {
+        int k = p->open[t].data[u];
+        for (int c = t - 1; c >= 0 && (p->leftLink[k] = findCandidate(p, &p->stack[c], p->level[k], false)) < 0; c--)
+            ;
+    }
+    for (int k = chunkStart(p, t); k < chunkStart(p, t + 1); k++) {
+        int i = parPos(p, k);
+        if (!p->tokens[i].isOperator) continue;
+        Node* near = &p->nodes[parPos(p, k - 1)];
+        Node* far = &p->nodes[parPos(p, p->leftLink[k])];
+        p->nodes[i].left = p->reverse ? near : far;
+        p->nodes[i].right = p->reverse ? far : near;
+    }
+}
+
+// Infix: with d the parenthesis depth, an operator binds with key
+// d * 3 + precedence. The tree is the Cartesian tree of the keys (ties go
+// to the later operator, which gives left associativity): an operator's
+// parent is the lower of its nearest stronger-binding neighbours, and an
+// operand's parent is the lower of its two adjacent operators.
+
+enum { INFIX_START, INFIX_OPERAND, INFIX_OPERATOR, INFIX_OPEN, INFIX_CLOSE };
+
+static int infixKind(const Token* token) {
+    if (token->isOperator) return INFIX_OPERATOR;
+    if (strcmp(token->value, "(") == 0) return INFIX_OPEN;
+    if (strcmp(token->value, ")") == 0) return INFIX_CLOSE;
+    return INFIX_OPERAND;
+}
+
+static void infixPhaseSum(void* ctx, int t) {
+    ParallelParse* p = (ParallelParse*)ctx;
+    long long sum = 0;
+    bool valid = true;
+    p->firstOp[t] = p->lastOp[t] = -1;
+    for (int k = chunkStart(p, t); k < chunkStart(p, t + 1); k++) {
+        int kind = infixKind(&p->tokens[k]);
+        int prev = k == 0 ? INFIX_START : infixKind(&p->tokens[k - 1]);
+        //Operands and '(' follow an operator or '('; operators and ')' follow an operand or ')'
+        bool wantsOperand = prev == INFIX_START || prev == INFIX_OPERATOR || prev == INFIX_OPEN;
+        if (wantsOperand != (kind == INFIX_OPERAND || kind == INFIX_OPEN)) valid = false;
+        if (k == p->tokenCount - 1 && kind != INFIX_OPERAND && kind != INFIX_CLOSE) valid = false;
+
+        if (kind == INFIX_OPEN) sum++;
+        else if (kind == INFIX_CLOSE) sum--;
+        else parInitNode(p, k);
+        if (kind == INFIX_OPERATOR) {
+            if (p->firstOp[t] < 0) p->firstOp[t] = k;
+            p->lastOp[t] = k;
+        }
+    }
+    p->offset[t] = sum;
+    p->valid[t] = valid;
+}
+
+static void infixPhaseMatch(void* ctx, int t) {
+    ParallelParse* p = (ParallelParse*)ctx;
+    int lo = chunkStart(p, t), hi = chunkStart(p, t + 1);
+    long long depth = p->offset[t];
+    int minDepth = INT_MAX;
+    IntList* stack = &p->stack[t];
+    for (int k = lo; k < hi; k++) {
+        int kind = infixKind(&p->tokens[k]);
+        if (kind == INFIX_OPEN) depth++;
+        else if (kind == INFIX_CLOSE) depth--;
+        if (depth < minDepth) minDepth = (int)depth;
+        if (kind != INFIX_OPERATOR) continue;
+        p->level[k] = (int)depth * 3 + precedence(p->tokens[k].value[0]);
+        //Nearest earlier operator that binds strictly weaker
+        while (stack->size && p->level[stack->data[stack->size - 1]] >= p->level[k]) stack->size--;
+        if (stack->size) p->leftLink[k] = stack->data[stack->size - 1];
+        else intListPush(&p->open[t], k);
+        intListPush(stack, k);
+    }
+    p->minLevel[t] = minDepth;
+
+    stack = &p->stackRight[t];
+    for (int k = hi - 1; k >= lo; k--) {
+        if (!p->tokens[k].isOperator) continue;
+        //Nearest later operator that binds weaker or equally
+        while (stack->size && p->level[stack->data[stack->size - 1]] > p->level[k]) stack->size--;
+        if (stack->size) p->rightLink[k] = stack->data[stack->size - 1];
+        else intListPush(&p->openRight[t], k);
+        intListPush(stack, k);
+    }
+}
+
+static void infixPhaseLink(void* ctx, int t) {
+    ParallelParse* p = (ParallelParse*)ctx;
+    int lo = chunkStart(p, t), hi = chunkStart(p, t + 1);
+    for (int u = 0; u < p->open[t].size; u++) {
+        int k = p->open[t].data[u];
+        for (int c = t - 1; c >= 0 && (p->leftLink[k] = findCandidate(p, &p->stack[c], p->level[k], true)) < 0; c--)
+            ;
+    }
+    for (int u = 0; u < p->openRight[t].size; u++) {
+        int k = p->openRight[t].data[u];
+        for (int c = t + 1; c < p->threads && (p->rightLink[k] = findCandidate(p, &p->stackRight[c], p->level[k], false)) < 0; c++)
+            ;
+    }
+    //Operands hang off their adjacent operators
+    int op = p->opBefore[t];
+    for (int k = lo; k < hi; k++) {
+        if (p->tokens[k].isOperator) op = k;
+        else p->leftLink[k] = op;
+    }
+    op = p->opAfter[t];
+    for (int k = hi - 1; k >= lo; k--) {
+        if (p->tokens[k].isOperator) op = k;
+        else p->rightLink[k] = op;
+    }
+    for (int k = lo; k < hi; k++) {
+        int kind = infixKind(&p->tokens[k]);
+        if (kind != INFIX_OPERAND && kind != INFIX_OPERATOR) continue;
+        int l = p->leftLink[k], r = p->rightLink[k], parent;
+        if (l < 0 && r < 0) {
+            p->root = k;
+            continue;
+        }
+        if (l < 0) parent = r;
+        else if (r < 0) parent = l;
+        else parent = p->level[l] < p->level[r] ? r : l;
+        if (parent > k) p->nodes[parent].left = &p->nodes[k];
+        else p->nodes[parent].right = &p->nodes[k];
+    }
+}
+
+//Builds the tree for one expression on several threads. All nodes live in
+//*nodes (release with free). Returns NULL if the expression is invalid;
+//nothing is printed so the caller can report the error.
+Node* buildTreeParallel(Token* tokens, int tokenCount, const char* inputType, int threads, Node** nodes) {
+    ParallelParse* p = (ParallelParse*)calloc(1, sizeof(ParallelParse));
+    if (!p) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    if (threads < 1) threads = 1;
+    if (threads > PAR_MAX_THREADS) threads = PAR_MAX_THREADS;
+    if (threads > tokenCount) threads = tokenCount > 0 ? tokenCount : 1;
+    p->tokens = tokens;
+    p->tokenCount = tokenCount;
+    p->threads = threads;
+    p->infix = strcmp(inputType, "infix") == 0;
+    p->reverse = strcmp(inputType, "prefix") == 0;
+    p->root = -1;
+    p->nodes = (Node*)malloc(sizeof(Node) * (size_t)(tokenCount > 0 ? tokenCount : 1));
+    p->level = (int*)malloc(sizeof(int) * (size_t)(tokenCount > 0 ? tokenCount : 1));
+    p->leftLink = (int*)malloc(sizeof(int) * (size_t)(tokenCount > 0 ? tokenCount : 1));
+    p->rightLink = (int*)malloc(sizeof(int) * (size_t)(tokenCount > 0 ? tokenCount : 1));
+    if (!p->nodes || !p->level || !p->leftLink || !p->rightLink) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    memset(p->leftLink, 0xff, sizeof(int) * (size_t)tokenCount);
+    memset(p->rightLink, 0xff, sizeof(int) * (size_t)tokenCount);
+
+    bool valid = tokenCount > 0;
+    Node* root = NULL;
+    if (valid) {
+        parallelFor(threads, p->infix ? infixPhaseSum : stackPhaseSum, p);
+
+        //Exclusive scan of the chunk sums (one entry per thread)
+        long long running = 0;
+        for (int t = 0; t < threads; t++) {
+            long long sum = p->offset[t];
+            p->offset[t] = running;
+            running += sum;
+        }
+        if (p->infix) {
+            valid = running == 0;
+            int op = -1;
+            for (int t = 0; t < threads; t++) {
+                p->opBefore[t] = op;
+                if (p->lastOp[t] >= 0) op = p->lastOp[t];
+                valid = valid && p->valid[t];
+            }
+            op = -1;
+            for (int t = threads - 1; t >= 0; t--) {
+                p->opAfter[t] = op;
+                if (p->firstOp[t] >= 0) op = p->firstOp[t];
+            }
+        } else {
+            valid = running == 1;
+        }
+    }
+    if (valid) {
+        parallelFor(threads, p->infix ? infixPhaseMatch : stackPhaseMatch, p);
+        //Infix depth never drops below 0; postfix height never below 1
+        for (int t = 0; t < threads; t++) {
+            if (p->minLevel[t] < (p->infix ? 0 : 1)) valid = false;
+        }
+    }
+    if (valid) {
+        parallelFor(threads, p->infix ? infixPhaseLink : stackPhaseLink, p);
+        root = p->infix ? &p->nodes[p->root] : &p->nodes[parPos(p, tokenCount - 1)];
+    }
+
+    for (int t = 0; t < PAR_MAX_THREADS; t++) {
+        free(p->open[t].data);
+        free(p->openRight[t].data);
+        free(p->stack[t].data);
+        free(p->stackRight[t].data);
+    }
+    free(p->level);
+    free(p->leftLink);
+    free(p->rightLink);
+    if (root) *nodes = p->nodes;
+    else free(p->nodes);
+    free(p);
+    return root;
+}
+
+//Reads a whole expression from a file (or "-" for stdin); line breaks
+//and tabs become spaces so the space-splitting tokenizers accept them
+char* loadExpression(const char* path, size_t* length) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        printf("Error: Cannot open input file '%s'\n", path);
+        return NULL;
+    }
+    size_t capacity = 1 << 16, len = 0, n;
+    char* buf = (char*)malloc(capacity + 1);
+    while (buf && (n = fread(buf + len, 1, capacity - len, file)) > 0) {
+        len += n;
+        if (len == capacity) {
+            capacity *= 2;
+            buf = (char*)realloc(buf, capacity + 1);
+        }
+    }
+    if (!buf) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    if (file != stdin) fclose(file);
+    for (size_t i = 0; i < len; i++) {
+        if (isspace((unsigned char)buf[i])) buf[i] = ' ';
+    }
+    buf[len] = '\0';
+    *length = len;
+    return buf;
+}
+
+//Shared state for splitting a loaded expression on several threads
+typedef struct {
+    char* buf;
+    size_t length;
+    int threads;
+    size_t start[PAR_MAX_THREADS + 1];  //Chunk boundaries, moved to token starts
+    int count[PAR_MAX_THREADS];         //Tokens per chunk, then first token index
+    Token* tokens;
+    bool valid[PAR_MAX_THREADS];
+} ParallelSplit;
+
+static void splitPhaseCount(void* ctx, int t) {
+    ParallelSplit* s = (ParallelSplit*)ctx;
+    int count = 0;
+    for (size_t i = s->start[t]; i < s->start[t + 1]; i++) {
+        if (s->buf[i] != ' ' && (i == 0 || s->buf[i - 1] == ' ')) count++;
+    }
+    s->count[t] = count;
+}
+
+static void splitPhaseStore(void* ctx, int t) {
+    ParallelSplit* s = (ParallelSplit*)ctx;
+    int index = s->count[t];
+    bool valid = true;
+    size_t i = s->start[t];
+    while (i < s->start[t + 1]) {
+        if (s->buf[i] == ' ') {
+            i++;
+            continue;
+        }
+        Token* token = &s->tokens[index++];
+        token->value = s->buf + i;
+        while (i < s->length && s->buf[i] != ' ') i++;
+        s->buf[i++] = '\0'; //Terminate in place; the values point into buf
+        valid = valid && isValidToken(token->value);
+        token->isOperator = isOperator(token->value);
+    }
+    s->valid[t] = valid;
+}
+
+//Tokenizes buf in place on several threads. Token values point into buf
+//(no strdup). Returns the token count, or -1 if a token is invalid.
+int tokenizeParallel(char* buf, size_t length, Token** tokens, int threads) {
+    ParallelSplit s;
+    if (threads < 1) threads = 1;
+    if (threads > PAR_MAX_THREADS) threads = PAR_MAX_THREADS;
+    s.buf = buf;
+    s.length = length;
+    s.threads = threads;
+    for (int t = 0; t <= threads; t++) {
+        size_t pos = length / (size_t)threads * (size_t)t;
+        if (t == threads) pos = length;
+        //Move the boundary past a token that straddles it
+        while (pos > 0 && pos < length && buf[pos - 1] != ' ') pos++;
+        s.start[t] = pos;
+    }
+    parallelFor(threads, splitPhaseCount, &s);
+    int total = 0;
+    for (int t = 0; t < threads; t++) {
+        int count = s.count[t];
+        s.count[t] = total;
+        total += count;
+    }
+    s.tokens = (Token*)malloc(sizeof(Token) * (size_t)(total > 0 ? total : 1));
+    if (!s.tokens) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    parallelFor(threads, splitPhaseStore, &s);
+    *tokens = s.tokens;
+    for (int t = 0; t < threads; t++) {
+        if (!s.valid[t]) return -1;
+    }
+    return total;
+}
+
+//Undoes tokenizeParallel so the text can go through the sequential path
+void restoreExpression(char* buf, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (buf[i] == '\0') buf[i] = ' ';
+    }
+}
+
+//Default worker count: one per online core
+int defaultThreads(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > 0) return cores > PAR_MAX_THREADS ? PAR_MAX_THREADS : (int)cores;
+#endif
+    return 1;
+}
+
+//Seconds from a monotonic clock
+double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//True if two trees have the same shape and values. Pairs of subtrees
+//still to compare wait on one stack, a's node above b's.
+bool sameTree(Node* a, Node* b) {
+    Stack pending;
+    initStack(&pending);
+    bool same = true;
+    for (;;) {
+        if (!a || !b) {
+            same = a == b;
+        } else if (strcmp(a->value, b->value) != 0) {
+            same = false;
+        } else {
+            push(&pending, b->right);
+            push(&pending, a->right);
+            a = a->left;
+            b = b->left;
+            continue;
+        }
+        if (!same || isEmpty(&pending)) break;
+        a = pop(&pending);
+        b = pop(&pending);
+    }
+    freeStack(&pending);
+    return same;
+}
+
+//Times the sequential builders against the parallel builder on one
+//expression file, for 1, 2, 4, ... up to maxThreads workers
+int benchParse(const char* path, const char* inputType, int maxThreads) {
+    size_t length;
+    char* buf = loadExpression(path, &length);
+    if (!buf) return 1;
+    char* text = strdup(buf);
+    if (!text) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+
+    //Sequential: tokenize + validate + build, as a normal run does
+    double start = nowSeconds();
+    int maxTokens = (int)(length / 2 + 1), seqCount;
+    Token* seqTokens = (Token*)malloc(sizeof(Token) * (size_t)maxTokens);
+    if (!seqTokens) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    Node* seqRoot = parseExpression(text, inputType, seqTokens, maxTokens, &seqCount);
+    double sequential = nowSeconds() - start;
+    if (!seqRoot) {
+        free(seqTokens);
+        free(text);
+        free(buf);
+        return 1;
+    }
+    printf("sequential: %.3f ms\n", sequential * 1e3);
+
+    int status = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        memcpy(text, buf, length + 1);
+        Token* tokens;
+        Node* nodes = NULL;
+        start = nowSeconds();
+        int tokenCount = tokenizeParallel(text, length, &tokens, threads);
+        Node* root = tokenCount > 0 ? buildTreeParallel(tokens, tokenCount, inputType, threads, &nodes) : NULL;
+        double parallel = nowSeconds() - start;
+        bool same = root && sameTree(root, seqRoot);
+        printf("parallel x%d: %.3f ms  speedup %.2fx  %s\n", threads, parallel * 1e3,
+               sequential / parallel, same ? "tree matches" : "TREE DIFFERS");
+        if (!same) status = 1;
+        free(nodes);
+        free(tokens);
+        if (threads * 2 > maxThreads && threads != maxThreads) threads = maxThreads / 2;
+    }
+    freeTree(seqRoot);
+    freeTokens(seqTokens, seqCount);
+    free(seqTokens);
+    free(text);
+    free(buf);
+    return status;
+}
+
+// ----------- PARALLEL Emission -----------
+
+//Nodes per part the tree is cut into; smaller trees are rendered as one part
+#define EMIT_PART_NODES 8192
+
+//The tree is cut by size into parts of about EMIT_PART_NODES nodes. A part
+//is a subtree with holes where the parts below it were cut out, so a long
+//chain splits into a run of parts instead of one. Workers size and later
+//render the parts; only the parts themselves are placed sequentially.
+typedef struct {
+    Node* top;
+    int firstHole;          //Parts cut out of this one, left to right, in holes[]
+    int holeCount;
+    size_t size;            //Bytes of its own tokens
+    size_t before;          //Bytes of the parent part that come before this one
+    size_t total;           //Bytes of the whole subtree, holes filled in
+    size_t offset;          //Where the subtree starts in the output
+} EmitPart;
+
+typedef struct {
+    int notation;
+    int threads;
+    EmitPart* parts;        //Parents come after their holes
+    int partCount;
+    int partCapacity;
+    int* holes;
+    int holeCount;
+    int holeCapacity;
+    char* out;
+} ParallelEmit;
+
+//Cuts the tree in one post-order walk: a node whose uncut subtree reaches
+//EMIT_PART_NODES becomes the top of a part, and the parts found below it
+//since it was entered become its holes
+static void cutParts(ParallelEmit* e, Node* root) {
+    typedef struct {
+        Node* node;
+        int step;
+        int pending;        //Parts waiting for a parent when the node was entered
+        long nodes;         //Uncut nodes of its subtree so far
+    } CutFrame;
+    int capacity = 0, count = 0;
+    int pendingCapacity = 0, pendingCount = 0;
+    CutFrame* stack = (CutFrame*)growArray(NULL, 0, &capacity, sizeof(CutFrame));
+    int* pending = (int*)growArray(NULL, 0, &pendingCapacity, sizeof(int));
+    stack[count++] = (CutFrame){root, 0, 0, 1};
+    while (count > 0) {
+        CutFrame* frame = &stack[count - 1];
+        Node* child = NULL;
+        if (frame->step == 0) {
+            frame->step = 1;
+            frame->pending = pendingCount;
+            child = frame->node->left;
+        } else if (frame->step == 1) {
+            frame->step = 2;
+            child = frame->node->right;
+        }
+        if (child) {
+            stack = (CutFrame*)growArray(stack, count + 1, &capacity, sizeof(CutFrame));
+            stack[count++] = (CutFrame){child, 0, 0, 1};
+            continue;
+        }
+        if (frame->step < 2) continue;
+
+        CutFrame done = stack[--count];
+        if (done.nodes < EMIT_PART_NODES && count > 0) {
+            stack[count - 1].nodes += done.nodes;
+            continue;
+        }
+        e->parts = (EmitPart*)growArray(e->parts, e->partCount + 1, &e->partCapacity, sizeof(EmitPart));
+        EmitPart* part = &e->parts[e->partCount];
+        memset(part, 0, sizeof(*part));
+        part->top = done.node;
+        part->firstHole = e->holeCount;
+        part->holeCount = pendingCount - done.pending;
+        for (int i = done.pending; i < pendingCount; i++) {
+            e->holes = (int*)growArray(e->holes, e->holeCount + 1, &e->holeCapacity, sizeof(int));
+            e->holes[e->holeCount++] = pending[i];
+        }
+        pendingCount = done.pending;
+        pending = (int*)growArray(pending, pendingCount + 1, &pendingCapacity, sizeof(int));
+        pending[pendingCount++] = e->partCount++;
+    }
+    free(stack);
+    free(pending);
+}
+
+//Where walkPart is in its part
+typedef struct {
+    ParallelEmit* e;
+    int hole, lastHole;
+    Node* nextHole;
+    char* out;
+    size_t pos;
+} PartCursor;
+
+static void partToken(void* ctx, Node* node, const char* text) {
+    (void)node;
+    PartCursor* c = (PartCursor*)ctx;
+    if (c->out) putToken(c->out + c->pos, text);
+    c->pos += strlen(text) + 1;
+}
+
+//A hole is skipped: its size is added when rendering, its start recorded
+//when sizing
+static bool partHole(void* ctx, Node* node) {
+    PartCursor* c = (PartCursor*)ctx;
+    if (node != c->nextHole) return false;
+    EmitPart* cut = &c->e->parts[c->e->holes[c->hole++]];
+    if (c->out) c->pos += cut->total;
+    else cut->before = c->pos;
+    c->nextHole = c->hole < c->lastHole ? c->e->parts[c->e->holes[c->hole]].top : NULL;
+    return true;
+}
+
+//Walks one part in output order, skipping its holes. Without out it sizes
+//the part and records where each hole starts in it; with out it writes the
+//part's tokens there, leaving room for the holes. Returns the bytes covered.
+static size_t walkPart(ParallelEmit* e, EmitPart* part, char* out) {
+    PartCursor c = {e, part->firstHole, part->firstHole + part->holeCount, NULL, out, 0};
+    c.nextHole = c.hole < c.lastHole ? e->parts[e->holes[c.hole]].top : NULL;
+    TokenSink sink = {partToken, partHole, &c};
+    walkTree(part->top, e->notation, &sink);
+    return c.pos;
+}
+
+static void emitPhaseSize(void* ctx, int t) {
+    ParallelEmit* e = (ParallelEmit*)ctx;
+    for (int i = t; i < e->partCount; i += e->threads)
+        e->parts[i].size = walkPart(e, &e->parts[i], NULL);
+}
+
+static void emitPhaseRender(void* ctx, int t) {
+    ParallelEmit* e = (ParallelEmit*)ctx;
+    for (int i = t; i < e->partCount; i += e->threads)
+        walkPart(e, &e->parts[i], e->out + e->parts[i].offset);
+}
+
+//Fills in every part's total bytes (holes before parents) and then its
+//offset (parents before holes). Returns the length of the whole output.
+static size_t placeParts(ParallelEmit* e) {
+    for (int i = 0; i < e->partCount; i++) {
+        EmitPart* part = &e->parts[i];
+        part->total = part->size;
+        for (int h = 0; h < part->holeCount; h++)
+            part->total += e->parts[e->holes[part->firstHole + h]].total;
+    }
+    for (int i = e->partCount - 1; i >= 0; i--) {
+        EmitPart* part = &e->parts[i];
+        size_t filled = 0;  //Bytes of the holes already passed
+        if (i == e->partCount - 1) part->offset = 0;
+        for (int h = 0; h < part->holeCount; h++) {
+            EmitPart* cut = &e->parts[e->holes[part->firstHole + h]];
+            cut->offset = part->offset + cut->before + filled;
+            filled += cut->total;
+        }
+    }
+    return e->partCount ? e->parts[e->partCount - 1].total : 0;
+}
+
+//Renders the whole tree into one exactly-sized buffer (not NUL-terminated)
+//using several threads. Returns the buffer and its length in *length.
+char* renderParallel(Node* root, int notation, int threads, size_t* length) {
+    ParallelEmit e;
+    memset(&e, 0, sizeof(e));
+    if (threads < 1) threads = 1;
+    if (threads > PAR_MAX_THREADS) threads = PAR_MAX_THREADS;
+    e.notation = notation;
+    e.threads = threads;
+    if (root && threads == 1) {
+        //Nothing to share out: the whole tree is one part
+        e.parts = (EmitPart*)growArray(NULL, 0, &e.partCapacity, sizeof(EmitPart));
+        memset(e.parts, 0, sizeof(EmitPart));
+        e.parts[e.partCount++].top = root;
+    } else if (root) {
+        cutParts(&e, root);
+    }
+
+    parallelFor(threads, emitPhaseSize, &e);
+    size_t total = placeParts(&e);
+    e.out = (char*)malloc(total + 1);
+    if (!e.out) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    parallelFor(threads, emitPhaseRender, &e);
+
+    free(e.parts);
+    free(e.holes);
+    *length = total;
+    return e.out;
+}
+
+//Same output as printExpression, rendered on several threads and written at once
+bool printExpressionParallel(Node* root, const char* outputType, int threads) {
+    if (strcmp(outputType, "all") == 0) return printExpression(root, outputType);
+    int notation = notationOf(outputType);
+    if (notation < 0) {
+        printOutputTypeError();
+        return false;
+    }
+    size_t length;
+    char* text = renderParallel(root, notation, threads, &length);
+    printf("\n%s", notationHeader[notation]);
+    writeOutput(text, length);
+    printf("\n");
+    free(text);
+    return true;
+}
+
+//Reruns an expression the parallel builder rejected on the sequential
+//path, for the exact error (or the rare input, such as an empty "( )",
+//that the sequential builder tolerates)
+static int convertRejected(char* buf, size_t length, int tokenCount, const char* inputType,
+                           const char* outputType, bool balance) {
+    restoreExpression(buf, length);
+    int maxTokens = tokenCount > 0 ? tokenCount : (int)(length / 2 + 1);
+    Token* seqTokens = (Token*)malloc(sizeof(Token) * (size_t)maxTokens);
+    if (!seqTokens) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    int seqCount;
+    Node* root = parseExpression(buf, inputType, seqTokens, maxTokens, &seqCount);
+    int status = 1;
+    if (root) {
+        int before = balance ? treeDepth(root) : 0, after;
+        if (balance) root = balanceChains(root, &after);
+        status = printExpression(root, outputType) ? 0 : 1;
+        if (balance && status == 0) printf("Tree depth: %d (was %d before balancing)\n", after, before);
+        freeTree(root);
+        freeTokens(seqTokens, seqCount);
+    }
+    free(seqTokens);
+    return status;
+}
+
+//Converts one (possibly huge) expression from a file with the parallel
+//builders. Invalid input is handed to the sequential path, which prints
+//exactly the same errors as a normal run. With balance, + and * chains
+//are balanced first and the depths are printed, as --balance does.
+int convertParallel(const char* path, const char* inputType, const char* outputType, int threads,
+                    bool balance) {
+    size_t length;
+    char* buf = loadExpression(path, &length);
+    if (!buf) return 1;
+
+    Token* tokens = NULL;
+    Node* nodes = NULL;
+    Node* root = NULL;
+    int tokenCount = tokenizeParallel(buf, length, &tokens, threads);
+    if (tokenCount > 0 && (strcmp(inputType, "infix") == 0 || strcmp(inputType, "prefix") == 0 ||
+                           strcmp(inputType, "postfix") == 0)) {
+        root = buildTreeParallel(tokens, tokenCount, inputType, threads, &nodes);
+    }
+
+    int status;
+    if (root) {
+        int before = balance ? treeDepth(root) : 0, after;
+        if (balance) root = balanceChains(root, &after);
+        status = printExpressionParallel(root, outputType, threads) ? 0 : 1;
+        if (balance && status == 0) printf("Tree depth: %d (was %d before balancing)\n", after, before);
+        free(nodes);
+    } else {
+        status = convertRejected(buf, length, tokenCount, inputType, outputType, balance);
+    }
+    free(tokens);
+    free(buf);
+    return status;
+}
+
+//Times the per-token printf traversal against the parallel renderer.
+//The expressions go to stdout and the timings to stderr.
+int benchEmit(const char* path, const char* inputType, const char* outputType, int maxThreads) {
+    size_t length;
+    char* buf = loadExpression(path, &length);
+    if (!buf) return 1;
+    Token* tokens;
+    Node* nodes = NULL;
+    int tokenCount = tokenizeParallel(buf, length, &tokens, maxThreads);
+    Node* root = tokenCount > 0 ? buildTreeParallel(tokens, tokenCount, inputType, maxThreads, &nodes) : NULL;
+    if (!root || notationOf(outputType) < 0) {
+        printf("Error: Invalid %s expression or output type\n", inputType);
+        free(tokens);
+        free(buf);
+        return 1;
+    }
+
+    double start = nowSeconds();
+    printTraversal(root, notationOf(outputType));
+    fflush(stdout);
+    double sequential = nowSeconds() - start;
+    fprintf(stderr, "printf traversal: %.3f ms\n", sequential * 1e3);
+
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        start = nowSeconds();
+        printExpressionParallel(root, outputType, threads);
+        fflush(stdout);
+        double parallel = nowSeconds() - start;
+        fprintf(stderr, "parallel render x%d: %.3f ms  speedup %.2fx\n", threads, parallel * 1e3,
+                sequential / parallel);
+        if (threads * 2 > maxThreads && threads != maxThreads) threads = maxThreads / 2;
+    }
+    free(nodes);
+    free(tokens);
+    free(buf);
+    return 0;
+}
+
+// ----------- GATHER Output -----------
+
+//--gather writes the result without copying any token text. Every output
+//token is already in the input buffer, so the output is a list of iovecs:
+//tokens (with the space after them) point into the input, parentheses and
+//headers point at constant strings. An entry that starts where the last
+//one ended is merged into it, so tokens that keep their input order, and
+//runs of parentheses, become single entries. The list is written with
+//vmsplice when stdout is a pipe (the pipe takes the pages instead of a
+//copy) and with writev otherwise.
+
+#define GATHER_PAREN_RUN 64      //Parentheses one constant entry can cover
+#define GATHER_SPLICE_MIN 4096   //Mean entry size for vmsplice; a pipe holds
+                                 //only 16 entries, so small ones are copied
+#define GATHER_FLATTEN_MAX 32    //Below this mean entry size one copy into a
+                                 //buffer beats handing the kernel the list
+
+static const char gatherOpen[] =
+    "( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( "
+    "( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ( ";
+static const char gatherClose[] =
+    ") ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) "
+    ") ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ";
+
+typedef struct {
+    struct iovec* iov;
+    int count, capacity;
+    Node* nodes;                 //Node i was built from tokens[i]
+    Token* tokens;
+} GatherList;
+
+static void gatherAdd(GatherList* g, const char* text, size_t len) {
+    if (g->count > 0) {
+        struct iovec* last = &g->iov[g->count - 1];
+        if ((const char*)last->iov_base + last->iov_len == text) {
+            last->iov_len += len;
+            return;
+        }
+    }
+    if (g->count == g->capacity) {
+        g->capacity = g->capacity ? g->capacity * 2 : 1024;
+        g->iov = (struct iovec*)realloc(g->iov, sizeof(struct iovec) * (size_t)g->capacity);
+        if (!g->iov) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    g->iov[g->count].iov_base = (void*)text;
+    g->iov[g->count].iov_len = len;
+    g->count++;
+}
+
+//Adds "( " or ") ", extending the last entry while it is inside the run
+static void gatherParen(GatherList* g, const char* run) {
+    if (g->count > 0) {
+        struct iovec* last = &g->iov[g->count - 1];
+        const char* end = (const char*)last->iov_base + last->iov_len;
+        if (end >= run && end < run + 2 * GATHER_PAREN_RUN) {
+            last->iov_len += 2;
+            return;
+        }
+    }
+    gatherAdd(g, run, 2);
+}
+
+//Adds a node's token and the space after it, straight from the input
+static void gatherToken(GatherList* g, Node* node) {
+    const char* text = g->tokens[node - g->nodes].value;
+    size_t len = strlen(node->value); //Node values are cut at 9 characters, so is the output
+    if (text[len] == ' ') {
+        gatherAdd(g, text, len + 1);
+    } else {
+        gatherAdd(g, text, len);
+        gatherAdd(g, " ", 1);
+    }
+}
+
+static void gatherNext(void* ctx, Node* node, const char* text) {
+    GatherList* g = (GatherList*)ctx;
+    if (node) gatherToken(g, node);
+    else gatherParen(g, text[0] == '(' ? gatherOpen : gatherClose);
+}
+
+//Same order as renderTree
+static void gatherTree(GatherList* g, Node* root, int notation) {
+    TokenSink sink = {gatherNext, NULL, g};
+    walkTree(root, notation, &sink);
+}
+
+//Writes the entries (bytes in all) to fd; true if it went through
+//vmsplice. Entries are shortened in place after a partial write.
+static bool writeGathered(int fd, struct iovec* iov, int count, size_t bytes, bool* failed) {
+    bool spliced = false;
+    *failed = false;
+#ifdef _WIN32
+    (void)fd;
+    (void)bytes;
+    for (int i = 0; i < count; i++) {
+        if (fwrite(iov[i].iov_base, 1, iov[i].iov_len, stdout) != iov[i].iov_len) *failed = true;
+    }
+    fflush(stdout);
+#else
+    bool splice = false;
+#ifdef __linux__
+    struct stat st;
+    splice = bytes / (size_t)(count ? count : 1) >= GATHER_SPLICE_MIN && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+#endif
+    int i = 0;
+    while (i < count) {
+        int n = count - i < IOV_MAX ? count - i : IOV_MAX;
+        ssize_t written;
+#ifdef __linux__
+        if (splice) {
+            written = vmsplice(fd, iov + i, (unsigned long)n, 0);
+            if (written < 0 && errno != EINTR) {
+                splice = false; //Not supported here: copy instead
+                continue;
+            }
+            if (written > 0) spliced = true;
+        } else
+#endif
+        {
+            written = writev(fd, iov + i, n);
+        }
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            *failed = true;
+            break;
+        }
+        while (written > 0) {
+            if ((size_t)written >= iov[i].iov_len) {
+                written -= (ssize_t)iov[i].iov_len;
+                i++;
+            } else {
+                iov[i].iov_base = (char*)iov[i].iov_base + written;
+                iov[i].iov_len -= (size_t)written;
+                written = 0;
+            }
+        }
+    }
+#endif
+    return spliced;
+}
+
+//Converts the expression in path and writes it as a gather list
+int convertGathered(const char* path, const char* inputType, const char* outputType, bool stats) {
+    bool all = strcmp(outputType, "all") == 0;
+    int notation = notationOf(outputType);
+    if (!all && notation < 0) {
+        printOutputTypeError();
+        return 1;
+    }
+    size_t length;
+    char* buf = loadExpression(path, &length);
+    if (!buf) return 1;
+
+    double start = nowSeconds();
+    Token* tokens = NULL;
+    Node* nodes = NULL;
+    Node* root = NULL;
+    int tokenCount = tokenizeParallel(buf, length, &tokens, 1);
+    if (tokenCount > 0 && notationOf(inputType) >= 0) {
+        root = buildTreeParallel(tokens, tokenCount, inputType, 1, &nodes);
+    }
+    if (!root) {
+        int status = convertRejected(buf, length, tokenCount, inputType, outputType, false);
+        free(tokens);
+        free(buf);
+        return status;
+    }
+    restoreExpression(buf, length); //Puts the spaces back so tokens keep them
+    double parsed = nowSeconds();
+
+    GatherList g;
+    memset(&g, 0, sizeof(g));
+    g.nodes = nodes;
+    g.tokens = tokens;
+    for (int n = all ? NOTATION_PREFIX : notation; n <= (all ? NOTATION_POSTFIX : notation); n++) {
+        gatherAdd(&g, "\n", 1);
+        gatherAdd(&g, notationHeader[n], strlen(notationHeader[n]));
+        gatherTree(&g, root, n);
+        gatherAdd(&g, "\n", 1);
+    }
+    double gathered = nowSeconds();
+
+    size_t bytes = 0;
+    for (int i = 0; i < g.count; i++) bytes += g.iov[i].iov_len;
+    int entries = g.count;
+    fflush(stdout);
+    bool failed = false, spliced = false, flattened = bytes < (size_t)entries * GATHER_FLATTEN_MAX;
+    if (flattened) {
+        char* text = (char*)malloc(bytes);
+        if (!text) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        char* out = text;
+        for (int i = 0; i < g.count; i++) {
+            memcpy(out, g.iov[i].iov_base, g.iov[i].iov_len);
+            out += g.iov[i].iov_len;
+        }
+        writeOutput(text, bytes);
+        free(text);
+    } else {
+        spliced = writeGathered(fileno(stdout), g.iov, g.count, bytes, &failed);
+    }
+    double written = nowSeconds();
+    if (stats) {
+        fprintf(stderr, "%d tokens, %zu bytes in %d entries (%.1f bytes each), %s\n", tokenCount, bytes,
+                entries, entries ? (double)bytes / entries : 0.0, flattened ? "copied, entries too small" : spliced ? "vmsplice" : "writev");
+        fprintf(stderr, "parse %.3f ms, gather %.3f ms, write %.3f ms\n", (parsed - start) * 1e3,
+                (gathered - parsed) * 1e3, (written - gathered) * 1e3);
+    }
+
+    free(g.iov);
+    free(nodes);
+    free(tokens);
+    //The pipe may still refer to the input pages; they are left to exit
+    if (!spliced) free(buf);
+    if (failed) {
+        fprintf(stderr, "Error: Cannot write the output\n");
+        return 1;
+    }
+    return 0;
+}
+
+// ----------- BULK Validation -----------
+
+//Why a line failed validation
+enum { VALID, INVALID_TOKEN, TOO_FEW_OPERANDS, EXTRA_TOKENS, INCOMPLETE, NO_TOKENS };
+
+//Byte-level token checks shared by the scalar and vector kernels:
+//tokens are separated by spaces only, as tokenize splits them (a tab is
+//part of its token), and must be an alphanumeric operand, a single
+//operator, or a single parenthesis
+static bool isSeparator(unsigned char c) { return c == ' '; }
+
+//A line of spaces and tabs, which --stream reports as having no tokens
+static bool isBlankLine(const char* line, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (line[i] != ' ' && line[i] != '\t') return false;
+    }
+    return true;
+}
+
+//Reference kernel: walks the tokens of one line and keeps the running
+//operand balance. Returns the failure reason and, in *failToken, the
+//0-based token it happened at (the token count for end-of-line errors).
+int validateLineScalar(const char* line, size_t len, bool prefix, long long* failToken) {
+    long long token = 0, balance = 0;
+    bool complete = false; //Prefix: a whole expression has been read
+    size_t i = 0;
+    while (i < len) {
+        if (isSeparator((unsigned char)line[i])) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        bool alnum = true;
+        while (i < len && !isSeparator((unsigned char)line[i])) {
+            if (!isalnum((unsigned char)line[i])) alnum = false;
+            i++;
+        }
+        bool single = i - start == 1;
+        bool op = single && strchr("+-*/", line[start]);
+        *failToken = token;
+        if (!alnum && !(single && strchr("+-*/()", line[start]))) {
+            return token == 0 && isBlankLine(line, len) ? NO_TOKENS : INVALID_TOKEN;
+        }
+        if (complete) return EXTRA_TOKENS;
+        balance += op ? -1 : 1;
+        //Postfix: every prefix keeps at least one operand on the stack.
+        //Prefix: balance reaches 1 exactly when the expression is complete.
+        if (!prefix && balance < 1) return TOO_FEW_OPERANDS;
+        if (prefix && balance == 1) complete = true;
+        token++;
+    }
+    *failToken = token;
+    if (token == 0) return NO_TOKENS;
+    if (prefix ? !complete : balance != 1) return INCOMPLETE;
+    return VALID;
+}
+
+#ifdef __SSE2__
+//Lanes of b that are spaces
+static __m128i separatorMask(__m128i b) {
+    return _mm_cmpeq_epi8(b, _mm_set1_epi8(' '));
+}
+
+//Lanes of b in [lo, lo + n) (unsigned)
+static __m128i rangeMask(__m128i b, char lo, char n) {
+    __m128i x = _mm_sub_epi8(b, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8((char)(n - 1))), x);
+}
+
+//Vector kernel, 16 bytes per step. The token-start mask becomes +1/-1
+//deltas (operand/operator), their running sum is formed with a log-step
+//prefix sum inside the register, and the smallest (postfix) or largest
+//(prefix) balance at a token start is checked against the limit. Any
+//block that might fail is handed to validateLineScalar, which reports
+//the exact token. line[-1] and 16 bytes after line[len] must be readable
+//(the reader pads its buffer); the bytes around the line count as
+//separators whatever they hold.
+int validateLine(const char* line, size_t len, bool prefix, long long* failToken) {
+    const __m128i laneIndex = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i firstLane = _mm_setr_epi8(-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i ones = _mm_set1_epi8(1), twos = _mm_set1_epi8(2), flip = _mm_set1_epi8((char)0x80);
+    long long balance = 0, tokens = 0;
+    bool complete = false;
+
+    for (size_t i = 0; i < len; i += 16) {
+        size_t count = len - i < 16 ? len - i : 16;
+        __m128i b = _mm_loadu_si128((const __m128i*)(line + i));
+        __m128i prevSep = separatorMask(_mm_loadu_si128((const __m128i*)(line + i - 1)));
+        if (i == 0) prevSep = _mm_or_si128(prevSep, firstLane);
+        //Lanes from the last byte of the line on are followed by a separator
+        long long lastLane = (long long)(len - i) - 1;
+        __m128i atEnd = _mm_cmpgt_epi8(laneIndex, _mm_set1_epi8((char)(lastLane < 16 ? lastLane - 1 : 15)));
+        __m128i nextSep = _mm_or_si128(separatorMask(_mm_loadu_si128((const __m128i*)(line + i + 1))), atEnd);
+        __m128i inLine = _mm_cmplt_epi8(laneIndex, _mm_set1_epi8((char)count));
+        __m128i isSep = _mm_or_si128(separatorMask(b), _mm_andnot_si128(inLine, _mm_set1_epi8(-1)));
+
+        __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('+')), _mm_cmpeq_epi8(b, _mm_set1_epi8('-'))),
+                                  _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('*')), _mm_cmpeq_epi8(b, _mm_set1_epi8('/'))));
+        __m128i punct = _mm_or_si128(op, _mm_or_si128(_mm_cmpeq_epi8(b, _mm_set1_epi8('(')), _mm_cmpeq_epi8(b, _mm_set1_epi8(')'))));
+        __m128i alnum = _mm_or_si128(rangeMask(b, '0', 10),
+                                     rangeMask(_mm_or_si128(b, _mm_set1_epi8(0x20)), 'a', 26));
+        //Bytes that are neither separator, alnum nor punctuation, and
+        //punctuation that is not a one-character token
+        __m128i bad = _mm_andnot_si128(_mm_or_si128(isSep, _mm_or_si128(alnum, punct)), _mm_set1_epi8(-1));
+        bad = _mm_or_si128(bad, _mm_andnot_si128(isSep, _mm_and_si128(punct,
+                                _mm_andnot_si128(_mm_and_si128(prevSep, nextSep), _mm_set1_epi8(-1)))));
+        if (_mm_movemask_epi8(bad)) return validateLineScalar(line, len, prefix, failToken);
+
+        __m128i start = _mm_andnot_si128(isSep, prevSep);
+        __m128i delta = _mm_sub_epi8(_mm_and_si128(start, ones), _mm_and_si128(_mm_and_si128(start, op), twos));
+        __m128i sum = _mm_add_epi8(delta, _mm_slli_si128(delta, 1));
+        sum = _mm_add_epi8(sum, _mm_slli_si128(sum, 2));
+        sum = _mm_add_epi8(sum, _mm_slli_si128(sum, 4));
+        sum = _mm_add_epi8(sum, _mm_slli_si128(sum, 8));
+
+        int startBits = _mm_movemask_epi8(start);
+        if (startBits) {
+            if (complete) return validateLineScalar(line, len, prefix, failToken);
+            //Extreme balance over the token starts, in biased unsigned form
+            __m128i biased = _mm_xor_si128(sum, flip);
+            __m128i m;
+            if (prefix) m = _mm_and_si128(biased, start);
+            else m = _mm_or_si128(biased, _mm_andnot_si128(start, _mm_set1_epi8(-1)));
+            for (int shift = 8; shift >= 1; shift /= 2) {
+                __m128i shifted = shift == 8 ? _mm_srli_si128(m, 8) : shift == 4 ? _mm_srli_si128(m, 4)
+                                : shift == 2 ? _mm_srli_si128(m, 2) : _mm_srli_si128(m, 1);
+                m = prefix ? _mm_max_epu8(m, shifted) : _mm_min_epu8(m, shifted);
+            }
+            int extreme = (signed char)(_mm_cvtsi128_si32(m) ^ 0x80);
+            if (!prefix && balance + extreme < 1) return validateLineScalar(line, len, prefix, failToken);
+            if (prefix && balance + extreme >= 1) {
+                //Only the last token of the line may complete the expression
+                signed char lanes[16];
+                _mm_storeu_si128((__m128i*)lanes, sum);
+                int last = 31 - __builtin_clz((unsigned)startBits);
+                for (int k = 0; k < last; k++) {
+                    if ((startBits >> k & 1) && balance + lanes[k] >= 1)
+                        return validateLineScalar(line, len, prefix, failToken);
+                }
+                complete = true;
+            }
+            tokens += __builtin_popcount((unsigned)startBits);
+        }
+        balance += (signed char)(_mm_cvtsi128_si32(_mm_srli_si128(sum, 15)) & 0xff);
+    }
+    *failToken = tokens;
+    if (tokens == 0) return NO_TOKENS;
+    if (prefix ? !complete : balance != 1) return validateLineScalar(line, len, prefix, failToken);
+    return VALID;
+}
+#else
+int validateLine(const char* line, size_t len, bool prefix, long long* failToken) {
+    return validateLineScalar(line, len, prefix, failToken);
+}
+#endif
+
+//Message for each failure reason
+static const char* validationMessage(int reason, bool prefix) {
+    switch (reason) {
+        case INVALID_TOKEN: return "Invalid token";
+        case TOO_FEW_OPERANDS: return "Too few operands for operator";
+        case EXTRA_TOKENS: return "Extra tokens after a complete expression";
+        case INCOMPLETE: return prefix ? "Too few operands" : "Too many operands";
+        default: return "No valid tokens found";
+    }
+}
+
+//Checks one expression per line without building trees. Prints every
+//invalid line with the first failing token, then a summary.
+int validateCorpus(const char* path, const char* inputType) {
+    bool prefix = strcmp(inputType, "prefix") == 0;
+    if (!prefix && strcmp(inputType, "postfix") != 0) {
+        printf("Error: Validation supports prefix and postfix input only\n");
+        return 1;
+    }
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        printf("Error: Cannot open input file '%s'\n", path);
+        return 1;
+    }
+
+    //Data starts at buf + 16 so line[-1] is readable; 16 separator bytes follow it
+    size_t capacity = 4 << 20, used = 0, n;
+    char* buf = (char*)malloc(capacity + 32);
+    if (!buf) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    memset(buf, '\n', 16);
+    char* data = buf + 16;
+    long long lineNumber = 0, invalid = 0, bytes = 0;
+    double start = nowSeconds();
+
+    for (;;) {
+        n = fread(data + used, 1, capacity - used, file);
+        used += n;
+        bytes += (long long)n;
+        memset(data + used, ' ', 16);
+        size_t lineStart = 0;
+        for (;;) {
+            char* nl = (char*)memchr(data + lineStart, '\n', used - lineStart);
+            if (!nl && (n > 0 || lineStart == used)) break;
+            size_t lineEnd = nl ? (size_t)(nl - data) : used;
+            size_t len = lineEnd - lineStart;
+            if (len > 0 && data[lineEnd - 1] == '\r') len--; //As --stream drops it
+            long long failToken;
+            lineNumber++;
+            int reason = validateLine(data + lineStart, len, prefix, &failToken);
+            if (reason != VALID) {
+                invalid++;
+                printf("Line %lld: Error: %s at token %lld\n", lineNumber,
+                       validationMessage(reason, prefix), failToken + 1);
+            }
+            lineStart = nl ? lineEnd + 1 : used;
+        }
+        memmove(data, data + lineStart, used - lineStart);
+        used -= lineStart;
+        if (n == 0) break;
+        if (used == capacity) {
+            capacity *= 2;
+            buf = (char*)realloc(buf, capacity + 32);
+            if (!buf) {
+                printf("Error: Memory allocation failed\n");
+                exit(1);
+            }
+            data = buf + 16;
+        }
+    }
+    double elapsed = nowSeconds() - start;
+    if (file != stdin) fclose(file);
+    free(buf);
+
+    printf("Checked %lld %s expressions: %lld valid, %lld invalid\n", lineNumber, inputType,
+           lineNumber - invalid, invalid);
+    fprintf(stderr, "%.1f MB/s\n", elapsed > 0 ? bytes / elapsed / 1e6 : 0.0);
+    return invalid ? 1 : 0;
+}
+
+//Builds a random tree with the given number of operands, split evenly
+Node* randomTree(long long operands) {
+    static const char* names[] = {"a", "b1", "x", "X99", "42", "count", "y7", "z"};
+    static const char* ops[] = {"+", "-", "*", "/"};
+    if (operands <= 1) return createNode(names[rand() % 8]);
+    Node* node = createNode(ops[rand() % 4]);
+    node->left = randomTree(operands / 2);
+    node->right = randomTree(operands - operands / 2);
+    return node;
+}
+
+//Times printf traversals against sized single-buffer rendering for
+//10^3 .. maxTokens tokens. Expressions go to stdout, timings to stderr.
+int benchRender(long long maxTokens) {
+    srand(1);
+    fprintf(stderr, "%10s %-8s %12s %12s %8s\n", "tokens", "type", "printf ms", "buffer ms", "speedup");
+    for (long long tokens = 1000; tokens <= maxTokens; tokens *= 10) {
+        Node* root = randomTree((tokens + 1) / 2);
+        for (int notation = NOTATION_PREFIX; notation <= NOTATION_POSTFIX; notation++) {
+            static const char* names[] = {"prefix", "infix", "postfix"};
+            double start = nowSeconds();
+            printTraversal(root, notation);
+            fflush(stdout);
+            double traversal = nowSeconds() - start;
+
+            start = nowSeconds();
+            printExpression(root, names[notation]);
+            double buffered = nowSeconds() - start;
+            fprintf(stderr, "%10lld %-8s %12.3f %12.3f %7.2fx\n", tokens, names[notation],
+                    traversal * 1e3, buffered * 1e3, traversal / buffered);
+        }
+        freeTree(root);
+    }
+    return 0;
+}
+
+// ----------- HARDWARE Counters -----------
+
+//--perf converts one expression with the sequential path, phase by phase
+//(tokenize, validate, build, emit, free), and reads the CPU counters
+//around each phase through perf_event_open: cycles, instructions, L1 data
+//and last-level cache misses, and branch misses, in total and per token.
+//A counter the kernel or the CPU does not offer is shown as "-"; with
+//none at all (no PMU, perf_event_paranoid, not Linux) only time is shown.
+//Infix is parsed straight from the text, so it has no tokenize or validate
+//phase: parseExpression is timed whole as its build, shown as "parse".
+
+enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_BRANCH_MISSES, PERF_COUNTERS };
+static const char* perfCounterName[PERF_COUNTERS] = {"cycles", "instr", "L1d miss", "LLC miss", "br miss"};
+
+enum { PHASE_TOKENIZE, PHASE_VALIDATE, PHASE_BUILD, PHASE_EMIT, PHASE_FREE, PHASES };
+static const char* phaseName[PHASES] = {"tokenize", "validate", "build", "emit", "free"};
+
+typedef struct {
+    int fd[PERF_COUNTERS];                  //-1 where the counter is unavailable
+    int available;
+    int openError;                          //errno of the first counter that failed
+    double value[PHASES][PERF_COUNTERS];    //Summed over the runs
+    double seconds[PHASES];
+    double start;
+} PerfCounters;
+
+static void openPerfCounters(PerfCounters* pc) {
+    memset(pc, 0, sizeof(*pc));
+    for (int i = 0; i < PERF_COUNTERS; i++) pc->fd[i] = -1;
+#ifdef HAVE_PERF_EVENTS
+    static const struct {
+        unsigned type;
+        unsigned long long config;
+    } events[PERF_COUNTERS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1; //Allowed at perf_event_paranoid 2
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        pc->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (pc->fd[i] >= 0) pc->available++;
+        else if (!pc->openError) pc->openError = errno;
+    }
+#endif
+}
+
+static void closePerfCounters(PerfCounters* pc) {
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (pc->fd[i] >= 0) close(pc->fd[i]);
+    }
+}
+
+static void perfBegin(PerfCounters* pc) {
+#ifdef HAVE_PERF_EVENTS
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (pc->fd[i] < 0) continue;
+        ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    pc->start = nowSeconds();
+}
+
+static void perfEnd(PerfCounters* pc, int phase) {
+    pc->seconds[phase] += nowSeconds() - pc->start;
+#ifdef HAVE_PERF_EVENTS
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (pc->fd[i] >= 0) ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        unsigned long long data[3]; //Value, time enabled, time running
+        if (pc->fd[i] < 0 || read(pc->fd[i], data, sizeof(data)) != (ssize_t)sizeof(data)) continue;
+        //Scale up when the counter shared the PMU with others
+        if (data[2] > 0) pc->value[phase][i] += (double)data[0] * ((double)data[1] / (double)data[2]);
+    }
+#endif
+}
+
+//Times the emit phase (into memory; writing gigabytes to a terminal is not
+//the point) and the free phase of one run
+static void perfEmitAndFree(PerfCounters* pc, Node* root, int notation, Token* tokens, int tokenCount) {
+    perfBegin(pc);
+    size_t size = renderedSize(root, notation);
+    char* out = (char*)malloc(size + 1);
+    if (!out) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    renderTree(root, notation, out);
+    perfEnd(pc, PHASE_EMIT);
+
+    perfBegin(pc);
+    free(out);
+    freeTree(root);
+    freeTokens(tokens, tokenCount);
+    perfEnd(pc, PHASE_FREE);
+}
+
+//Runs the sequential conversion of the expression in path runs times and
+//prints the mean counters of each phase
+int convertWithCounters(const char* path, const char* inputType, const char* outputType, int runs) {
+    int notation = notationOf(outputType);
+    if (notation < 0) {
+        printOutputTypeError();
+        return 1;
+    }
+    int kind = notationOf(inputType);
+    if (kind < 0) {
+        printf("\nError: Unknown input type\n");
+        return 1;
+    }
+    size_t length;
+    char* buf = loadExpression(path, &length);
+    if (!buf) return 1;
+    if (runs < 1) runs = 1;
+    char* text = (char*)malloc(length + 1);
+    int maxTokens = (int)(length / 2 + 1);
+    Token* tokens = (Token*)malloc(sizeof(Token) * (size_t)maxTokens);
+    if (!text || !tokens) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+
+    PerfCounters pc;
+    openPerfCounters(&pc);
+    int tokenCount = 0;
+    int status = 0;
+    for (int run = 0; run < runs && status == 0; run++) {
+        memcpy(text, buf, length + 1);
+        if (kind == NOTATION_INFIX) {
+            perfBegin(&pc);
+            int unused;
+            Node* root = parseExpression(text, "infix", tokens, maxTokens, &unused);
+            perfEnd(&pc, PHASE_BUILD);
+            if (!root) {
+                status = 1;
+                break;
+            }
+            //Per token means per node, as for a prefix or postfix input
+            size_t tokenBytes = 0, operators = 0;
+            measureAll(root, &tokenBytes, &operators);
+            tokenCount = (int)(2 * operators + 1);
+            perfEmitAndFree(&pc, root, notation, NULL, 0);
+            continue;
+        }
+        perfBegin(&pc);
+        tokenCount = tokenize(text, tokens, maxTokens);
+        perfEnd(&pc, PHASE_TOKENIZE);
+        if (tokenCount < 0) {
+            status = 1;
+            break;
+        }
+
+        perfBegin(&pc);
+        bool valid = kind == NOTATION_PREFIX ? validatePrefix(tokens, tokenCount)
+                                             : validatePostfix(tokens, tokenCount);
+        perfEnd(&pc, PHASE_VALIDATE);
+        if (!valid) {
+            printFormatError(inputType);
+            freeTokens(tokens, tokenCount);
+            status = 1;
+            break;
+        }
+
+        perfBegin(&pc);
+        Node* root;
+        if (kind == NOTATION_PREFIX) {
+            int index = 0;
+            root = buildTreeFromPrefix(tokens, &index, tokenCount);
+        } else {
+            root = buildTreeFromPostfix(tokens, tokenCount);
+        }
+        perfEnd(&pc, PHASE_BUILD);
+        if (!root) {
+            freeTokens(tokens, tokenCount);
+            status = 1;
+            break;
+        }
+        perfEmitAndFree(&pc, root, notation, tokens, tokenCount);
+    }
+    closePerfCounters(&pc);
+    free(tokens);
+    free(text);
+    free(buf);
+    if (status) return status;
+
+    printf("%d tokens, mean of %d runs", tokenCount, runs);
+    if (pc.available == 0) {
+        const char* why = pc.openError == ENOENT || pc.openError == EOPNOTSUPP ? "no PMU, e.g. in a VM"
+                          : pc.openError == EACCES || pc.openError == EPERM ? "see perf_event_paranoid"
+                          : pc.openError ? strerror(pc.openError) : "not built for Linux";
+        printf("; hardware counters unavailable (%s), times only", why);
+    }
+    printf("\n%-9s %10s", "phase", "ms");
+    for (int i = 0; i < PERF_COUNTERS; i++) {
+        if (pc.available) printf(" %12s", perfCounterName[i]);
+    }
+    if (pc.available) printf(" %6s", "IPC");
+    printf("\n");
+    for (int phase = 0; phase < PHASES; phase++) {
+        if (kind == NOTATION_INFIX && phase < PHASE_BUILD) {
+            printf("%-9s %10s\n", phaseName[phase], "n/a");
+            continue;
+        }
+        //Total per run, then the same per token
+        for (int perToken = 0; perToken < 2; perToken++) {
+            double scale = perToken ? 1.0 / runs / tokenCount : 1.0 / runs;
+            const char* name = kind == NOTATION_INFIX && phase == PHASE_BUILD ? "parse" : phaseName[phase];
+            printf("%-9s %10.3f", perToken ? "  /token" : name,
+                   pc.seconds[phase] * scale * (perToken ? 1e9 : 1e3));
+            for (int i = 0; i < PERF_COUNTERS && pc.available; i++) {
+                if (pc.fd[i] < 0) printf(" %12s", "-");
+                else printf(perToken ? " %12.2f" : " %12.0f", pc.value[phase][i] * scale);
+            }
+            if (pc.available) {
+                double cycles = pc.value[phase][PERF_CYCLES];
+                if (pc.fd[PERF_CYCLES] >= 0 && pc.fd[PERF_INSTRUCTIONS] >= 0 && cycles > 0) {
+                    printf(" %6.2f", pc.value[phase][PERF_INSTRUCTIONS] / cycles);
+                } else {
+                    printf(" %6s", "-");
+                }
+            }
+            printf("\n");
+        }
+    }
+    printf("(per-token time in ns)\n");
+    return 0;
+}
+
+// ----------- COMPRESSED Streams -----------
+
+//Streaming gzip and zstd for the line-based modes. Input is decompressed
+//by the reader stage, on its own thread, so it overlaps parsing; output
+//is compressed by the writer stage. Each side holds one CODEC_CHUNK of
+//compressed data at a time. The codecs are compiled in with
+//-DCONVERT_WITH_ZLIB -lz and -DCONVERT_WITH_ZSTD -lzstd.
+
+#define CODEC_CHUNK (128 * 1024)
+
+enum { CODEC_NONE, CODEC_GZIP, CODEC_ZSTD };
+static const char* codecName[] = {"plain", "gzip", "zstd"};
+
+//Input that is read like fread: a short count means the end
+typedef struct {
+    FILE* file;
+    int codec;
+    unsigned char* buf;          //Compressed bytes not yet consumed
+    size_t bufLen, bufPos;
+    bool fileEnd, done, failed;
+#ifdef CONVERT_WITH_ZLIB
+    z_stream z;
+#endif
+#ifdef CONVERT_WITH_ZSTD
+    ZSTD_DStream* zd;
+    size_t zstdHint;             //Nonzero while a frame is incomplete
+#endif
+} StreamSource;
+
+//Output that compresses whatever is written to it
+typedef struct {
+    FILE* file;
+    int codec;
+    unsigned char* buf;
+    bool failed;
+#ifdef CONVERT_WITH_ZLIB
+    z_stream z;
+#endif
+#ifdef CONVERT_WITH_ZSTD
+    ZSTD_CStream* zc;
+#endif
+} StreamSink;
+
+//Looks up a codec by name; -1 if unknown or not compiled in
+int codecOf(const char* name) {
+    if (strcmp(name, "gzip") == 0) {
+#ifdef CONVERT_WITH_ZLIB
+        return CODEC_GZIP;
+#endif
+    } else if (strcmp(name, "zstd") == 0) {
+#ifdef CONVERT_WITH_ZSTD
+        return CODEC_ZSTD;
+#endif
+    }
+    return -1;
+}
+
+static void refillSource(StreamSource* src) {
+    src->bufLen = fread(src->buf, 1, CODEC_CHUNK, src->file);
+    src->bufPos = 0;
+    if (src->bufLen < CODEC_CHUNK) src->fileEnd = true;
+}
+
+//Opens a source and detects gzip or zstd from the first bytes.
+//Returns false (after printing why) if the codec is not compiled in.
+bool openSource(StreamSource* src, FILE* file) {
+    memset(src, 0, sizeof(*src));
+    src->file = file;
+    src->buf = (unsigned char*)malloc(CODEC_CHUNK);
+    if (!src->buf) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    refillSource(src);
+    const unsigned char* b = src->buf;
+    if (src->bufLen >= 2 && b[0] == 0x1f && b[1] == 0x8b) src->codec = CODEC_GZIP;
+    if (src->bufLen >= 4 && b[0] == 0x28 && b[1] == 0xb5 && b[2] == 0x2f && b[3] == 0xfd) src->codec = CODEC_ZSTD;
+
+    if (src->codec == CODEC_GZIP) {
+#ifdef CONVERT_WITH_ZLIB
+        if (inflateInit2(&src->z, 15 + 16) == Z_OK) return true;
+#else
+        printf("Error: Input is gzip-compressed; build with -DCONVERT_WITH_ZLIB -lz\n");
+        free(src->buf);
+        return false;
+#endif
+    } else if (src->codec == CODEC_ZSTD) {
+#ifdef CONVERT_WITH_ZSTD
+        src->zd = ZSTD_createDStream();
+        if (src->zd && !ZSTD_isError(ZSTD_initDStream(src->zd))) return true;
+#else
+        printf("Error: Input is zstd-compressed; build with -DCONVERT_WITH_ZSTD -lzstd\n");
+        free(src->buf);
+        return false;
+#endif
+    } else {
+        return true;
+    }
+    printf("Error: Memory allocation failed\n");
+    exit(1);
+}
+
+//Reads up to want decompressed bytes; fewer only at the end of the input
+//or on corrupt data (failed is then set)
+size_t readSource(StreamSource* src, char* dst, size_t want) {
+    size_t produced = 0;
+    if (src->codec == CODEC_NONE) {
+        size_t n = src->bufLen - src->bufPos < want ? src->bufLen - src->bufPos : want;
+        memcpy(dst, src->buf + src->bufPos, n);
+        src->bufPos += n;
+        produced = n;
+        if (produced < want && !src->fileEnd) produced += fread(dst + produced, 1, want - produced, src->file);
+        return produced;
+    }
+    while (produced < want && !src->done) {
+        if (src->bufPos == src->bufLen && !src->fileEnd) refillSource(src);
+#ifdef CONVERT_WITH_ZLIB
+        if (src->codec == CODEC_GZIP) {
+            bool inputLeft = src->bufPos < src->bufLen;
+            src->z.next_in = src->buf + src->bufPos;
+            src->z.avail_in = (uInt)(src->bufLen - src->bufPos);
+            src->z.next_out = (Bytef*)dst + produced;
+            src->z.avail_out = (uInt)(want - produced);
+            int ret = inflate(&src->z, Z_NO_FLUSH);
+            src->bufPos = src->bufLen - src->z.avail_in;
+            produced = want - src->z.avail_out;
+            if (ret == Z_STREAM_END) {
+                //Concatenated gzip members continue the same text, as with zcat
+                if (src->bufPos == src->bufLen && !src->fileEnd) refillSource(src);
+                if (src->bufPos < src->bufLen) inflateReset(&src->z);
+                else src->done = true;
+            } else if (ret != Z_OK && !(ret == Z_BUF_ERROR && inputLeft)) {
+                src->failed = src->done = true; //Corrupt, or truncated (no input left)
+            }
+        }
+#endif
+#ifdef CONVERT_WITH_ZSTD
+        if (src->codec == CODEC_ZSTD) {
+            ZSTD_inBuffer in = {src->buf, src->bufLen, src->bufPos};
+            ZSTD_outBuffer out = {dst, want, produced};
+            size_t hint = ZSTD_decompressStream(src->zd, &out, &in);
+            src->bufPos = in.pos;
+            produced = out.pos;
+            if (ZSTD_isError(hint)) {
+                src->failed = src->done = true;
+            } else {
+                src->zstdHint = hint;
+                //Input used up and nothing more to flush: the end
+                if (src->bufPos == src->bufLen && src->fileEnd && out.pos < out.size) {
+                    src->done = true;
+                    src->failed = hint != 0; //A frame was cut short
+                }
+            }
+        }
+#endif
+    }
+    return produced;
+}
+
+void closeSource(StreamSource* src) {
+#ifdef CONVERT_WITH_ZLIB
+    if (src->codec == CODEC_GZIP) inflateEnd(&src->z);
+#endif
+#ifdef CONVERT_WITH_ZSTD
+    if (src->codec == CODEC_ZSTD) ZSTD_freeDStream(src->zd);
+#endif
+    free(src->buf);
+}
+
+//Opens a sink writing to file with the given codec
+void openSink(StreamSink* sink, FILE* file, int codec) {
+    memset(sink, 0, sizeof(*sink));
+    sink->file = file;
+    sink->codec = codec;
+    if (codec == CODEC_NONE) return;
+    sink->buf = (unsigned char*)malloc(CODEC_CHUNK);
+    bool ready = sink->buf != NULL;
+#ifdef CONVERT_WITH_ZLIB
+    if (codec == CODEC_GZIP) {
+        ready = ready && deflateInit2(&sink->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                                      Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+#endif
+#ifdef CONVERT_WITH_ZSTD
+    if (codec == CODEC_ZSTD) {
+        sink->zc = ZSTD_createCStream();
+        ready = ready && sink->zc && !ZSTD_isError(ZSTD_initCStream(sink->zc, 3));
+    }
+#endif
+    if (!ready) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+}
+
+//Compresses (or copies) data into the sink; finish flushes the codec.
+//Only whole CODEC_CHUNK blocks are written until then.
+static void sinkCompress(StreamSink* sink, const char* data, size_t length, bool finish) {
+#ifdef CONVERT_WITH_ZLIB
+    if (sink->codec == CODEC_GZIP) {
+        sink->z.next_in = (Bytef*)data;
+        sink->z.avail_in = (uInt)length;
+        int ret;
+        do {
+            sink->z.next_out = sink->buf;
+            sink->z.avail_out = CODEC_CHUNK;
+            ret = deflate(&sink->z, finish ? Z_FINISH : Z_NO_FLUSH);
+            size_t have = CODEC_CHUNK - sink->z.avail_out;
+            if (have && fwrite(sink->buf, 1, have, sink->file) != have) sink->failed = true;
+        } while (sink->z.avail_out == 0 || (finish && ret != Z_STREAM_END));
+    }
+#endif
+#ifdef CONVERT_WITH_ZSTD
+    if (sink->codec == CODEC_ZSTD) {
+        ZSTD_inBuffer in = {data, length, 0};
+        size_t remaining;
+        do {
+            ZSTD_outBuffer out = {sink->buf, CODEC_CHUNK, 0};
+            remaining = ZSTD_compressStream2(sink->zc, &out, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) {
+                sink->failed = true;
+                break;
+            }
+            if (out.pos && fwrite(sink->buf, 1, out.pos, sink->file) != out.pos) sink->failed = true;
+        } while (in.pos < in.size || (finish && remaining != 0));
+    }
+#endif
+    (void)sink;
+    (void)data;
+    (void)length;
+    (void)finish;
+}
+
+void writeSink(StreamSink* sink, const char* data, size_t length) {
+    if (sink->codec == CODEC_NONE) {
+        if (fwrite(data, 1, length, sink->file) != length) sink->failed = true;
+    } else {
+        sinkCompress(sink, data, length, false);
+    }
+}
+
+//Finishes the compressed stream and flushes the file; false on any error
+bool closeSink(StreamSink* sink) {
+    if (sink->codec != CODEC_NONE) sinkCompress(sink, NULL, 0, true);
+#ifdef CONVERT_WITH_ZLIB
+    if (sink->codec == CODEC_GZIP) deflateEnd(&sink->z);
+#endif
+#ifdef CONVERT_WITH_ZSTD
+    if (sink->codec == CODEC_ZSTD) ZSTD_freeCStream(sink->zc);
+#endif
+    free(sink->buf);
+    if (fflush(sink->file) != 0) sink->failed = true;
+    return !sink->failed;
+}
+
+// ----------- CONVERSION Cache -----------
+
+//Persistent results shared across runs and processes: --cache <file>
+//before a mode makes --stream, --schedule and --bulk-dir look each line
+//up before parsing it, and add what they convert. Layout of the file:
+//  header (4096 bytes): magic, size cap, slot count, log start and end,
+//                       entries, writer sessions
+//  slots:  open addressing on a 128-bit key of (line, input type,
+//          output type); a slot holds the key, the log offset of its
+//          record (0 while empty) and the session that last used it
+//  log:    records {key, length, output text} appended back to back
+//Every process maps the whole size cap at once, so the mapping never
+//moves while the file grows. One process at a time is the writer (an
+//flock on the file); it writes a record, then the log end, and publishes
+//the slot's offset last, so readers in any process need no lock. Records
+//never change once written. When the cap or the slots run out, adding
+//stops, and the writer compacts the file at exit: the most recently used
+//entries are copied into a new file that is renamed over the old one.
+
+#define CACHE_MAGIC "CVCACHE2"  //CVCACHE1 keyed lines by their tokens
+#define CACHE_HEADER_SIZE 4096
+#define CACHE_DEFAULT_BYTES (256ULL << 20)  //Size cap of a new cache file
+#define CACHE_MIN_SLOTS 4096
+#define CACHE_NEW_SLOTS (1ULL << 20)        //Slots of a new cache file (32 MiB, sparse)
+#define CACHE_GROW (1ULL << 20)             //The file grows this much at a time
+
+typedef struct {
+    char magic[8];
+    unsigned long long capacity;            //Largest file size, and the mapped length
+    unsigned long long slotCount;           //A power of two
+    unsigned long long logStart;
+    atomic_ullong logEnd;                   //End of the records written so far
+    atomic_ullong entries;
+    unsigned long long generation;          //Writer sessions so far
+} CacheHeader;
+
+typedef struct {
+    atomic_ullong record;                   //Log offset of the record; 0 while empty, stored last
+    unsigned long long keyHi, keyLo;
+    atomic_ullong lastUsed;                 //Writer session that last added or read it
+} CacheSlot;
+
+typedef struct {
+    unsigned long long keyHi, keyLo;
+    unsigned long long length;              //Output bytes that follow, without the newline
+} CacheRecord;
+
+typedef struct {
+    int fd;
+    char* base;                             //The capacity bytes of the file
+    CacheHeader* header;
+    CacheSlot* slots;
+    unsigned long long capacity, mask, fileSize;
+    bool writer, full;
+    bool readOnly;                          //No write permission (else another process writes)
+    unsigned long long generation;
+    pthread_mutex_t lock;                   //Adds from this process, one at a time
+    atomic_ullong lookups, hits, added;
+    char* path;
+} ConversionCache;
+
+static ConversionCache* conversionCache;   //NULL without --cache
+
+//Key of a line: its bytes as the parser gets them, the conversion pair
+//and whether chains are balanced. Spaces count as well, since the infix
+//start/end check reads the first and last byte and the stack builder is
+//only rerun on lines shorter than LEGACY_INFIX_BYTES. Only lines that
+//convert are stored, and their result depends on nothing else.
+Fingerprint cacheKey(const char* text, size_t len, int inputNotation, int outputNotation, bool balanced) {
+    unsigned long long hi = 0xcbf29ce484222325ULL, lo = 0x84222325cbf29ce4ULL;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)text[i];
+        hi = (hi ^ c) * 0x100000001b3ULL;
+        lo = (lo ^ c) * 0x100000001b3ULL;
+    }
+    unsigned long long pair = (unsigned long long)(inputNotation * 3 + outputNotation + 1 + (balanced ? 9 : 0));
+    Fingerprint key = {mix64(hi ^ pair), mix64(lo + pair * 0xc2b2ae3d27d4eb4fULL)};
+    return key;
+}
+
+#ifndef _WIN32
+static unsigned long long cacheRecordSize(unsigned long long length) {
+    return (sizeof(CacheRecord) + length + 7) & ~7ULL;
+}
+
+//Writes a cache file holding the given records (or none) to a temporary
+//name and moves it to path, so no process ever sees it half written.
+//With replace (compaction by the writer) it is renamed over path.
+//Otherwise it is hard-linked, which fails if path exists: of several
+//processes creating the cache at once, only the first file is kept and
+//the others are dropped. True if path now holds a cache file.
+static bool writeCacheFile(const char* path, unsigned long long capacity, unsigned long long slotCount,
+                           const char* source, const unsigned long long* records, const unsigned long long* lastUsed,
+                           size_t count, unsigned long long generation, bool replace) {
+    unsigned long long logStart = CACHE_HEADER_SIZE + slotCount * sizeof(CacheSlot), logEnd = logStart;
+    for (size_t i = 0; i < count; i++) {
+        logEnd += cacheRecordSize(((const CacheRecord*)(source + records[i]))->length);
+    }
+    size_t pathLen = strlen(path);
+    char* temp = (char*)malloc(pathLen + 32);
+    if (!temp) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    snprintf(temp, pathLen + 32, "%s.tmp.%ld", path, (long)getpid());
+    int fd = open(temp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    char* map = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, (off_t)logEnd) == 0) {
+        map = (char*)mmap(NULL, (size_t)logEnd, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        if (fd >= 0) close(fd);
+        unlink(temp);
+        free(temp);
+        return false;
+    }
+
+    CacheHeader* header = (CacheHeader*)map;
+    memcpy(header->magic, CACHE_MAGIC, 8);
+    header->capacity = capacity;
+    header->slotCount = slotCount;
+    header->logStart = logStart;
+    header->generation = generation;
+    CacheSlot* slots = (CacheSlot*)(map + CACHE_HEADER_SIZE);
+    unsigned long long end = logStart;
+    for (size_t i = 0; i < count; i++) {
+        const CacheRecord* r = (const CacheRecord*)(source + records[i]);
+        unsigned long long size = cacheRecordSize(r->length);
+        memcpy(map + end, r, sizeof(CacheRecord) + r->length);
+        size_t s = r->keyHi & (slotCount - 1);
+        while (atomic_load_explicit(&slots[s].record, memory_order_relaxed)) s = (s + 1) & (slotCount - 1);
+        slots[s].keyHi = r->keyHi;
+        slots[s].keyLo = r->keyLo;
+        atomic_store_explicit(&slots[s].lastUsed, lastUsed[i], memory_order_relaxed);
+        atomic_store_explicit(&slots[s].record, end, memory_order_relaxed);
+        end += size;
+    }
+    atomic_store(&header->logEnd, end);
+    atomic_store(&header->entries, (unsigned long long)count);
+
+    bool ok = msync(map, (size_t)logEnd, MS_SYNC) == 0;
+    munmap(map, (size_t)logEnd);
+    ok = fsync(fd) == 0 && ok;
+    close(fd);
+    if (ok && !replace) {
+        //Filesystems without hard links fall back to the rename
+        if (link(temp, path) == 0 || errno == EEXIST) {
+            unlink(temp);
+            free(temp);
+            return true;
+        }
+        if (errno != EPERM && errno != ENOTSUP && errno != EOPNOTSUPP) ok = false;
+    }
+    ok = ok && rename(temp, path) == 0;
+    if (!ok) unlink(temp);
+    free(temp);
+    return ok;
+}
+
+static unsigned long long nextPowerOfTwo(unsigned long long n) {
+    unsigned long long p = 1;
+    while (p < n) p *= 2;
+    return p;
+}
+
+typedef struct {
+    unsigned long long record, lastUsed;
+} CacheEntry;
+
+static int compareCacheEntries(const void* a, const void* b) {
+    const CacheEntry* x = (const CacheEntry*)a;
+    const CacheEntry* y = (const CacheEntry*)b;
+    if (x->lastUsed != y->lastUsed) return x->lastUsed > y->lastUsed ? -1 : 1;
+    return (x->record < y->record) - (x->record > y->record); //Newer first
+}
+
+//Rewrites the cache (the caller is its writer) with the most recently
+//used entries that fit in three quarters of the size cap, which is
+//changed to capacity when that is not 0. Reports what it kept on stderr.
+static bool compactCache(ConversionCache* c, unsigned long long capacity) {
+    if (capacity == 0) capacity = c->capacity;
+    unsigned long long count = 0;
+    CacheEntry* entries = (CacheEntry*)malloc(sizeof(CacheEntry) * (c->header->slotCount + 1));
+    if (!entries) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    unsigned long long logEnd = atomic_load(&c->header->logEnd);
+    for (unsigned long long s = 0; s < c->header->slotCount; s++) {
+        unsigned long long record = atomic_load_explicit(&c->slots[s].record, memory_order_acquire);
+        if (!record || record + sizeof(CacheRecord) > logEnd) continue;
+        const CacheRecord* r = (const CacheRecord*)(c->base + record);
+        if (record + cacheRecordSize(r->length) > logEnd) continue; //Damaged; drop it
+        entries[count].record = record;
+        entries[count++].lastUsed = atomic_load_explicit(&c->slots[s].lastUsed, memory_order_relaxed);
+    }
+    qsort(entries, (size_t)count, sizeof(CacheEntry), compareCacheEntries);
+
+    //Slots for twice the entries kept, so the next runs can add as many again
+    unsigned long long slotCount = nextPowerOfTwo(count * 2 > CACHE_MIN_SLOTS ? count * 2 : CACHE_MIN_SLOTS);
+    while (slotCount > CACHE_MIN_SLOTS && CACHE_HEADER_SIZE + slotCount * sizeof(CacheSlot) > capacity / 4) slotCount /= 2;
+    unsigned long long budget = (capacity - CACHE_HEADER_SIZE - slotCount * sizeof(CacheSlot)) / 4 * 3;
+    unsigned long long used = 0, kept = 0;
+    unsigned long long* records = (unsigned long long*)malloc(sizeof(unsigned long long) * (count + 1));
+    unsigned long long* lastUsed = (unsigned long long*)malloc(sizeof(unsigned long long) * (count + 1));
+    if (!records || !lastUsed) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    for (unsigned long long i = 0; i < count && kept < slotCount / 2; i++) {
+        unsigned long long size = cacheRecordSize(((const CacheRecord*)(c->base + entries[i].record))->length);
+        if (used + size > budget) continue;
+        used += size;
+        records[kept] = entries[i].record;
+        lastUsed[kept++] = entries[i].lastUsed;
+    }
+    bool ok = capacity > CACHE_HEADER_SIZE + slotCount * sizeof(CacheSlot) &&
+              writeCacheFile(c->path, capacity, slotCount, c->base, records, lastUsed, (size_t)kept, c->generation,
+                             true);
+    if (ok) {
+        fprintf(stderr, "cache compacted: kept %llu of %llu entries, %.1f of %.1f MiB\n", kept, count,
+                (CACHE_HEADER_SIZE + slotCount * sizeof(CacheSlot) + used) / 1048576.0, capacity / 1048576.0);
+    } else {
+        fprintf(stderr, "Error: Cannot compact cache file '%s'\n", c->path);
+    }
+    free(entries);
+    free(records);
+    free(lastUsed);
+    return ok;
+}
+
+//Opens (creating if needed) and maps a cache file. The process becomes
+//its writer unless another process is; then it only reads.
+static ConversionCache* mapCache(const char* path, bool quiet) {
+    for (int attempt = 0; attempt < 8; attempt++) {
+        int fd = open(path, O_RDWR);
+        bool readOnly = false;
+        if (fd < 0 && errno == ENOENT) {
+            if (!writeCacheFile(path, CACHE_DEFAULT_BYTES, CACHE_NEW_SLOTS, NULL, NULL, NULL, 0, 0, false)) break;
+            continue;
+        }
+        if (fd < 0) {
+            fd = open(path, O_RDONLY);
+            readOnly = true;
+        }
+        if (fd < 0) break;
+        bool writer = !readOnly && flock(fd, LOCK_EX | LOCK_NB) == 0;
+
+        //A writer that compacted may have renamed a new file over this one
+        struct stat opened, current;
+        if (writer && (fstat(fd, &opened) != 0 || stat(path, &current) != 0 || opened.st_ino != current.st_ino)) {
+            close(fd);
+            continue;
+        }
+        CacheHeader header;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            memcmp(header.magic, CACHE_MAGIC, 8) != 0 || header.slotCount == 0 ||
+            (header.slotCount & (header.slotCount - 1)) != 0 ||
+            header.logStart != CACHE_HEADER_SIZE + header.slotCount * sizeof(CacheSlot) ||
+            (unsigned long long)st.st_size < header.logStart || header.capacity < (unsigned long long)st.st_size) {
+            if (!quiet) printf("Error: '%s' is not a cache file\n", path);
+            close(fd);
+            return NULL;
+        }
+        char* base = (char*)mmap(NULL, (size_t)header.capacity, PROT_READ | (writer ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            close(fd);
+            break;
+        }
+
+        ConversionCache* c = (ConversionCache*)calloc(1, sizeof(ConversionCache));
+        c->path = strdup(path);
+        if (!c || !c->path) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        c->fd = fd;
+        c->base = base;
+        c->header = (CacheHeader*)base;
+        c->slots = (CacheSlot*)(base + CACHE_HEADER_SIZE);
+        c->capacity = header.capacity;
+        c->mask = header.slotCount - 1;
+        c->fileSize = (unsigned long long)st.st_size;
+        c->writer = writer;
+        c->readOnly = readOnly;
+        c->generation = header.generation + (writer ? 1 : 0);
+        if (writer) c->header->generation = c->generation;
+        pthread_mutex_init(&c->lock, NULL);
+        return c;
+    }
+    if (!quiet) printf("Error: Cannot open cache file '%s'\n", path);
+    return NULL;
+}
+
+static void unmapCache(ConversionCache* c) {
+    munmap(c->base, (size_t)c->capacity);
+    close(c->fd); //Also drops the writer lock
+    pthread_mutex_destroy(&c->lock);
+    free(c->path);
+    free(c);
+}
+
+//Reports the hit rate, and compacts a cache that filled up during the run
+static void closeCache(void) {
+    ConversionCache* c = conversionCache;
+    if (!c) return;
+    conversionCache = NULL;
+    unsigned long long lookups = atomic_load(&c->lookups), hits = atomic_load(&c->hits);
+    fprintf(stderr, "cache: %llu lookups, %llu hits (%.1f%%), %llu added, %llu entries, %.1f of %.1f MiB%s\n",
+            lookups, hits, lookups ? 100.0 * hits / lookups : 0.0, atomic_load(&c->added),
+            atomic_load(&c->header->entries), atomic_load(&c->header->logEnd) / 1048576.0, c->capacity / 1048576.0,
+            c->writer ? (c->full ? ", full" : "") : c->readOnly ? ", read-only" : ", read-only (another process is writing)");
+    if (c->writer && c->full) compactCache(c, 0);
+    unmapCache(c);
+}
+
+//Turns the cache on for this run; closeCache runs at exit
+bool openCache(const char* path) {
+    conversionCache = mapCache(path, false);
+    if (!conversionCache) return false;
+    atexit(closeCache);
+    return true;
+}
+
+//Compacts a cache file by hand, optionally with a new size cap (MiB)
+int compactCacheFile(const char* path, long long maxMiB) {
+    ConversionCache* c = mapCache(path, false);
+    if (!c) return 1;
+    if (!c->writer) {
+        printf("Error: Cache file '%s' is being written by another process\n", path);
+        unmapCache(c);
+        return 1;
+    }
+    bool ok = compactCache(c, maxMiB > 0 ? (unsigned long long)maxMiB << 20 : 0);
+    unmapCache(c);
+    return ok ? 0 : 1;
+}
+
+//Finds a result; the text stays valid until the cache is closed
+const char* cacheLookup(Fingerprint key, size_t* length) {
+    ConversionCache* c = conversionCache;
+    atomic_fetch_add_explicit(&c->lookups, 1, memory_order_relaxed);
+    for (unsigned long long i = key.hi & c->mask, n = 0; n <= c->mask; i = (i + 1) & c->mask, n++) {
+        CacheSlot* slot = &c->slots[i];
+        unsigned long long record = atomic_load_explicit(&slot->record, memory_order_acquire);
+        if (!record) return NULL;
+        if (slot->keyHi != key.hi || slot->keyLo != key.lo) continue;
+        const CacheRecord* r = (const CacheRecord*)(c->base + record);
+        if (record + sizeof(CacheRecord) > c->capacity || r->length > c->capacity - record - sizeof(CacheRecord) ||
+            r->keyHi != key.hi || r->keyLo != key.lo) {
+            return NULL; //Damaged
+        }
+        if (c->writer) atomic_store_explicit(&slot->lastUsed, c->generation, memory_order_relaxed);
+        atomic_fetch_add_explicit(&c->hits, 1, memory_order_relaxed);
+        *length = (size_t)r->length;
+        return (const char*)(r + 1);
+    }
+    return NULL;
+}
+
+//Stores a converted line's output (without its newline). Does nothing
+//unless this process is the writer and the cache has room.
+void cacheInsert(Fingerprint key, const char* text, size_t length) {
+    ConversionCache* c = conversionCache;
+    if (!c->writer || c->full) return;
+    pthread_mutex_lock(&c->lock);
+    unsigned long long size = cacheRecordSize(length);
+    unsigned long long logEnd = atomic_load_explicit(&c->header->logEnd, memory_order_relaxed);
+    unsigned long long entries = atomic_load_explicit(&c->header->entries, memory_order_relaxed);
+    if (logEnd + size > c->capacity || (entries + 1) * 10 > (c->mask + 1) * 7) {
+        c->full = true;
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    unsigned long long i = key.hi & c->mask;
+    for (; atomic_load_explicit(&c->slots[i].record, memory_order_relaxed); i = (i + 1) & c->mask) {
+        if (c->slots[i].keyHi == key.hi && c->slots[i].keyLo == key.lo) { //Added meanwhile
+            pthread_mutex_unlock(&c->lock);
+            return;
+        }
+    }
+    if (logEnd + size > c->fileSize) {
+        unsigned long long grown = c->fileSize + CACHE_GROW > logEnd + size ? c->fileSize + CACHE_GROW : logEnd + size;
+        if (grown > c->capacity) grown = c->capacity;
+        if (ftruncate(c->fd, (off_t)grown) != 0) { //Disk full: keep what is there
+            c->full = true;
+            pthread_mutex_unlock(&c->lock);
+            return;
+        }
+        c->fileSize = grown;
+    }
+    CacheRecord* r = (CacheRecord*)(c->base + logEnd);
+    r->keyHi = key.hi;
+    r->keyLo = key.lo;
+    r->length = length;
+    memcpy(r + 1, text, length);
+    //The log end moves before the slot is published, so a writer that
+    //dies in between leaves unused bytes and never a slot without a record
+    atomic_store_explicit(&c->header->logEnd, logEnd + size, memory_order_release);
+    CacheSlot* slot = &c->slots[i];
+    slot->keyHi = key.hi;
+    slot->keyLo = key.lo;
+    atomic_store_explicit(&slot->lastUsed, c->generation, memory_order_relaxed);
+    atomic_store_explicit(&slot->record, logEnd, memory_order_release);
+    atomic_store_explicit(&c->header->entries, entries + 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c->added, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&c->lock);
+}
+#else
+bool openCache(const char* path) {
+    printf("Error: --cache needs mmap, which this build does not have ('%s')\n", path);
+    return false;
+}
+
+int compactCacheFile(const char* path, long long maxMiB) {
+    (void)maxMiB;
+    return openCache(path) ? 0 : 1;
+}
+
+const char* cacheLookup(Fingerprint key, size_t* length) {
+    (void)key;
+    (void)length;
+    return NULL;
+}
+
+void cacheInsert(Fingerprint key, const char* text, size_t length) {
+    (void)key;
+    (void)text;
+    (void)length;
+}
+#endif
+
+// ----------- STREAMING Pipeline -----------
+
+//Converts one expression per line with four stages on their own threads:
+//reader (split lines) -> parser (build trees) -> emitter (render) -> writer.
+//Lines travel in batches through lock-free single-producer single-consumer
+//rings. A stage whose output ring is full waits (backpressure), and batches
+//are recycled from the writer back to the reader, so memory stays bounded.
+
+#define STREAM_BATCHES 8                 //Batches in flight
+#define STREAM_RING_SIZE 4               //Slots in each stage ring
+#define STREAM_BATCH_BYTES (256 * 1024)  //Input bytes read into one batch
+#define STREAM_SPINS 64                  //Polls before a waiting stage yields
+
+//A batch of input lines; each stage fills in its part and passes it on
+typedef struct {
+    char* text;                          //Lines, each NUL-terminated
+    size_t textCap;
+    size_t* lineStart;                   //Offset of each line in text
+    Node** roots;                        //Parsed tree per line, NULL on error
+    char (*errors)[ERROR_CAPTURE_SIZE];  //Captured error per line
+    size_t* lineBytes;                   //Input length of each line
+    unsigned long long* parseNs;         //Parse time of each line
+    const char** cached;                 //Output found in the cache, or NULL
+    size_t* cachedLen;
+    Fingerprint* keys;                   //Cache key of each line (with --cache)
+    int lineCount, lineCap;
+    char* out;                           //Rendered lines for the writer
+    size_t outLen, outCap;
+} StreamBatch;
+
+//Ring for one producer and one consumer thread. head and tail only grow,
+//each is stored by one side, and they sit on separate cache lines.
+//The counters are also split by side so no counter is shared.
+typedef struct {
+    StreamBatch* slots[STREAM_BATCHES];
+    size_t capacity;
+    const char* name;
+    _Alignas(64) atomic_size_t tail;     //Next slot to fill (producer)
+    unsigned long long pushes, fullWaits, occupancySum, maxOccupancy;
+    _Alignas(64) atomic_size_t head;     //Next slot to take (consumer)
+    unsigned long long emptyWaits;
+} SpscRing;
+
+//Start offset of every output line, for the indexed output file
+typedef struct {
+    unsigned long long* offsets;
+    size_t count, capacity;
+    unsigned long long written;          //Output bytes so far
+} StreamIndex;
+
+typedef struct {
+    SpscRing freeRing, parseRing, emitRing, writeRing;
+    StreamBatch batches[STREAM_BATCHES];
+    StreamSource source;                 //Input, decompressed if needed
+    StreamSink sink;                     //stdout or the indexed output file
+    StreamIndex* index;                  //NULL unless building an index
+    bool writeFailed;
+    const char* inputType;
+    int inputNotation, notation;
+    bool balance;                        //Balance + and * chains (--balance)
+    long long lines, errors;
+} StreamPipeline;
+
+void initRing(SpscRing* r, const char* name, size_t capacity) {
+    memset(r, 0, sizeof(*r));
+    r->name = name;
+    r->capacity = capacity;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+}
+
+//Busy-polls for a moment, then gives the core to the other stages
+static void ringWait(int* spins) {
+    if (++*spins > STREAM_SPINS) sched_yield();
+}
+
+//Adds a batch (NULL ends the stream), waiting while the ring is full
+void ringPush(SpscRing* r, StreamBatch* batch) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    int spins = 0;
+    while (tail - atomic_load_explicit(&r->head, memory_order_acquire) >= r->capacity) {
+        if (spins == 0) r->fullWaits++;
+        ringWait(&spins);
+    }
+    r->slots[tail % r->capacity] = batch;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+
+    if (!batch) return;
+    size_t occupancy = tail + 1 - atomic_load_explicit(&r->head, memory_order_relaxed);
+    r->pushes++;
+    r->occupancySum += occupancy;
+    if (occupancy > r->maxOccupancy) r->maxOccupancy = occupancy;
+}
+
+//Takes the oldest batch, waiting while the ring is empty
+StreamBatch* ringPop(SpscRing* r) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    int spins = 0;
+    while (atomic_load_explicit(&r->tail, memory_order_acquire) == head) {
+        if (spins == 0) r->emptyWaits++;
+        ringWait(&spins);
+    }
+    StreamBatch* batch = r->slots[head % r->capacity];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return batch;
+}
+
+//realloc that exits like createNode when memory runs out
+static void* streamRealloc(void* ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+//Records text[start..end) as the next line of the batch
+static void addLine(StreamBatch* b, size_t start, size_t end) {
+    if (end > start && b->text[end - 1] == '\r') end--;
+    b->text[end] = '\0';
+    if (b->lineCount == b->lineCap) {
+        b->lineCap = b->lineCap ? b->lineCap * 2 : 1024;
+        b->lineStart = (size_t*)streamRealloc(b->lineStart, b->lineCap * sizeof(size_t));
+        b->roots = (Node**)streamRealloc(b->roots, b->lineCap * sizeof(Node*));
+        b->errors = streamRealloc(b->errors, b->lineCap * sizeof(*b->errors));
+        b->lineBytes = (size_t*)streamRealloc(b->lineBytes, b->lineCap * sizeof(size_t));
+        b->parseNs = (unsigned long long*)streamRealloc(b->parseNs, b->lineCap * sizeof(unsigned long long));
+        b->cached = (const char**)streamRealloc(b->cached, b->lineCap * sizeof(const char*));
+        b->cachedLen = (size_t*)streamRealloc(b->cachedLen, b->lineCap * sizeof(size_t));
+        b->keys = (Fingerprint*)streamRealloc(b->keys, b->lineCap * sizeof(Fingerprint));
+    }
+    b->lineStart[b->lineCount++] = start;
+}
+
+//Reader stage (runs on the calling thread): fills batches with whole lines.
+//A partial line at the end of a read is carried into the next batch.
+static void streamRead(StreamPipeline* p) {
+    char* pending = NULL;
+    size_t pendingLen = 0;
+    StreamBatch* b = NULL;
+    bool eof = false;
+
+    while (!eof) {
+        if (!b) b = ringPop(&p->freeRing);
+        b->lineCount = 0;
+        if (b->textCap < pendingLen + STREAM_BATCH_BYTES + 1) {
+            b->textCap = pendingLen + STREAM_BATCH_BYTES + 1;
+            b->text = (char*)streamRealloc(b->text, b->textCap);
+        }
+        if (pendingLen) memcpy(b->text, pending, pendingLen);
+        size_t used = pendingLen, scanned = pendingLen;
+        pendingLen = 0;
+
+        //Read until the batch holds a complete line or the input ends
+        for (;;) {
+            size_t want = b->textCap - 1 - used;
+            size_t n = readSource(&p->source, b->text + used, want);
+            used += n;
+            eof = n < want; //A short read means end of input (or a read error)
+            if (eof || memchr(b->text + scanned, '\n', used - scanned)) break;
+            scanned = used;
+            b->textCap *= 2;
+            b->text = (char*)streamRealloc(b->text, b->textCap);
+        }
+
+        size_t start = 0;
+        char* nl;
+        while ((nl = (char*)memchr(b->text + start, '\n', used - start))) {
+            addLine(b, start, (size_t)(nl - b->text));
+            start = (size_t)(nl - b->text) + 1;
+        }
+        if (start < used) {
+            if (eof) {
+                //A corrupt or truncated input ends mid-line: that line is not converted
+                if (!p->source.failed) addLine(b, start, used);
+            } else {
+                pendingLen = used - start;
+                pending = (char*)streamRealloc(pending, pendingLen);
+                memcpy(pending, b->text + start, pendingLen);
+            }
+        }
+        if (b->lineCount) {
+            ringPush(&p->parseRing, b);
+            b = NULL;
+        }
+    }
+    free(pending);
+    ringPush(&p->parseRing, NULL);
+}
+
+//Parser stage: builds each line's tree with the sequential builders and
+//keeps the error text of lines that fail. With --cache, a line whose
+//output is already known is not parsed at all.
+static void* streamParse(void* arg) {
+    StreamPipeline* p = (StreamPipeline*)arg;
+    Token* tokens = NULL;
+    size_t tokenCap = 0;
+    StreamBatch* b;
+
+    while ((b = ringPop(&p->parseRing))) {
+        unsigned long long begin = metricsNow(); //Each line's end is the next one's start
+        for (int i = 0; i < b->lineCount; i++) {
+            char* line = b->text + b->lineStart[i];
+            size_t len = strlen(line);
+            b->lineBytes[i] = len;
+            if (len / 2 + 1 > tokenCap) {
+                tokenCap = len / 2 + 1;
+                tokens = (Token*)streamRealloc(tokens, tokenCap * sizeof(Token));
+            }
+            errorCapture = b->errors[i];
+            errorCapture[0] = '\0';
+            b->roots[i] = NULL;
+            b->cached[i] = NULL;
+            if (conversionCache) {
+                b->keys[i] = cacheKey(line, len, p->inputNotation, p->notation, p->balance);
+                b->cached[i] = cacheLookup(b->keys[i], &b->cachedLen[i]);
+            }
+            if (b->cached[i]) {
+                //Converted by an earlier run
+            } else if (strspn(line, " \t") == len) {
+                reportError("Error: No valid tokens found\n");
+            } else {
+                int tokenCount;
+                b->roots[i] = parseExpression(line, p->inputType, tokens, (int)tokenCap, &tokenCount);
+                if (p->balance) b->roots[i] = balanceChains(b->roots[i], NULL);
+                freeTokens(tokens, tokenCount);
+            }
+            unsigned long long end = metricsNow();
+            b->parseNs[i] = end - begin;
+            begin = end;
+        }
+        ringPush(&p->emitRing, b);
+    }
+    errorCapture = NULL;
+    free(tokens);
+    ringPush(&p->emitRing, NULL);
+    return NULL;
+}
+
+//Emitter stage: renders every tree (or its error) as one output line
+static void* streamEmit(void* arg) {
+    StreamPipeline* p = (StreamPipeline*)arg;
+    StreamBatch* b;
+
+    while ((b = ringPop(&p->emitRing))) {
+        b->outLen = 0;
+        unsigned long long begin = metricsNow();
+        for (int i = 0; i < b->lineCount; i++) {
+            Node* root = b->roots[i];
+            const char* cached = b->cached[i];
+            const char* error = b->errors[i][0] ? b->errors[i] : "Error: Invalid expression";
+            size_t size = cached ? b->cachedLen[i] : root ? renderedSize(root, p->notation) : strlen(error);
+            if (b->outLen + size + 1 > b->outCap) {
+                b->outCap = (b->outLen + size + 1) * 2;
+                b->out = (char*)streamRealloc(b->out, b->outCap);
+            }
+            char* end = b->out + b->outLen;
+            if (cached) {
+                memcpy(end, cached, size);
+                end += size;
+            } else if (root) {
+                end = renderTree(root, p->notation, end);
+                if (end > b->out + b->outLen && end[-1] == ' ') end--; //No trailing space
+                freeTree(root);
+                if (conversionCache) cacheInsert(b->keys[i], b->out + b->outLen, (size_t)(end - b->out) - b->outLen);
+            } else {
+                memcpy(end, error, size);
+                end += size;
+                p->errors++;
+            }
+            *end++ = '\n';
+            unsigned long long done = metricsNow();
+            recordConversion(p->inputNotation, p->notation, b->lineBytes[i], (size_t)(end - b->out) - b->outLen,
+                             b->parseNs[i] + done - begin, cached || root ? NULL : error);
+            begin = done;
+            b->outLen = (size_t)(end - b->out);
+        }
+        ringPush(&p->writeRing, b);
+    }
+    ringPush(&p->writeRing, NULL);
+    return NULL;
+}
+
+//Records where each line of a batch's output starts
+static void indexLines(StreamIndex* index, const char* out, size_t length) {
+    size_t pos = 0;
+    while (pos < length) {
+        if (index->count == index->capacity) {
+            index->capacity = index->capacity ? index->capacity * 2 : 1 << 16;
+            index->offsets = (unsigned long long*)streamRealloc(index->offsets,
+                                                                index->capacity * sizeof(unsigned long long));
+        }
+        index->offsets[index->count++] = index->written + pos;
+        const char* nl = (const char*)memchr(out + pos, '\n', length - pos);
+        pos = nl ? (size_t)(nl - out) + 1 : length;
+    }
+    index->written += length;
+}
+
+//Writer stage: writes each batch's output and hands the batch back
+static void* streamWrite(void* arg) {
+    StreamPipeline* p = (StreamPipeline*)arg;
+    StreamBatch* b;
+
+    while ((b = ringPop(&p->writeRing))) {
+        if (p->index) indexLines(p->index, b->out, b->outLen);
+        writeSink(&p->sink, b->out, b->outLen);
+        p->lines += b->lineCount;
+        ringPush(&p->freeRing, b);
+    }
+    if (!closeSink(&p->sink)) p->writeFailed = true;
+    return NULL;
+}
+
+//Prints the occupancy counters of every ring to stderr
+static void printStreamStats(StreamPipeline* p, double elapsed) {
+    SpscRing* rings[] = {&p->parseRing, &p->emitRing, &p->writeRing, &p->freeRing};
+    fprintf(stderr, "%-8s %5s %9s %9s %9s %11s %11s\n", "ring", "slots", "batches",
+            "avg fill", "max fill", "full waits", "empty waits");
+    for (int i = 0; i < 4; i++) {
+        SpscRing* r = rings[i];
+        fprintf(stderr, "%-8s %5zu %9llu %9.2f %9llu %11llu %11llu\n", r->name, r->capacity,
+                r->pushes, r->pushes ? (double)r->occupancySum / r->pushes : 0.0,
+                r->maxOccupancy, r->fullWaits, r->emptyWaits);
+    }
+    fprintf(stderr, "%lld lines, %lld errors, %.3f s, %.0f lines/s\n", p->lines, p->errors,
+            elapsed, elapsed > 0 ? p->lines / elapsed : 0.0);
+}
+
+//Runs the pipeline from path (or stdin with "-") into out, compressed
+//with codec, recording line offsets in index when it is set and
+//balancing + and * chains when balance is set. Compressed
+//input is detected by its magic bytes. Returns -1 if nothing could be run
+//or the input or output failed, otherwise 1 if any line had an error.
+static int runStream(const char* path, const char* inputType, const char* outputType, FILE* out,
+                     int codec, StreamIndex* index, bool balance, bool stats) {
+    if (strcmp(inputType, "infix") != 0 && strcmp(inputType, "prefix") != 0 &&
+        strcmp(inputType, "postfix") != 0) {
+        printf("\nError: Unknown input type\n");
+        return -1;
+    }
+    int notation = notationOf(outputType);
+    if (notation < 0) {
+        printOutputTypeError();
+        return -1;
+    }
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        printf("Error: Cannot open input file '%s'\n", path);
+        return -1;
+    }
+
+    StreamPipeline* p = (StreamPipeline*)calloc(1, sizeof(StreamPipeline));
+    if (!p) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    if (!openSource(&p->source, file)) {
+        if (file != stdin) fclose(file);
+        free(p);
+        return -1;
+    }
+    openSink(&p->sink, out, codec);
+    p->index = index;
+    p->inputType = inputType;
+    p->inputNotation = notationOf(inputType);
+    p->notation = notation;
+    p->balance = balance;
+    initRing(&p->freeRing, "free", STREAM_BATCHES);
+    initRing(&p->parseRing, "parse", STREAM_RING_SIZE);
+    initRing(&p->emitRing, "emit", STREAM_RING_SIZE);
+    initRing(&p->writeRing, "write", STREAM_RING_SIZE);
+    for (int i = 0; i < STREAM_BATCHES; i++) ringPush(&p->freeRing, &p->batches[i]);
+
+    startMetricsDumper();
+    double start = nowSeconds();
+    pthread_t parser, emitter, writer;
+    pthread_create(&parser, NULL, streamParse, p);
+    pthread_create(&emitter, NULL, streamEmit, p);
+    pthread_create(&writer, NULL, streamWrite, p);
+    streamRead(p);
+    pthread_join(parser, NULL);
+    pthread_join(emitter, NULL);
+    pthread_join(writer, NULL);
+    double elapsed = nowSeconds() - start;
+    stopMetricsDumper();
+
+    if (stats) {
+        printStreamStats(p, elapsed);
+        dumpMetrics(stderr);
+        if (p->source.codec != CODEC_NONE || codec != CODEC_NONE) {
+            fprintf(stderr, "input %s, output %s\n", codecName[p->source.codec], codecName[codec]);
+        }
+    }
+    int status = p->errors ? 1 : 0;
+    //On stderr, so a compressed output stays a valid stream
+    if (p->source.failed) {
+        fprintf(stderr, "Error: Compressed input is corrupt or truncated\n");
+        status = -1;
+    }
+    if (p->writeFailed) {
+        fprintf(stderr, "Error: Cannot write the output\n");
+        status = -1;
+    }
+    for (int i = 0; i < STREAM_BATCHES; i++) {
+        StreamBatch* b = &p->batches[i];
+        free(b->text);
+        free(b->lineStart);
+        free(b->roots);
+        free(b->errors);
+        free(b->lineBytes);
+        free(b->parseNs);
+        free(b->cached);
+        free(b->cachedLen);
+        free(b->keys);
+        free(b->out);
+    }
+    closeSource(&p->source);
+    if (file != stdin) fclose(file);
+    free(p);
+    return status;
+}
+
+//Converts a file (or stdin with "-") with one expression per line. Each
+//output line is the converted expression or the error for that line.
+//The output is compressed with codec (CODEC_NONE for plain text), and
+//with balance every + and * chain is balanced as --balance does it.
+int convertStream(const char* path, const char* inputType, const char* outputType, int codec, bool balance,
+                  bool stats) {
+    return runStream(path, inputType, outputType, stdout, codec, NULL, balance, stats) != 0;
+}
+
+// ----------- INDEXED Output -----------
+
+//Batch results in one file that supports random access. Layout:
+//  header (32 bytes): "CONVIDX1", count (8), index offset (8), width (4), 0 (4)
+//  data:   the result lines back to back, as --stream writes them
+//  index:  count + 1 little-endian offsets of width bytes (4, or 8 once
+//          the data passes 4 GiB); result i is data[off[i], off[i+1])
+//Looking up a result reads two offsets, so it is O(1) through mmap.
+
+#define INDEX_MAGIC "CONVIDX1"
+#define INDEX_HEADER_SIZE 32
+
+static void putLittleEndian(unsigned char* out, unsigned long long value, int width) {
+    for (int i = 0; i < width; i++) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+static unsigned long long getLittleEndian(const unsigned char* in, int width) {
+    unsigned long long value = 0;
+    for (int i = 0; i < width; i++) value |= (unsigned long long)in[i] << (8 * i);
+    return value;
+}
+
+//Converts one expression per line like --stream, into an indexed file
+int buildIndexedOutput(const char* path, const char* inputType, const char* outputType, const char* target) {
+    FILE* out = fopen(target, "wb");
+    if (!out) {
+        printf("Error: Cannot create output file '%s'\n", target);
+        return 1;
+    }
+    unsigned char header[INDEX_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    fwrite(header, 1, sizeof(header), out); //Filled in once the counts are known
+
+    StreamIndex index;
+    memset(&index, 0, sizeof(index));
+    int status = runStream(path, inputType, outputType, out, CODEC_NONE, &index, false, false);
+    if (status < 0) {
+        fclose(out);
+        remove(target);
+        free(index.offsets);
+        return 1;
+    }
+
+    int width = index.written <= 0xffffffffULL ? 4 : 8;
+    unsigned char entry[8];
+    for (size_t i = 0; i <= index.count; i++) {
+        putLittleEndian(entry, i < index.count ? index.offsets[i] : index.written, width);
+        fwrite(entry, 1, (size_t)width, out);
+    }
+    memcpy(header, INDEX_MAGIC, 8);
+    putLittleEndian(header + 8, index.count, 8);
+    putLittleEndian(header + 16, INDEX_HEADER_SIZE + index.written, 8);
+    putLittleEndian(header + 24, (unsigned long long)width, 4);
+    bool written = fseeko(out, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), out) == sizeof(header);
+    if (fclose(out) != 0 || !written) {
+        printf("Error: Cannot write output file '%s'\n", target);
+        status = 1;
+    }
+    printf("Indexed %zu results (%d-byte offsets) into %s\n", index.count, width, target);
+    free(index.offsets);
+    return status;
+}
+
+//Prints results first .. first + count - 1 (numbered from 1) of an
+//indexed file, reading only their offsets and bytes
+int lookupIndexed(const char* target, long long first, long long count) {
+    FILE* file = fopen(target, "rb");
+    if (!file) {
+        printf("Error: Cannot open input file '%s'\n", target);
+        return 1;
+    }
+    fseeko(file, 0, SEEK_END);
+    off_t size = ftello(file);
+    const unsigned char* map = NULL;
+#ifndef _WIN32
+    void* mapped = size > 0 ? mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileno(file), 0) : MAP_FAILED;
+    if (mapped != MAP_FAILED) map = (const unsigned char*)mapped;
+#endif
+    unsigned char* copy = NULL;
+    if (!map) {
+        //No mmap: read the file instead
+        copy = (unsigned char*)malloc(size > 0 ? (size_t)size : 1);
+        if (!copy) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        fseeko(file, 0, SEEK_SET);
+        size = (off_t)fread(copy, 1, (size_t)size, file);
+        map = copy;
+    }
+
+    int status = 0;
+    unsigned long long total = 0, indexOffset = 0;
+    int width = 0;
+    if (size >= INDEX_HEADER_SIZE && memcmp(map, INDEX_MAGIC, 8) == 0) {
+        total = getLittleEndian(map + 8, 8);
+        indexOffset = getLittleEndian(map + 16, 8);
+        width = (int)getLittleEndian(map + 24, 4);
+    }
+    if ((width != 4 && width != 8) || indexOffset > (unsigned long long)size ||
+        (unsigned long long)size - indexOffset < (total + 1) * (unsigned long long)width) {
+        printf("Error: '%s' is not an indexed output file\n", target);
+        status = 1;
+    } else if (first < 1 || count < 1 || (unsigned long long)first > total) {
+        printf("Error: Result %lld is out of range (1 to %llu)\n", first, total);
+        status = 1;
+    } else {
+        unsigned long long last = (unsigned long long)first + (unsigned long long)count - 1;
+        if (last > total) last = total;
+        const unsigned char* offsets = map + indexOffset;
+        unsigned long long begin = getLittleEndian(offsets + (first - 1) * width, width);
+        unsigned long long end = getLittleEndian(offsets + last * width, width);
+        if (begin > end || INDEX_HEADER_SIZE + end > indexOffset) {
+            printf("Error: '%s' has a corrupt index\n", target);
+            status = 1;
+        } else {
+            writeOutput((const char*)map + INDEX_HEADER_SIZE + begin, (size_t)(end - begin));
+        }
+    }
+
+#ifndef _WIN32
+    if (!copy) munmap((void*)map, (size_t)size);
+#endif
+    free(copy);
+    fclose(file);
+    return status;
+}
+
+// ----------- BULK Directory Conversion -----------
+
+//Converts many small files, one expression per file, into an output
+//directory. With io_uring the opens, reads, writes and closes of many
+//files are kept in flight and submitted in batches; each file is converted
+//as soon as its read completes. Without it a pool of threads runs the
+//blocking path.
+
+#define BULK_SLOTS 64            //Files in flight on the io_uring path
+#define BULK_READ_SIZE 4096      //First read size; larger files grow the buffer
+
+//Input and output paths of every file to convert. Each result is written
+//to a temporary file next to its output and renamed over it once complete,
+//so an output is never left truncated.
+typedef struct {
+    char** inputs;
+    char** outputs;
+    char** temps;                //outDir/.<file name>.tmp
+    int count;
+    const char* inputType;
+    int notation;
+    atomic_int next;             //Next file for the blocking workers
+    atomic_int errors;
+} BulkJob;
+
+//A file holds one expression, read as --stream reads a one-line file:
+//only its final line break ("\n", "\r\n" or a lone "\r") is dropped
+static size_t bulkLineLength(const char* text, size_t len) {
+    if (len > 0 && text[len - 1] == '\n') len--;
+    if (len > 0 && text[len - 1] == '\r') len--;
+    return len;
+}
+
+//Converts one line (len bytes without its line break, room for one more)
+//into one output line, exactly as --stream converts it: only spaces
+//separate tokens and nothing is trimmed. Returns a malloc'd,
+//NUL-terminated line with the result or the error. With --cache, a result
+//from an earlier run is returned unparsed.
+char* convertText(char* text, size_t len, const char* inputType, int notation, size_t* outLen, bool* failed) {
+    text[len] = '\0';
+
+    Fingerprint key;
+    if (conversionCache) {
+        size_t cachedLen;
+        key = cacheKey(text, len, notationOf(inputType), notation, false);
+        const char* cached = cacheLookup(key, &cachedLen);
+        if (cached) {
+            char* out = (char*)malloc(cachedLen + 2);
+            if (!out) {
+                printf("Error: Memory allocation failed\n");
+                exit(1);
+            }
+            memcpy(out, cached, cachedLen);
+            out[cachedLen] = '\n';
+            out[cachedLen + 1] = '\0';
+            *outLen = cachedLen + 1;
+            *failed = false;
+            return out;
+        }
+    }
+
+    char error[ERROR_CAPTURE_SIZE] = "";
+    Node* root = NULL;
+    Token* tokens = (Token*)malloc((len / 2 + 1) * sizeof(Token));
+    if (!tokens) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    errorCapture = error;
+    if (strspn(text, " \t") == len) {
+        reportError("Error: No valid tokens found\n");
+    } else {
+        int tokenCount;
+        root = parseExpression(text, inputType, tokens, (int)(len / 2 + 1), &tokenCount);
+        freeTokens(tokens, tokenCount);
+    }
+    errorCapture = NULL;
+    free(tokens);
+
+    size_t size = root ? renderedSize(root, notation) : strlen(error[0] ? error : "Error: Invalid expression");
+    char* out = (char*)malloc(size + 2);
+    if (!out) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    char* end = out;
+    if (root) {
+        end = renderTree(root, notation, out);
+        if (end > out && end[-1] == ' ') end--;
+        freeTree(root);
+        if (conversionCache) cacheInsert(key, out, (size_t)(end - out));
+    } else {
+        memcpy(out, error[0] ? error : "Error: Invalid expression", size);
+        end += size;
+    }
+    *end++ = '\n';
+    *end = '\0'; //The schedule classifies errors with strstr
+    *outLen = (size_t)(end - out);
+    *failed = root == NULL;
+    return out;
+}
+
+//Adds one input file and its output path (outDir/<file name>) to the job
+static void addBulkFile(BulkJob* job, int* capacity, const char* input, const char* outDir) {
+    if (job->count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 1024;
+        job->inputs = (char**)realloc(job->inputs, *capacity * sizeof(char*));
+        job->outputs = (char**)realloc(job->outputs, *capacity * sizeof(char*));
+        job->temps = (char**)realloc(job->temps, *capacity * sizeof(char*));
+        if (!job->inputs || !job->outputs || !job->temps) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    const char* name = strrchr(input, '/');
+    name = name ? name + 1 : input;
+    char* output = (char*)malloc(strlen(outDir) + strlen(name) + 2);
+    char* temp = (char*)malloc(strlen(outDir) + strlen(name) + 7);
+    char* copy = strdup(input);
+    if (!output || !temp || !copy) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    sprintf(output, "%s/%s", outDir, name);
+    sprintf(temp, "%s/.%s.tmp", outDir, name);
+    job->inputs[job->count] = copy;
+    job->temps[job->count] = temp;
+    job->outputs[job->count++] = output;
+}
+
+//Moves a completely written temporary file over its output. Returns
+//false (and removes the temporary file) if that fails.
+static bool bulkFinish(BulkJob* job, int i) {
+    if (rename(job->temps[i], job->outputs[i]) == 0) return true;
+    printf("Error: Cannot write output file '%s'\n", job->outputs[i]);
+    remove(job->temps[i]);
+    return false;
+}
+
+//Lists the regular files of a directory, or the paths in a list file
+//(one per line). Returns false if the source cannot be read.
+static bool collectBulkFiles(BulkJob* job, const char* source, const char* outDir) {
+    int capacity = 0;
+#ifndef _WIN32
+    DIR* dir = opendir(source);
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir))) {
+            char* path = (char*)malloc(strlen(source) + strlen(entry->d_name) + 2);
+            if (!path) {
+                printf("Error: Memory allocation failed\n");
+                exit(1);
+            }
+            sprintf(path, "%s/%s", source, entry->d_name);
+            struct stat info;
+            if (entry->d_type == DT_REG || (entry->d_type == DT_UNKNOWN && stat(path, &info) == 0 &&
+                                            S_ISREG(info.st_mode))) {
+                addBulkFile(job, &capacity, path, outDir);
+            }
+            free(path);
+        }
+        closedir(dir);
+        return true;
+    }
+#endif
+    FILE* list = fopen(source, "r");
+    if (!list) return false;
+    char line[4096];
+    while (fgets(line, sizeof(line), list)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0]) addBulkFile(job, &capacity, line, outDir);
+    }
+    fclose(list);
+    return true;
+}
+
+//Blocking worker: takes the next file until none are left
+static void bulkPhaseBlocking(void* ctx, int t) {
+    (void)t;
+    BulkJob* job = (BulkJob*)ctx;
+    int i;
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count) {
+        FILE* in = fopen(job->inputs[i], "rb");
+        if (!in) {
+            printf("Error: Cannot open input file '%s'\n", job->inputs[i]);
+            atomic_fetch_add(&job->errors, 1);
+            continue;
+        }
+        size_t capacity = BULK_READ_SIZE, len = 0, n;
+        char* text = (char*)malloc(capacity);
+        while (text && (n = fread(text + len, 1, capacity - 1 - len, in)) > 0) {
+            len += n;
+            if (len == capacity - 1) text = (char*)realloc(text, capacity *= 2);
+        }
+        fclose(in);
+        if (!text) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+
+        size_t outLen;
+        bool failed;
+        char* out = convertText(text, bulkLineLength(text, len), job->inputType, job->notation, &outLen, &failed);
+        free(text);
+        FILE* file = fopen(job->temps[i], "wb");
+        bool written = file && fwrite(out, 1, outLen, file) == outLen;
+        if (file && fclose(file) != 0) written = false;
+        if (!written) {
+            printf("Error: Cannot write output file '%s'\n", job->outputs[i]);
+            if (file) remove(job->temps[i]);
+            failed = true;
+        } else if (!bulkFinish(job, i)) {
+            failed = true;
+        }
+        free(out);
+        if (failed) atomic_fetch_add(&job->errors, 1);
+    }
+}
+
+#ifdef HAVE_IO_URING
+
+//Submission and completion rings mapped from the kernel
+typedef struct {
+    int fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray, sqEntries;
+    struct io_uring_sqe* sqes;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe* cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize;
+    unsigned toSubmit;           //Entries queued since the last io_uring_enter
+    unsigned inFlight;           //Entries whose completion has not been reaped
+} Uring;
+
+//Sets up a ring and checks that the file operations are supported.
+//Returns false (nothing to free) when io_uring cannot be used.
+static bool uringInit(Uring* ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return false;
+
+    struct {
+        struct io_uring_probe probe;
+        struct io_uring_probe_op ops[256];
+    } probe;
+    memset(&probe, 0, sizeof(probe));
+    int needed[] = {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE};
+    bool supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, &probe, 256) == 0;
+    for (int i = 0; supported && i < 4; i++) {
+        supported = needed[i] <= probe.probe.last_op && (probe.ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+    ring->sqRing = supported ? mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                    ring->fd, IORING_OFF_SQ_RING) : MAP_FAILED;
+    ring->cqRing = ring->sqRing;
+    if (ring->sqRing != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes = ring->cqRing == MAP_FAILED ? MAP_FAILED :
+                 mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+        if (ring->sqRing != MAP_FAILED) munmap(ring->sqRing, ring->sqRingSize);
+        close(ring->fd);
+        return false;
+    }
+
+    char* sq = (char*)ring->sqRing;
+    char* cq = (char*)ring->cqRing;
+    ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+    ring->sqEntries = params.sq_entries;
+    ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+static void uringFree(Uring* ring) {
+    munmap(ring->sqes, ring->sqEntries * sizeof(struct io_uring_sqe));
+    if (ring->cqRing != ring->sqRing) munmap(ring->cqRing, ring->cqRingSize);
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+}
+
+//Submits the queued entries; with wait, also blocks for one completion
+static void uringSubmit(Uring* ring, bool wait) {
+    while (ring->toSubmit > 0 || wait) {
+        int done = (int)syscall(__NR_io_uring_enter, ring->fd, ring->toSubmit, wait ? 1 : 0,
+                                wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (done < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            printf("Error: io_uring submission failed\n");
+            exit(1);
+        }
+        ring->toSubmit -= (unsigned)done;
+        wait = false;
+    }
+}
+
+//Queues one operation; user is returned with its completion
+static void uringQueue(Uring* ring, int opcode, int fd, const void* addr, unsigned len,
+                       unsigned long long offset, int flags, unsigned long long user) {
+    unsigned tail = *ring->sqTail;
+    if (tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) == ring->sqEntries) {
+        uringSubmit(ring, false);
+    }
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)opcode;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)(unsigned long)addr;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->open_flags = (unsigned)flags;
+    sqe->user_data = user;
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->toSubmit++;
+    ring->inFlight++;
+}
+
+//What each in-flight file is waiting for
+enum { BULK_OPEN_IN, BULK_READ, BULK_OPEN_OUT, BULK_WRITE };
+
+typedef struct {
+    int file;                    //Index in the job, -1 when the slot is free
+    int state;
+    int fd;
+    char* text;                  //Input bytes, later the converted line
+    size_t len, capacity, written;
+    bool failed;
+} BulkSlot;
+
+//user_data layout: slot index << 1, low bit set for closes (nothing to do)
+#define BULK_CLOSE 1ULL
+
+static void bulkClose(Uring* ring, int fd) {
+    uringQueue(ring, IORING_OP_CLOSE, fd, NULL, 0, 0, 0, BULK_CLOSE);
+}
+
+//Starts the next file in a free slot, if any are left
+static void bulkStart(Uring* ring, BulkJob* job, BulkSlot* slot, int index, int* nextFile) {
+    if (*nextFile >= job->count) {
+        slot->file = -1;
+        return;
+    }
+    slot->file = (*nextFile)++;
+    slot->state = BULK_OPEN_IN;
+    slot->len = 0;
+    slot->failed = false;
+    uringQueue(ring, IORING_OP_OPENAT, AT_FDCWD, job->inputs[slot->file], 0, 0, O_RDONLY | O_CLOEXEC,
+               (unsigned long long)index << 1);
+}
+
+//Moves a slot on after one of its operations completes
+static void bulkAdvance(Uring* ring, BulkJob* job, BulkSlot* slot, int index, int res, int* nextFile) {
+    unsigned long long user = (unsigned long long)index << 1;
+    switch (slot->state) {
+        case BULK_OPEN_IN:
+            if (res < 0) {
+                printf("Error: Cannot open input file '%s'\n", job->inputs[slot->file]);
+                break;
+            }
+            slot->fd = res;
+            slot->state = BULK_READ;
+            uringQueue(ring, IORING_OP_READ, slot->fd, slot->text, (unsigned)(slot->capacity - 1), 0, 0, user);
+            return;
+        case BULK_READ:
+            if (res < 0) {
+                printf("Error: Cannot read input file '%s'\n", job->inputs[slot->file]);
+                bulkClose(ring, slot->fd);
+                break;
+            }
+            slot->len += (size_t)res;
+            if (slot->len == slot->capacity - 1) {
+                //The buffer filled up, so the file may be longer
+                slot->capacity *= 2;
+                slot->text = (char*)realloc(slot->text, slot->capacity);
+                if (!slot->text) {
+                    printf("Error: Memory allocation failed\n");
+                    exit(1);
+                }
+                uringQueue(ring, IORING_OP_READ, slot->fd, slot->text + slot->len,
+                           (unsigned)(slot->capacity - 1 - slot->len), slot->len, 0, user);
+                return;
+            }
+            //A short read of a regular file is its end
+            bulkClose(ring, slot->fd);
+            {
+                size_t outLen;
+                char* out = convertText(slot->text, bulkLineLength(slot->text, slot->len), job->inputType,
+                                        job->notation, &outLen, &slot->failed);
+                if (outLen > slot->capacity) {
+                    slot->capacity = outLen;
+                    slot->text = (char*)realloc(slot->text, slot->capacity);
+                    if (!slot->text) {
+                        printf("Error: Memory allocation failed\n");
+                        exit(1);
+                    }
+                }
+                memcpy(slot->text, out, outLen);
+                free(out);
+                slot->len = outLen;
+            }
+            slot->state = BULK_OPEN_OUT;
+            uringQueue(ring, IORING_OP_OPENAT, AT_FDCWD, job->temps[slot->file], 0644, 0,
+                       O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, user);
+            return;
+        case BULK_OPEN_OUT:
+            if (res < 0) {
+                printf("Error: Cannot write output file '%s'\n", job->outputs[slot->file]);
+                break;
+            }
+            slot->fd = res;
+            slot->written = 0;
+            slot->state = BULK_WRITE;
+            uringQueue(ring, IORING_OP_WRITE, slot->fd, slot->text, (unsigned)slot->len, 0, 0, user);
+            return;
+        case BULK_WRITE:
+            if (res <= 0) {
+                printf("Error: Cannot write output file '%s'\n", job->outputs[slot->file]);
+                bulkClose(ring, slot->fd);
+                remove(job->temps[slot->file]);
+                break;
+            }
+            slot->written += (size_t)res;
+            if (slot->written < slot->len) {
+                uringQueue(ring, IORING_OP_WRITE, slot->fd, slot->text + slot->written,
+                           (unsigned)(slot->len - slot->written), slot->written, 0, user);
+                return;
+            }
+            //Every byte is written, so the rename need not wait for the close
+            bulkClose(ring, slot->fd);
+            if (!bulkFinish(job, slot->file)) slot->failed = true;
+            if (slot->failed) atomic_fetch_add(&job->errors, 1);
+            bulkStart(ring, job, slot, index, nextFile);
+            return;
+    }
+    //Reached only when an I/O step failed
+    atomic_fetch_add(&job->errors, 1);
+    bulkStart(ring, job, slot, index, nextFile);
+}
+
+//Runs the whole job on one thread through io_uring. Returns false if
+//io_uring is unavailable, before any file has been touched.
+static bool bulkUring(BulkJob* job) {
+    Uring ring;
+    if (!uringInit(&ring, BULK_SLOTS * 4)) return false;
+
+    BulkSlot slots[BULK_SLOTS];
+    int nextFile = 0;
+    for (int i = 0; i < BULK_SLOTS; i++) {
+        slots[i].capacity = BULK_READ_SIZE;
+        slots[i].text = (char*)malloc(slots[i].capacity);
+        if (!slots[i].text) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        bulkStart(&ring, job, &slots[i], i, &nextFile);
+    }
+
+    //Every queued operation gets one completion, closes included
+    while (ring.inFlight > 0) {
+        uringSubmit(&ring, true);
+        unsigned head = *ring.cqHead;
+        unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+            unsigned long long user = cqe->user_data;
+            int res = cqe->res;
+            __atomic_store_n(ring.cqHead, head + 1, __ATOMIC_RELEASE);
+            ring.inFlight--;
+            if (user & BULK_CLOSE) continue;
+            int index = (int)(user >> 1);
+            bulkAdvance(&ring, job, &slots[index], index, res, &nextFile);
+        }
+    }
+
+    for (int i = 0; i < BULK_SLOTS; i++) free(slots[i].text);
+    uringFree(&ring);
+    return true;
+}
+
+#endif
+
+//Converts every file of a directory (or list file) into outDir.
+//mode is "uring" (default; falls back to threads), "blocking" or "compare".
+int convertBulk(const char* source, const char* inputType, const char* outputType, const char* outDir,
+                const char* mode, int threads) {
+    if (strcmp(inputType, "infix") != 0 && strcmp(inputType, "prefix") != 0 &&
+        strcmp(inputType, "postfix") != 0) {
+        printf("\nError: Unknown input type\n");
+        return 1;
+    }
+    int notation = notationOf(outputType);
+    if (notation < 0) {
+        printOutputTypeError();
+        return 1;
+    }
+    bool compare = strcmp(mode, "compare") == 0;
+    if (!compare && strcmp(mode, "uring") != 0 && strcmp(mode, "blocking") != 0) {
+        printf("Error: Unknown bulk mode '%s' (use uring, blocking or compare)\n", mode);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > PAR_MAX_THREADS) threads = PAR_MAX_THREADS;
+
+    BulkJob job;
+    memset(&job, 0, sizeof(job));
+    job.inputType = inputType;
+    job.notation = notation;
+    if (!collectBulkFiles(&job, source, outDir)) {
+        printf("Error: Cannot open input directory or list '%s'\n", source);
+        return 1;
+    }
+
+    //compare runs the blocking path first, then io_uring over the same files
+    int runs = compare ? 2 : 1;
+    for (int run = 0; run < runs; run++) {
+        bool blocking = compare ? run == 0 : strcmp(mode, "blocking") == 0;
+        atomic_init(&job.next, 0);
+        atomic_init(&job.errors, 0);
+        double start = nowSeconds();
+        const char* used = "io_uring";
+#ifdef HAVE_IO_URING
+        if (blocking || !bulkUring(&job)) {
+            if (!blocking) fprintf(stderr, "io_uring unavailable, using %d blocking threads\n", threads);
+            parallelFor(threads, bulkPhaseBlocking, &job);
+            used = "blocking";
+        }
+#else
+        parallelFor(threads, bulkPhaseBlocking, &job);
+        used = "blocking";
+#endif
+        double elapsed = nowSeconds() - start;
+        fprintf(stderr, "%-8s %d files, %d errors, %.3f s, %.0f files/s\n", used, job.count,
+                atomic_load(&job.errors), elapsed, elapsed > 0 ? job.count / elapsed : 0.0);
+    }
+
+    for (int i = 0; i < job.count; i++) {
+        free(job.inputs[i]);
+        free(job.outputs[i]);
+        free(job.temps[i]);
+    }
+    free(job.inputs);
+    free(job.outputs);
+    free(job.temps);
+    return atomic_load(&job.errors) ? 1 : 0;
+}
+
+// ----------- SIZE-AWARE Scheduling -----------
+
+//Converts one expression per line when sizes are very uneven. Each line's
+//size is estimated from its token count. Tiny and medium lines are packed
+//into batches that workers take whole, so scheduling cost is paid per
+//batch instead of per line. Huge lines each get the intra-expression
+//parallel path on all threads. Output order matches input order.
+
+#define SCHED_WINDOW_BYTES (64 << 20)    //Input scheduled per round
+#define SCHED_BATCH_BYTES (64 * 1024)    //Input bytes per worker batch
+#define SCHED_TINY_TOKENS 20             //Up to this many tokens is tiny
+#define SCHED_HUGE_TOKENS 100000         //Default threshold for the parallel path
+
+enum { CLASS_TINY, CLASS_MEDIUM, CLASS_HUGE };
+static const char* sizeClassName[] = {"tiny", "medium", "huge"};
+
+//A run of small lines converted by one worker, or a single huge line
+typedef struct {
+    int first, count;
+    bool huge;
+    char* out;
+    size_t outLen;
+} SchedItem;
+
+typedef struct {
+    char* text;                  //Window of input lines, each NUL-terminated
+    size_t* lineStart;
+    size_t* lineLen;
+    long long* lineTokens;
+    double* latency;             //Conversion time of each line
+    bool* failed;
+    int lineCount;
+    SchedItem* items;
+    int itemCount;
+    atomic_int nextItem;
+    const char* inputType;
+    int inputNotation, notation;
+    int threads;
+} SchedWindow;
+
+//Latency samples and totals of one size class
+typedef struct {
+    double* samples;
+    size_t count, capacity;
+    long long tokens, errors;
+    double busy;                 //Summed conversion time
+} ClassStats;
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+//Counts the space-separated tokens of a line, the size estimate
+static long long countTokens(const char* text, size_t len) {
+    long long tokens = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] != ' ' && text[i] != '\t' && (i == 0 || text[i - 1] == ' ' || text[i - 1] == '\t')) tokens++;
+    }
+    return tokens;
+}
+
+//Converts one huge line with the parallel parser and renderer. Same
+//contract as convertText, which handles lines the parallel path rejects.
+char* convertHuge(char* text, size_t len, const char* inputType, int notation, int threads,
+                  size_t* outLen, bool* failed) {
+    Token* tokens = NULL;
+    Node* nodes = NULL;
+    Node* root = NULL;
+    int tokenCount = tokenizeParallel(text, len, &tokens, threads);
+    if (tokenCount > 0) root = buildTreeParallel(tokens, tokenCount, inputType, threads, &nodes);
+    free(tokens);
+    if (!root) {
+        restoreExpression(text, len);
+        return convertText(text, len, inputType, notation, outLen, failed);
+    }
+    size_t length;
+    char* out = renderParallel(root, notation, threads, &length);
+    free(nodes);
+    if (length > 0 && out[length - 1] == ' ') length--;
+    out[length++] = '\n';
+    *outLen = length;
+    *failed = false;
+    return out;
+}
+
+//Worker: converts whole batches of small lines into one buffer each
+static void schedPhaseBatches(void* ctx, int t) {
+    (void)t;
+    SchedWindow* w = (SchedWindow*)ctx;
+    int i;
+    while ((i = atomic_fetch_add(&w->nextItem, 1)) < w->itemCount) {
+        SchedItem* item = &w->items[i];
+        if (item->huge) continue;
+        size_t capacity = SCHED_BATCH_BYTES * 2;
+        item->out = (char*)malloc(capacity);
+        item->outLen = 0;
+        for (int line = item->first; line < item->first + item->count; line++) {
+            double start = nowSeconds();
+            size_t len;
+            char* out = convertText(w->text + w->lineStart[line], w->lineLen[line], w->inputType,
+                                    w->notation, &len, &w->failed[line]);
+            if (item->outLen + len > capacity) {
+                capacity = (item->outLen + len) * 2;
+                item->out = (char*)realloc(item->out, capacity);
+            }
+            if (!item->out) {
+                printf("Error: Memory allocation failed\n");
+                exit(1);
+            }
+            memcpy(item->out + item->outLen, out, len);
+            item->outLen += len;
+            w->latency[line] = nowSeconds() - start;
+            recordConversion(w->inputNotation, w->notation, w->lineLen[line], len,
+                             (unsigned long long)(w->latency[line] * 1e9), w->failed[line] ? out : NULL);
+            free(out);
+        }
+    }
+}
+
+static void addSample(ClassStats* stats, double latency, long long tokens, bool failed) {
+    if (stats->count == stats->capacity) {
+        stats->capacity = stats->capacity ? stats->capacity * 2 : 1024;
+        stats->samples = (double*)realloc(stats->samples, stats->capacity * sizeof(double));
+        if (!stats->samples) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    stats->samples[stats->count++] = latency;
+    stats->tokens += tokens;
+    stats->busy += latency;
+    if (failed) stats->errors++;
+}
+
+//Grows the per-line arrays of a window
+static void growWindowLines(SchedWindow* w, int* capacity) {
+    *capacity = *capacity ? *capacity * 2 : 4096;
+    w->lineStart = (size_t*)realloc(w->lineStart, *capacity * sizeof(size_t));
+    w->lineLen = (size_t*)realloc(w->lineLen, *capacity * sizeof(size_t));
+    w->lineTokens = (long long*)realloc(w->lineTokens, *capacity * sizeof(long long));
+    w->latency = (double*)realloc(w->latency, *capacity * sizeof(double));
+    w->failed = (bool*)realloc(w->failed, *capacity * sizeof(bool));
+    w->items = (SchedItem*)realloc(w->items, *capacity * sizeof(SchedItem));
+    if (!w->lineStart || !w->lineLen || !w->lineTokens || !w->latency || !w->failed || !w->items) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+}
+
+//Converts a file (or stdin with "-") with one expression per line,
+//scheduling by size, and reports latency and throughput per size class
+int convertScheduled(const char* path, const char* inputType, const char* outputType, int threads,
+                     long long hugeTokens) {
+    if (strcmp(inputType, "infix") != 0 && strcmp(inputType, "prefix") != 0 &&
+        strcmp(inputType, "postfix") != 0) {
+        printf("\nError: Unknown input type\n");
+        return 1;
+    }
+    int notation = notationOf(outputType);
+    if (notation < 0) {
+        printOutputTypeError();
+        return 1;
+    }
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        printf("Error: Cannot open input file '%s'\n", path);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > PAR_MAX_THREADS) threads = PAR_MAX_THREADS;
+    if (hugeTokens <= SCHED_TINY_TOKENS) hugeTokens = SCHED_HUGE_TOKENS;
+
+    SchedWindow w;
+    memset(&w, 0, sizeof(w));
+    w.inputType = inputType;
+    w.inputNotation = notationOf(inputType);
+    w.notation = notation;
+    w.threads = threads;
+    int lineCapacity = 0;
+    size_t capacity = SCHED_WINDOW_BYTES, used = 0;
+    w.text = (char*)malloc(capacity);
+    if (!w.text) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    ClassStats stats[3];
+    memset(stats, 0, sizeof(stats));
+    startMetricsDumper();
+    double batchWall = 0, hugeWall = 0, start = nowSeconds();
+    long long bytes = 0;
+    bool eof = false;
+
+    while (!eof) {
+        //Fill the window; it grows only while it holds no complete line
+        size_t want = capacity - 1 - used;
+        size_t n = fread(w.text + used, 1, want, file);
+        used += n;
+        bytes += (long long)n;
+        eof = n < want;
+        char* last = (char*)memrchr(w.text, '\n', used);
+        if (!last && !eof) {
+            capacity *= 2;
+            w.text = (char*)realloc(w.text, capacity);
+            if (!w.text) {
+                printf("Error: Memory allocation failed\n");
+                exit(1);
+            }
+            continue;
+        }
+        size_t end = eof ? used : (size_t)(last - w.text) + 1;
+
+        //Split and classify the lines, cutting batches at huge lines
+        w.lineCount = 0;
+        w.itemCount = 0;
+        size_t lineStart = 0, batchBytes = 0;
+        while (lineStart < end) {
+            char* nl = (char*)memchr(w.text + lineStart, '\n', end - lineStart);
+            size_t lineEnd = nl ? (size_t)(nl - w.text) : end;
+            size_t len = lineEnd - lineStart;
+            if (len > 0 && w.text[lineStart + len - 1] == '\r') len--;
+            if (w.lineCount == lineCapacity) growWindowLines(&w, &lineCapacity);
+            int line = w.lineCount++;
+            w.lineStart[line] = lineStart;
+            w.lineLen[line] = len;
+            w.lineTokens[line] = countTokens(w.text + lineStart, len);
+
+            bool huge = w.lineTokens[line] >= hugeTokens;
+            SchedItem* item = w.itemCount ? &w.items[w.itemCount - 1] : NULL;
+            if (huge || !item || item->huge || batchBytes + len > SCHED_BATCH_BYTES) {
+                item = &w.items[w.itemCount++];
+                item->first = line;
+                item->count = 0;
+                item->huge = huge;
+                item->out = NULL;
+                batchBytes = 0;
+            }
+            item->count++;
+            batchBytes += len + 1;
+            lineStart = lineEnd + 1;
+        }
+        for (int line = 0; line < w.lineCount; line++) {
+            w.text[w.lineStart[line] + w.lineLen[line]] = '\0';
+        }
+
+        //Small lines: whole batches per worker
+        double phase = nowSeconds();
+        atomic_init(&w.nextItem, 0);
+        parallelFor(threads, schedPhaseBatches, &w);
+        batchWall += nowSeconds() - phase;
+
+        //Huge lines: one at a time on every thread
+        phase = nowSeconds();
+        for (int i = 0; i < w.itemCount; i++) {
+            SchedItem* item = &w.items[i];
+            if (!item->huge) continue;
+            double begin = nowSeconds();
+            item->out = convertHuge(w.text + w.lineStart[item->first], w.lineLen[item->first], inputType,
+                                    notation, threads, &item->outLen, &w.failed[item->first]);
+            w.latency[item->first] = nowSeconds() - begin;
+            recordConversion(w.inputNotation, notation, w.lineLen[item->first], item->outLen,
+                             (unsigned long long)(w.latency[item->first] * 1e9),
+                             w.failed[item->first] ? item->out : NULL);
+        }
+        hugeWall += nowSeconds() - phase;
+
+        for (int i = 0; i < w.itemCount; i++) {
+            fwrite(w.items[i].out, 1, w.items[i].outLen, stdout);
+            free(w.items[i].out);
+        }
+        for (int line = 0; line < w.lineCount; line++) {
+            long long tokens = w.lineTokens[line];
+            int sizeClass = tokens >= hugeTokens ? CLASS_HUGE : tokens <= SCHED_TINY_TOKENS ? CLASS_TINY : CLASS_MEDIUM;
+            addSample(&stats[sizeClass], w.latency[line], tokens, w.failed[line]);
+        }
+
+        memmove(w.text, w.text + end, used - end);
+        used -= end;
+    }
+    fflush(stdout);
+    stopMetricsDumper();
+    double elapsed = nowSeconds() - start;
+
+    //Latency is each expression's conversion time; throughput is per busy
+    //second of the workers (tiny, medium) or of the whole pool (huge)
+    fprintf(stderr, "%-7s %10s %12s %7s %10s %10s %10s %12s %14s\n", "class", "count", "tokens", "errors",
+            "p50 us", "p99 us", "max us", "expr/s", "tokens/s");
+    long long lines = 0, errors = 0;
+    for (int c = CLASS_TINY; c <= CLASS_HUGE; c++) {
+        ClassStats* s = &stats[c];
+        lines += (long long)s->count;
+        errors += s->errors;
+        if (s->count == 0) {
+            fprintf(stderr, "%-7s %10d\n", sizeClassName[c], 0);
+            continue;
+        }
+        qsort(s->samples, s->count, sizeof(double), compareDoubles);
+        fprintf(stderr, "%-7s %10zu %12lld %7lld %10.1f %10.1f %10.1f %12.0f %14.0f\n", sizeClassName[c], s->count,
+                s->tokens, s->errors, s->samples[s->count / 2] * 1e6, s->samples[(s->count - 1) * 99 / 100] * 1e6,
+                s->samples[s->count - 1] * 1e6, s->busy > 0 ? s->count / s->busy : 0.0,
+                s->busy > 0 ? s->tokens / s->busy : 0.0);
+        free(s->samples);
+    }
+    fprintf(stderr, "%lld lines on %d threads in %.3f s (batches %.3f s, huge %.3f s), %.0f lines/s, %.1f MB/s\n",
+            lines, threads, elapsed, batchWall, hugeWall, elapsed > 0 ? lines / elapsed : 0.0,
+            elapsed > 0 ? bytes / elapsed / 1e6 : 0.0);
+
+    if (file != stdin) fclose(file);
+    free(w.text);
+    free(w.lineStart);
+    free(w.lineLen);
+    free(w.lineTokens);
+    free(w.latency);
+    free(w.failed);
+    free(w.items);
+    return errors ? 1 : 0;
+}
+
+// ----------- CORPUS Profile -----------
+
+//One pass over a corpus with bounded memory: the structure of what is
+//being converted, to size arenas and caches and to set the parallel
+//threshold. Distributions use the log-linear buckets of the latency
+//histograms as a quantile sketch (each quantile is within 12.5% of the
+//true value); distinct operands and subtrees are HyperLogLog estimates.
+
+#define HLL_BITS 14                       //2^14 registers: about 0.8% standard error
+#define HLL_REGISTERS (1 << HLL_BITS)
+#define LEAN_BUCKETS 11                   //Per-expression lean, -1.0 to 1.0 in steps of 0.2
+
+typedef struct {
+    unsigned char reg[HLL_REGISTERS];     //Longest run of leading zeros + 1 seen per register
+} HyperLogLog;
+
+static void hllAdd(HyperLogLog* h, unsigned long long hash) {
+    unsigned int index = (unsigned int)(hash >> (64 - HLL_BITS));
+    unsigned long long rest = (hash << HLL_BITS) | (1ULL << (HLL_BITS - 1)); //Caps the run length
+    unsigned char rank = (unsigned char)(__builtin_clzll(rest) + 1);
+    if (rank > h->reg[index]) h->reg[index] = rank;
+}
+
+//Natural log of x >= 1 without libm: halve into [1, 2), then the atanh series
+static double naturalLog(double x) {
+    int halvings = 0;
+    while (x >= 2) {
+        x /= 2;
+        halvings++;
+    }
+    double t = (x - 1) / (x + 1), t2 = t * t, term = t, sum = 0;
+    for (int k = 1; k < 40; k += 2) {
+        sum += term / k;
+        term *= t2;
+    }
+    return halvings * 0.6931471805599453 + 2 * sum;
+}
+
+//Harmonic-mean estimate, with linear counting while registers are still empty
+static double hllEstimate(const HyperLogLog* h) {
+    double sum = 0, m = HLL_REGISTERS;
+    int zeros = 0;
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        sum += 1.0 / (double)(1ULL << h->reg[i]);
+        zeros += h->reg[i] == 0;
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros) estimate = m * naturalLog(m / zeros);
+    return estimate;
+}
+
+//Count, sum, exact maximum and log-linear histogram of one quantity
+typedef struct {
+    unsigned long long hist[HIST_BUCKETS];
+    unsigned long long count, sum, max;
+} Distribution;
+
+static void addValue(Distribution* d, unsigned long long value) {
+    d->hist[histBucket(value)]++;
+    d->count++;
+    d->sum += value;
+    if (value > d->max) d->max = value;
+}
+
+static void printDistribution(FILE* out, const char* name, const Distribution* d) {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    static const char* names[] = {"p50", "p90", "p99", "p999"};
+    fprintf(out, "\"%s\":{\"count\":%llu,\"mean\":%.2f", name, d->count, d->count ? (double)d->sum / d->count : 0.0);
+    unsigned long long seen = 0;
+    int q = 0;
+    for (int b = 0; b < HIST_BUCKETS && q < 4; b++) {
+        seen += d->hist[b];
+        while (q < 4 && seen > 0 && seen >= quantiles[q] * d->count) {
+            unsigned long long top = histBucketTop(b);
+            fprintf(out, ",\"%s\":%llu", names[q++], top < d->max ? top : d->max);
+        }
+    }
+    fprintf(out, ",\"max\":%llu}", d->max);
+}
+
+typedef struct {
+    Distribution lineBytes, tokens, depth, operandLength, nesting;
+    unsigned long long lines, converted, errors[ERROR_KINDS];
+    unsigned long long ops[4];            //+ - * /
+    unsigned long long operands, subtrees;
+    unsigned long long leanLeft, leanRight, leanEven; //Operators by their deeper side
+    unsigned long long lean[LEAN_BUCKETS];
+    unsigned long long hugeLines;         //At least SCHED_HUGE_TOKENS tokens
+    HyperLogLog distinctOperands, distinctSubtrees;
+    struct ProfileFrame* frames;          //Tree walk stack, kept between lines
+    int frameCap;
+    int notation;                         //Of the input
+    const char* inputType;
+    Token* tokenBuf;                      //Sized for the longest line so far
+    size_t tokenCap;
+} CorpusProfile;
+
+//Counts one token of an expression that converted; depth tracks "(" nesting
+static void profileToken(CorpusProfile* pr, const char* text, size_t len, int* depth, int* maxDepth) {
+    if (len == 1 && strchr("+-*/()", text[0])) {
+        if (text[0] == '(') {
+            if (++*depth > *maxDepth) *maxDepth = *depth;
+        } else if (text[0] == ')') {
+            --*depth;
+        } else {
+            pr->ops[strchr("+-*/", text[0]) - "+-*/"]++;
+        }
+        return;
+    }
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)text[i]) * 0x100000001b3ULL;
+    hllAdd(&pr->distinctOperands, mix64(h));
+    addValue(&pr->operandLength, len);
+    pr->operands++;
+}
+
+//Left subtree of an operator finished while its right one is walked
+typedef struct ProfileFrame {
+    Node* node;
+    bool rightSide;              //depth and left hold the left subtree
+    int depth;
+    Fingerprint left;
+} ProfileFrame;
+
+//Walks a tree for its depth, each operator's lean and the subtree
+//fingerprints, which are added to the distinct-subtree sketch. The walk
+//keeps its own stack, since the infix parser accepts any nesting depth.
+static int profileTree(CorpusProfile* pr, Node* root, long long* lean) {
+    int top = 0, depth;
+    Fingerprint fp;
+    Node* node = root;
+    for (;;) {
+        while (node->left && node->right) {
+            if (top == pr->frameCap) {
+                pr->frameCap = pr->frameCap ? pr->frameCap * 2 : 64;
+                pr->frames = (ProfileFrame*)realloc(pr->frames, sizeof(ProfileFrame) * (size_t)pr->frameCap);
+                if (!pr->frames) {
+                    printf("Error: Memory allocation failed\n");
+                    exit(1);
+                }
+            }
+            pr->frames[top].node = node;
+            pr->frames[top++].rightSide = false;
+            node = node->left;
+        }
+        depth = 1;
+        fp = leafFingerprint(node->value);
+
+        //Close every operator whose right subtree this completes
+        for (;;) {
+            if (top == 0) return depth;
+            ProfileFrame* f = &pr->frames[top - 1];
+            if (!f->rightSide) {
+                f->rightSide = true;
+                f->depth = depth;
+                f->left = fp;
+                node = f->node->right;
+                break;
+            }
+            fp = combineFingerprint(f->node->value[0], f->left, fp);
+            hllAdd(&pr->distinctSubtrees, fp.hi);
+            pr->subtrees++;
+            if (f->depth > depth) {
+                pr->leanLeft++;
+                ++*lean;
+            } else if (depth > f->depth) {
+                pr->leanRight++;
+                --*lean;
+            } else {
+                pr->leanEven++;
+            }
+            depth = 1 + (f->depth > depth ? f->depth : depth);
+            top--;
+        }
+    }
+}
+
+//Parses one line of a batch as streamParse does, keeping the error
+//message in error. The caller frees the tokens (tokenCount of them).
+static Node* parseLine(char* line, size_t len, const char* inputType, Token** tokens, size_t* tokenCap,
+                       int* tokenCount, char* error) {
+    Node* root = NULL;
+    *tokenCount = 0;
+    error[0] = '\0';
+    errorCapture = error;
+    if (strspn(line, " \t") == len) {
+        reportError("Error: No valid tokens found\n");
+    } else {
+        if (len / 2 + 1 > *tokenCap) {
+            *tokenCap = len / 2 + 1;
+            *tokens = (Token*)realloc(*tokens, *tokenCap * sizeof(Token));
+            if (!*tokens) {
+                printf("Error: Memory allocation failed\n");
+                exit(1);
+            }
+        }
+        root = parseExpression(line, inputType, *tokens, (int)*tokenCap, tokenCount);
+    }
+    errorCapture = NULL;
+    return root;
+}
+
+//Calls visit for every line of a file or stdin (gzip and zstd are
+//detected), without the newline or a trailing '\r'. Returns false after
+//printing the error if the input cannot be opened or read.
+static bool readLines(const char* path, void (*visit)(void* ctx, char* line, size_t len), void* ctx) {
+    FILE* file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        printf("Error: Cannot open input file '%s'\n", path);
+        return false;
+    }
+    StreamSource source;
+    if (!openSource(&source, file)) {
+        if (file != stdin) fclose(file);
+        return false;
+    }
+    size_t capacity = 1 << 20, used = 0;
+    char* buf = (char*)malloc(capacity + 1);
+    if (!buf) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+
+    //Whole lines are visited in buf; a partial line moves to the front
+    bool eof = false;
+    while (!eof || used) {
+        if (!eof) {
+            if (used == capacity) {
+                capacity *= 2;
+                buf = (char*)realloc(buf, capacity + 1);
+                if (!buf) {
+                    printf("Error: Memory allocation failed\n");
+                    exit(1);
+                }
+            }
+            size_t want = capacity - used;
+            size_t n = readSource(&source, buf + used, want);
+            used += n;
+            eof = n < want;
+        }
+        size_t lineStart = 0;
+        char* nl;
+        //A corrupt or truncated input ends mid-line: that line is dropped
+        while ((nl = (char*)memchr(buf + lineStart, '\n', used - lineStart)) ||
+               (eof && !source.failed && lineStart < used)) {
+            size_t lineEnd = nl ? (size_t)(nl - buf) : used;
+            size_t next = lineEnd + 1;
+            if (lineEnd > lineStart && buf[lineEnd - 1] == '\r') lineEnd--;
+            buf[lineEnd] = '\0';
+            visit(ctx, buf + lineStart, lineEnd - lineStart);
+            lineStart = next < used ? next : used;
+        }
+        memmove(buf, buf + lineStart, used - lineStart);
+        used -= lineStart;
+        if (eof) used = 0;
+    }
+    bool failed = source.failed;
+    closeSource(&source);
+    if (file != stdin) fclose(file);
+    free(buf);
+    if (failed) fprintf(stderr, "Error: Compressed input is corrupt or truncated\n");
+    return !failed;
+}
+
+static void profileLine(void* ctx, char* line, size_t len) {
+    CorpusProfile* pr = (CorpusProfile*)ctx;
+    Token** tokens = &pr->tokenBuf;
+    int notation = pr->notation;
+    pr->lines++;
+    char error[ERROR_CAPTURE_SIZE];
+    int tokenCount;
+    Node* root = parseLine(line, len, pr->inputType, tokens, &pr->tokenCap, &tokenCount, error);
+    if (!root) {
+        int kind = 0;
+        while (kind < ERRKIND_OTHER && !strstr(error, errorKindText[kind])) kind++;
+        pr->errors[kind]++;
+        freeTokens(*tokens, tokenCount);
+        return;
+    }
+
+    //Infix is parsed in place, so its text is intact; prefix and postfix
+    //were split by tokenize and are counted from their tokens
+    unsigned long long count = 0;
+    int depth = 0, maxDepth = 0;
+    if (notation == NOTATION_INFIX) {
+        for (size_t i = 0; i < len;) {
+            while (i < len && line[i] == ' ') i++;
+            size_t start = i;
+            while (i < len && line[i] != ' ') i++;
+            if (i > start) {
+                profileToken(pr, line + start, i - start, &depth, &maxDepth);
+                count++;
+            }
+        }
+        addValue(&pr->nesting, (unsigned long long)maxDepth);
+    } else {
+        for (int i = 0; i < tokenCount; i++) {
+            profileToken(pr, (*tokens)[i].value, strlen((*tokens)[i].value), &depth, &maxDepth);
+        }
+        count = (unsigned long long)tokenCount;
+    }
+    freeTokens(*tokens, tokenCount);
+
+    long long lean = 0;
+    unsigned long long before = pr->subtrees;
+    addValue(&pr->depth, (unsigned long long)profileTree(pr, root, &lean));
+    unsigned long long operators = pr->subtrees - before;
+    if (operators) pr->lean[(int)(((lean + (long long)operators) * (LEAN_BUCKETS - 1) + (long long)operators) / (2 * (long long)operators))]++;
+    freeTree(root);
+
+    addValue(&pr->lineBytes, len);
+    addValue(&pr->tokens, count);
+    if (count >= SCHED_HUGE_TOKENS) pr->hugeLines++;
+    pr->converted++;
+}
+
+//Profile mode: one JSON object describing every line of the corpus.
+//gzip and zstd input is detected as in --stream.
+int profileCorpus(const char* path, const char* inputType) {
+    int notation = notationOf(inputType);
+    if (notation < 0) {
+        printf("Error: Unknown input type\n");
+        return 1;
+    }
+    CorpusProfile* pr = (CorpusProfile*)calloc(1, sizeof(CorpusProfile));
+    if (!pr) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    pr->notation = notation;
+    pr->inputType = inputType;
+    double start = nowSeconds();
+    if (!readLines(path, profileLine, pr)) {
+        free(pr->tokenBuf);
+        free(pr->frames);
+        free(pr);
+        return 1;
+    }
+
+    unsigned long long failedLines = 0;
+    for (int k = 0; k < ERROR_KINDS; k++) failedLines += pr->errors[k];
+    double operandsDistinct = hllEstimate(&pr->distinctOperands);
+    double subtreesDistinct = hllEstimate(&pr->distinctSubtrees);
+    if (operandsDistinct > pr->operands) operandsDistinct = (double)pr->operands;
+    if (subtreesDistinct > pr->subtrees) subtreesDistinct = (double)pr->subtrees;
+
+    printf("{\"lines\":%llu,\"converted\":%llu,\"errors\":%llu,\"errors_by_kind\":{", pr->lines, pr->converted,
+           failedLines);
+    for (int k = 0; k < ERROR_KINDS; k++) printf("%s\"%s\":%llu", k ? "," : "", errorKindName[k], pr->errors[k]);
+    printf("},");
+    printDistribution(stdout, "line_bytes", &pr->lineBytes);
+    printf(",");
+    printDistribution(stdout, "tokens", &pr->tokens);
+    printf(",");
+    printDistribution(stdout, "depth", &pr->depth);
+    printf(",");
+    printDistribution(stdout, "operand_length", &pr->operandLength);
+    if (notation == NOTATION_INFIX) {
+        printf(",");
+        printDistribution(stdout, "paren_nesting", &pr->nesting);
+    }
+    printf(",\"operators\":{\"+\":%llu,\"-\":%llu,\"*\":%llu,\"/\":%llu}", pr->ops[0], pr->ops[1], pr->ops[2],
+           pr->ops[3]);
+    printf(",\"lean\":{\"left\":%llu,\"right\":%llu,\"even\":%llu,\"per_expression\":[", pr->leanLeft,
+           pr->leanRight, pr->leanEven);
+    for (int b = 0; b < LEAN_BUCKETS; b++) printf("%s%llu", b ? "," : "", pr->lean[b]);
+    printf("]},\"operands\":{\"total\":%llu,\"distinct\":%.0f,\"repeated\":%.0f}", pr->operands, operandsDistinct,
+           pr->operands - operandsDistinct);
+    printf(",\"subtrees\":{\"total\":%llu,\"distinct\":%.0f,\"repeated_ratio\":%.4f}", pr->subtrees,
+           subtreesDistinct, pr->subtrees ? 1 - subtreesDistinct / pr->subtrees : 0.0);
+    printf(",\"lines_over_parallel_threshold\":%llu,\"sketch_bytes\":%zu,\"seconds\":%.3f}\n", pr->hugeLines,
+           sizeof(CorpusProfile), nowSeconds() - start);
+
+    free(pr->tokenBuf);
+    free(pr->frames);
+    free(pr);
+    return 0; //Lines that fail are part of the profile, not a failure of it
+}
+
+// ----------- SHARED Subexpressions -----------
+
+//Batch mode with one hash-consed node table for the whole run. Each
+//parsed tree is merged into it bottom-up, so a subtree that appeared in
+//any earlier expression is the node already in the table, and the new
+//copy is freed as soon as it is matched. The output is the same as
+//--stream's, or with --let factored: every operator subtree used more
+//than once is written once as "let $N = ..." before the first line that
+//needs it, and lines refer to it as $N.
+
+typedef struct {
+    Node node;                      //First, so a table Node* is its SharedNode
+    unsigned long long hash;
+    unsigned int refs;              //Parents in the table, plus lines it is the root of
+    int binding;                    //N once "let $N" is written, else 0
+} SharedNode;
+
+#define SHARE_CHUNK 4096            //SharedNodes per allocation
+
+typedef struct {
+    SharedNode** slots;             //Open addressing, power-of-two capacity
+    size_t capacity, count;
+    SharedNode** chunks;
+    int chunkCount, chunkCap, chunkUsed;
+    unsigned long long treeNodes;   //Nodes parsed, as if nothing were shared
+} ShareTable;
+
+static SharedNode* shareAlloc(ShareTable* t) {
+    if (t->chunkCount == 0 || t->chunkUsed == SHARE_CHUNK) {
+        if (t->chunkCount == t->chunkCap) {
+            t->chunkCap = t->chunkCap ? t->chunkCap * 2 : 16;
+            t->chunks = (SharedNode**)realloc(t->chunks, sizeof(SharedNode*) * (size_t)t->chunkCap);
+        }
+        SharedNode* chunk = (SharedNode*)malloc(sizeof(SharedNode) * SHARE_CHUNK);
+        if (!t->chunks || !chunk) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+        t->chunks[t->chunkCount++] = chunk;
+        t->chunkUsed = 0;
+    }
+    return &t->chunks[t->chunkCount - 1][t->chunkUsed++];
+}
+
+static void shareGrow(ShareTable* t) {
+    size_t capacity = t->capacity ? t->capacity * 2 : 1024;
+    SharedNode** slots = (SharedNode**)calloc(capacity, sizeof(SharedNode*));
+    if (!slots) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < t->capacity; i++) {
+        SharedNode* s = t->slots[i];
+        if (!s) continue;
+        size_t j = s->hash & (capacity - 1);
+        while (slots[j]) j = (j + 1) & (capacity - 1);
+        slots[j] = s;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->capacity = capacity;
+}
+
+//Replaces one parsed node, whose children are already in the table, by
+//its table node, adding it if it is new. The parsed node is freed.
+static Node* internNode(ShareTable* t, Node* node, Node* left, Node* right) {
+    t->treeNodes++;
+    unsigned long long h = 0xcbf29ce484222325ULL;
+    for (const unsigned char* p = (const unsigned char*)node->value; *p; p++) h = (h ^ *p) * 0x100000001b3ULL;
+    h = mix64(h ^ mix64((unsigned long long)(size_t)left) ^ mix64((unsigned long long)(size_t)right) * 0x9e3779b97f4a7c15ULL);
+
+    if ((t->count + 1) * 2 > t->capacity) shareGrow(t);
+    size_t i = h & (t->capacity - 1);
+    for (SharedNode* s; (s = t->slots[i]); i = (i + 1) & (t->capacity - 1)) {
+        if (s->hash == h && s->node.left == left && s->node.right == right && strcmp(s->node.value, node->value) == 0) {
+            free(node);
+            return &s->node;
+        }
+    }
+    SharedNode* s = shareAlloc(t);
+    memcpy(s->node.value, node->value, sizeof(s->node.value));
+    s->node.left = left;
+    s->node.right = right;
+    s->hash = h;
+    s->refs = 0;
+    s->binding = 0;
+    if (left) ((SharedNode*)left)->refs++;
+    if (right) ((SharedNode*)right)->refs++;
+    t->slots[i] = s;
+    t->count++;
+    free(node);
+    return &s->node;
+}
+
+//Replaces a parsed tree by its nodes in the table, adding the ones that
+//are new and freeing every parsed node. Children are merged first, so a
+//node matches on its text and the addresses of its two children. The
+//walk uses an explicit stack, as deep as the tree.
+static Node* internTree(ShareTable* t, Node* root) {
+    typedef struct {
+        Node* node;
+        Node* left;                 //Its left child once merged
+        int step;
+    } InternFrame;
+    int capacity = 0, count = 0;
+    InternFrame* stack = (InternFrame*)growArray(NULL, 0, &capacity, sizeof(InternFrame));
+    stack[count++] = (InternFrame){root, NULL, 0};
+    Node* done = NULL;              //Table node of the subtree finished last
+    while (count > 0) {
+        InternFrame* frame = &stack[count - 1];
+        Node* child = NULL;
+        if (frame->step == 0) {
+            frame->step = 1;
+            child = frame->node->left;
+            done = NULL;
+        } else if (frame->step == 1) {
+            frame->step = 2;
+            frame->left = done;
+            child = frame->node->right;
+            done = NULL;
+        }
+        if (child) {
+            stack = (InternFrame*)growArray(stack, count + 1, &capacity, sizeof(InternFrame));
+            stack[count++] = (InternFrame){child, NULL, 0};
+            continue;
+        }
+        if (frame->step < 2) continue;
+        count--;
+        done = internNode(t, frame->node, frame->left, done);
+    }
+    free(stack);
+    return done;
+}
+
+typedef struct {
+    ShareTable table;
+    const char* inputType;
+    Token* tokens;
+    size_t tokenCap;
+    Node** roots;                   //Per line; NULL if it failed
+    char** errors;                  //Per failed line, its message
+    size_t lines, lineCap;
+} ShareBatch;
+
+static void shareLine(void* ctx, char* line, size_t len) {
+    ShareBatch* b = (ShareBatch*)ctx;
+    if (b->lines == b->lineCap) {
+        b->lineCap = b->lineCap ? b->lineCap * 2 : 1024;
+        b->roots = (Node**)realloc(b->roots, sizeof(Node*) * b->lineCap);
+        b->errors = (char**)realloc(b->errors, sizeof(char*) * b->lineCap);
+        if (!b->roots || !b->errors) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    char error[ERROR_CAPTURE_SIZE];
+    int tokenCount;
+    Node* root = parseLine(line, len, b->inputType, &b->tokens, &b->tokenCap, &tokenCount, error);
+    freeTokens(b->tokens, tokenCount);
+    b->errors[b->lines] = NULL;
+    if (root) {
+        root = internTree(&b->table, root);
+        ((SharedNode*)root)->refs++;
+    } else {
+        b->errors[b->lines] = strdup(error[0] ? error : "Error: Invalid expression");
+        if (!b->errors[b->lines]) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    b->roots[b->lines++] = root;
+}
+
+//Growable output line
+typedef struct {
+    char* text;
+    size_t length, capacity;
+} ShareLine;
+
+static void sharePut(ShareLine* o, const char* text, size_t len) {
+    if (o->length + len + 1 > o->capacity) {
+        o->capacity = (o->length + len + 1) * 2;
+        o->text = (char*)realloc(o->text, o->capacity);
+        if (!o->text) {
+            printf("Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    memcpy(o->text + o->length, text, len);
+    o->length += len;
+}
+
+//Appends a token and its trailing space
+static void shareToken(ShareLine* o, const char* value) {
+    sharePut(o, value, strlen(value));
+    sharePut(o, " ", 1);
+}
+
+//What renderShared is writing
+typedef struct {
+    ShareLine* o;
+    Node* root;
+    bool top;
+} ShareCursor;
+
+static void shareNext(void* ctx, Node* node, const char* text) {
+    (void)node;
+    shareToken(((ShareCursor*)ctx)->o, text);
+}
+
+static bool shareBound(void* ctx, Node* node) {
+    ShareCursor* c = (ShareCursor*)ctx;
+    SharedNode* s = (SharedNode*)node;
+    if (!s->binding || (c->top && node == c->root)) return false;
+    char name[16];
+    snprintf(name, sizeof(name), "$%d", s->binding);
+    shareToken(c->o, name);
+    return true;
+}
+
+//Renders with renderTree's walk, but a bound subtree is its $N, except
+//root itself when top is set
+static void renderShared(ShareLine* o, Node* root, int notation, bool top) {
+    ShareCursor c = {o, root, top};
+    TokenSink sink = {shareNext, shareBound, &c};
+    walkTree(root, notation, &sink);
+}
+
+//Ends a line (no trailing space, as in --stream), writes it to out if
+//there is one and returns its size
+static size_t shareFlush(ShareLine* o, FILE* out) {
+    if (o->length > 0 && o->text[o->length - 1] == ' ') o->length--;
+    o->text[o->length++] = '\n';
+    if (out) fwrite(o->text, 1, o->length, out);
+    size_t length = o->length;
+    o->length = 0;
+    return length;
+}
+
+//Writes, children first, the bindings of the shared subtrees under root
+//that are not written yet. A subtree bound while its sibling was walked
+//is skipped when it is reached again.
+static unsigned long long writeBindings(ShareLine* o, Node* root, int notation, int* bindings, FILE* out) {
+    unsigned long long bytes = 0;
+    int capacity = 0, count = 0;
+    IteratorFrame* stack = (IteratorFrame*)growArray(NULL, 0, &capacity, sizeof(IteratorFrame));
+    stack[count++] = (IteratorFrame){root, 0};
+    while (count > 0) {
+        IteratorFrame* frame = &stack[count - 1];
+        Node* node = frame->node;
+        SharedNode* s = (SharedNode*)node;
+        Node* child = NULL;
+        if (frame->step == 0) {
+            if (!node->left || s->binding) {
+                count--;
+                continue;
+            }
+            frame->step = 1;
+            child = node->left;
+        } else if (frame->step == 1) {
+            frame->step = 2;
+            child = node->right;
+        }
+        if (child) {
+            stack = (IteratorFrame*)growArray(stack, count + 1, &capacity, sizeof(IteratorFrame));
+            stack[count++] = (IteratorFrame){child, 0};
+            continue;
+        }
+        if (frame->step < 2) continue;
+        count--;
+        if (s->refs < 2) continue;
+        s->binding = ++*bindings;
+        char name[32];
+        sharePut(o, name, (size_t)snprintf(name, sizeof(name), "let $%d = ", s->binding));
+        renderShared(o, node, notation, true);
+        bytes += shareFlush(o, out);
+    }
+    free(stack);
+    return bytes;
+}
+
+//Writes (or with out NULL, only measures) every line, factored or not
+static unsigned long long writeShared(ShareBatch* b, int notation, bool factored, FILE* out, int* bindings) {
+    ShareLine o = {0};
+    unsigned long long bytes = 0;
+    *bindings = 0;
+    for (size_t i = 0; i < b->lines; i++) {
+        Node* root = b->roots[i];
+        if (!root) {
+            sharePut(&o, b->errors[i], strlen(b->errors[i]));
+        } else if (factored) {
+            bytes += writeBindings(&o, root, notation, bindings, out);
+            renderShared(&o, root, notation, ((SharedNode*)root)->binding == 0);
+        } else if (!out) {
+            bytes += renderedSize(root, notation); //Less the trailing space, plus the newline
+            continue;
+        } else {
+            renderShared(&o, root, notation, true);
+        }
+        bytes += shareFlush(&o, out);
+    }
+    //Bindings are numbered again by the next pass
+    for (int c = 0; c < b->table.chunkCount; c++) {
+        int used = c == b->table.chunkCount - 1 ? b->table.chunkUsed : SHARE_CHUNK;
+        for (int k = 0; k < used; k++) b->table.chunks[c][k].binding = 0;
+    }
+    free(o.text);
+    return bytes;
+}
+
+//Batch mode: ./Convert --share <file|-> <input_type> <output_type> [--let] [--stats]
+int convertShared(const char* path, const char* inputType, const char* outputType, bool factored, bool stats) {
+    int notation = notationOf(outputType);
+    if (notation < 0) {
+        printOutputTypeError();
+        return 1;
+    }
+    if (notationOf(inputType) < 0) {
+        printf("Error: Unknown input type\n");
+        return 1;
+    }
+    ShareBatch b;
+    memset(&b, 0, sizeof(b));
+    b.inputType = inputType;
+    double start = nowSeconds();
+    bool read = readLines(path, shareLine, &b);
+    double parsed = nowSeconds();
+
+    int bindings = 0;
+    unsigned long long failed = 0;
+    if (read) {
+        writeShared(&b, notation, factored, stdout, &bindings);
+        fflush(stdout);
+        for (size_t i = 0; i < b.lines; i++) failed += b.roots[i] == NULL;
+    }
+    if (read && stats) {
+        //Each size is measured for both forms, whichever was written
+        int plainBindings;
+        unsigned long long plain = writeShared(&b, notation, false, NULL, &plainBindings);
+        unsigned long long shared = writeShared(&b, notation, true, NULL, &bindings);
+        unsigned long long treeBytes = b.table.treeNodes * sizeof(Node);
+        unsigned long long tableBytes = b.table.count * sizeof(SharedNode) + b.table.capacity * sizeof(SharedNode*);
+        fprintf(stderr, "%zu lines, %llu errors, parsed and merged in %.3f s\n", b.lines, failed, parsed - start);
+        fprintf(stderr, "nodes: %llu parsed, %zu distinct (%.1f%%)\n", b.table.treeNodes, b.table.count,
+                b.table.treeNodes ? 100.0 * b.table.count / b.table.treeNodes : 0.0);
+        fprintf(stderr, "memory: %llu bytes as separate trees, %llu bytes shared\n", treeBytes, tableBytes);
+        fprintf(stderr, "output: %llu bytes expanded, %llu bytes with %d let bindings\n", plain, shared, bindings);
+    }
+
+    for (size_t i = 0; i < b.lines; i++) free(b.errors[i]);
+    for (int c = 0; c < b.table.chunkCount; c++) free(b.table.chunks[c]);
+    free(b.table.chunks);
+    free(b.table.slots);
+    free(b.roots);
+    free(b.errors);
+    free(b.tokens);
+    return !read || failed ? 1 : 0;
+}
+
+// ----------- MAIN Function -----------
+
+//bench_main.c includes this file with CONVERT_NO_MAIN to benchmark its kernels
+#ifndef CONVERT_NO_MAIN
+
+//Entry point for the program
+int main(int argc, char *argv[]) {
+    //Result cache: ./Convert --cache <file> <mode> ... (the mode sees the rest)
+    if (argc >= 4 && strcmp(argv[1], "--cache") == 0) {
+        if (!openCache(argv[2])) return 1;
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "--help") == 0) {
+        printf("\nFor Linux:");
+        printf("\nUsage: ./<program> \"<expression>\" <input_type> <output_type>\n");
+
+        printf("\nFor Windows:");
+        printf("\nUsage: <program.exe> \"<expression>\" <input_type> <output_type>\n");
+
+        printf("\nTypes:\n  infix\n  prefix\n  postfix\n");
+        printf("  all (output only: prints all three from one walk of the tree)\n");
+
+        printf("\nExamples:\n");
+        printf("  ./program \"a + b * c\" infix postfix\n");
+        printf("  ./program \"+ a * b c\" prefix infix\n");
+        printf("  ./program \"a b c * +\" postfix infix\n");
+        printf("  ./program \"a b c * +\" postfix all\n");
+
+        printf("\nCanonical Form:\n");
+        printf("  ./program --canonical \"<expression>\" <input_type> <output_type>\n");
+        printf("  Sorts the operands of + and * chains and prints a 128-bit fingerprint;\n");
+        printf("  equivalent inputs such as a + b and b + a give the same output.\n");
+
+        printf("\nFirst Tokens Only:\n");
+        printf("  ./program --head <count> \"<expression>\" <input_type> <output_type>\n");
+        printf("  Prints the first count output tokens; the rest are never generated.\n");
+
+        printf("\nMinimal Stack Postfix:\n");
+        printf("  ./program --stack-order \"<expression>\" <input_type>\n");
+        printf("  Postfix with the deeper operand first (Sethi-Ullman); - and / become ~- and ~/\n");
+        printf("  when swapped (\"x y ~-\" is y - x). Prints the evaluation stack depth needed.\n");
+
+        printf("\nBalanced Chains:\n");
+        printf("  ./program --balance \"<expression>\" <input_type> <output_type>\n");
+        printf("  Rebuilds chains of + and of * (a + b + c + d) as balanced trees, keeping the\n");
+        printf("  operand order; - and / are left as they are. Prints the depth before and after.\n");
+
+        printf("\nLarge Expressions (out-of-core):\n");
+        printf("  ./program --ooc <file|-> <input_type> <output_type> [mem_limit]\n");
+        printf("  Reads the expression from a file (or stdin with -) of any size.\n");
+        printf("  Stacks spill to temporary files once mem_limit (e.g. 64M) is reached.\n");
+
+        printf("\nLarge Expressions (parallel):\n");
+        printf("  ./program --parallel <file|-> <input_type> <output_type> [threads] [--balance]\n");
+        printf("  Parses one expression on several threads (default: one per core).\n");
+        printf("  ./program --bench-parse <file> <input_type> [max_threads]\n");
+        printf("  Compares the sequential and parallel builders on one expression.\n");
+        printf("  ./program --bench-emit <file> <input_type> <output_type> [max_threads]\n");
+        printf("  Compares printf output with the parallel renderer (timings on stderr).\n");
+        printf("  ./program --bench-render [max_tokens] > /dev/null\n");
+        printf("  Compares printf output with single-buffer output for 10^3.. tokens.\n");
+
+        printf("  ./program --gather <file|-> <input_type> <output_type> [--stats]\n");
+        printf("  Writes the result as an iovec list pointing into the input (vmsplice or writev).\n");
+
+        printf("  ./program --perf <file|-> <input_type> <output_type> [runs]\n");
+        printf("  Cycles, instructions, cache and branch misses per phase (tokenize, validate,\n");
+        printf("  build, emit, free) and per token, from Linux perf_event_open counters.\n");
+
+        printf("\nValidation only:\n");
+        printf("  ./program --validate <file|-> <prefix|postfix>\n");
+        printf("  Checks one expression per line and reports the first failing token.\n");
+
+        printf("\nMany Expressions (streaming):\n");
+        printf("  ./program --stream <file|-> <input_type> <output_type> [--stats] [--gzip|--zstd] [--balance]\n");
+        printf("  Converts one expression per line; each output line is the result or its error.\n");
+        printf("  Reading, parsing, rendering and writing run as a pipeline on four threads;\n");
+        printf("  --stats prints the fill level of each stage queue to stderr.\n");
+        printf("  gzip or zstd input is detected and decompressed; --gzip/--zstd compress the output.\n");
+        printf("  --stats also prints latency histograms and error counts as JSON; in --stream,\n");
+        printf("  --push and --schedule, kill -USR1 <pid> prints them while the conversion runs.\n");
+
+        printf("  ./program --schedule <file|-> <input_type> <output_type> [threads] [huge_tokens]\n");
+        printf("  Same output; small lines are converted in batches per thread, lines with at\n");
+        printf("  least huge_tokens tokens (default 100000) on all threads. Per-size latency on stderr.\n");
+
+        printf("  ./program --push <file|-> <input_type> <output_type> [chunk_bytes]\n");
+        printf("  Same output, fed to the incremental parser in chunks (default 4096 bytes)\n");
+        printf("  the way a network service would receive it.\n");
+
+        printf("  ./program --profile <file|-> <input_type>\n");
+        printf("  One pass over the lines with bounded memory: JSON quantiles of line size, tokens,\n");
+        printf("  depth, operand length and nesting, operator mix, lean, and distinct operands\n");
+        printf("  and subtrees (HyperLogLog estimates).\n");
+
+        printf("  ./program --share <file|-> <input_type> <output_type> [--let] [--stats]\n");
+        printf("  Same output, with equal subtrees of all lines stored once; --let writes each\n");
+        printf("  repeated subtree once as \"let $N = ...\" and refers to it as $N. --stats\n");
+        printf("  compares node memory and output size with and without sharing.\n");
+
+        printf("  ./program --index-build <file|-> <input_type> <output_type> <indexed_file>\n");
+        printf("  Writes the results with an offset table for random access.\n");
+        printf("  ./program --index-get <indexed_file> <line> [count]\n");
+        printf("  Prints the results for input lines line.. without reading the rest.\n");
+
+        printf("\nMany Small Files:\n");
+        printf("  ./program --bulk-dir <dir|list> <input_type> <output_type> <out_dir> [uring|blocking|compare] [threads]\n");
+        printf("  Converts one expression per file into out_dir (same file names).\n");
+        printf("  Uses io_uring when available, else a pool of blocking threads; compare times both.\n");
+
+        printf("\nResult Cache:\n");
+        printf("  ./program --cache <file> --stream|--schedule|--bulk-dir ...\n");
+        printf("  Looks every expression up in a memory-mapped file before parsing it and adds new\n");
+        printf("  results; later runs (and other processes) reuse them. Hit rate on stderr.\n");
+        printf("  ./program --cache-compact <file> [max_MB]\n");
+        printf("  Keeps the most recently used results (done by itself when the file is full).\n");
+
+        printf("\nErrors and Format Rules:\n");
+
+        printf("\n[ General Errors ]\n");
+        printf("  - Error: No valid tokens found\n");
+        printf("    ---> Make sure your expression has valid operands/operators separated by spaces.\n");
+        printf("  - Error: Invalid token '<token>'\n");
+        printf("    ---> Expression contains an invalid character or unrecognized symbol.\n");
+        printf("  - Error: Unknown output type\n");
+        printf("    ---> The third argument must be one of: infix, prefix, postfix\n");
+
+        printf("\n[ Infix Expression Rules ]\n");
+        printf("  - Must be properly parenthesized if necessary (e.g., ( a + b ) * c)\n");
+        printf("  - Operators: + - * /\n");
+        printf("  - Operands must be alphanumeric (e.g., a, b1, X99)\n");
+        printf("  - Error: Infix expression cannot start or end with an operator\n");
+        printf("  - Error: Unbalanced parentheses\n");
+        printf("  - Error: Too few operands for operator '+' or other operator\n");
+        printf("  - Error: Too many operands\n");
+
+        printf("\n[ Prefix Expression Rules ]\n");
+        printf("  - Format: <operator> <operand1> <operand2> [...]\n");
+        printf("  - Each operator must have exactly two operands\n");
+        printf("  - Error: Invalid prefix expression format\n");
+        printf("    ---> Too many or too few operands for the given operators\n");
+
+        printf("\n[ Postfix Expression Rules ]\n");
+        printf("  - Format: <operand1> <operand2> <operator>\n");
+        printf("  - Each operator must apply to the two previous operands\n");
+        printf("  - Error: Invalid postfix expression format\n");
+        printf("    ---> Too many or too few operands for the given operators\n");
+
+        printf("\nHelpful Tip:\n");
+        printf("  All expressions must be space-separated.\n");
+        printf("  Use double quotes around expressions to avoid shell issues.\n");
+
+        printf("\n");
+        return 0;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "--guide") == 0) {
+        printf("\nFor Linux:");
+        printf("\nUsage: ./<program> \"<expression>\" <input_type> <output_type>\n");
+
+        printf("\nFor Windows:");
+        printf("\nUsage: <program.exe> \"<expression>\" <input_type> <output_type>\n");
+
+        printf("\nTypes:\n  infix\n  prefix\n  postfix\n");
+        printf("\nExample: ./Convert \"a + b * c\" infix postfix\n");
+        printf("\nExample: Convert.exe \"a + b * c\" infix postfix\n\n");
+        return 0;
+    }
+
+    //Canonical mode: ./Convert --canonical "<expression>" <input_type> <output_type>
+    if (argc == 5 && strcmp(argv[1], "--canonical") == 0) {
+        return convertCanonical(argv[2], argv[3], argv[4]);
+    }
+
+    //First tokens only: ./Convert --head <count> "<expression>" <input_type> <output_type>
+    if (argc == 6 && strcmp(argv[1], "--head") == 0) {
+        return convertHead(argv[3], argv[4], argv[5], atoll(argv[2]));
+    }
+
+    //Stack-order postfix: ./Convert --stack-order "<expression>" <input_type>
+    if (argc == 4 && strcmp(argv[1], "--stack-order") == 0) {
+        return convertStackOrder(argv[2], argv[3]);
+    }
+
+    //Balanced chains: ./Convert --balance "<expression>" <input_type> <output_type>
+    if (argc == 5 && strcmp(argv[1], "--balance") == 0) {
+        return convertBalanced(argv[2], argv[3], argv[4]);
+    }
+
+    //Out-of-core mode: ./Convert --ooc <file|-> <input_type> <output_type> [mem_limit]
+    if ((argc == 5 || argc == 6) && strcmp(argv[1], "--ooc") == 0) {
+        long long memLimit = argc == 6 ? parseMemLimit(argv[5]) : OOC_DEFAULT_LIMIT;
+        return convertOutOfCore(argv[2], argv[3], argv[4], memLimit);
+    }
+
+    //Parallel mode: ./Convert --parallel <file|-> <input_type> <output_type> [threads] [--balance]
+    if (argc >= 5 && argc <= 7 && strcmp(argv[1], "--parallel") == 0) {
+        bool balance = strcmp(argv[argc - 1], "--balance") == 0;
+        int last = balance ? argc - 1 : argc;
+        if (last == 7) {
+            printf("Error: Unknown option '%s'\n", argv[6]);
+            return 1;
+        }
+        int threads = last == 6 ? atoi(argv[5]) : defaultThreads();
+        return convertParallel(argv[2], argv[3], argv[4], threads, balance);
+    }
+
+    //Emit benchmark: ./Convert --bench-emit <file> <input_type> <output_type> [max_threads]
+    if ((argc == 5 || argc == 6) && strcmp(argv[1], "--bench-emit") == 0) {
+        return benchEmit(argv[2], argv[3], argv[4], argc == 6 ? atoi(argv[5]) : defaultThreads());
+    }
+
+    //Validate-only mode: ./Convert --validate <file|-> <prefix|postfix>
+    if (argc == 4 && strcmp(argv[1], "--validate") == 0) {
+        return validateCorpus(argv[2], argv[3]);
+    }
+
+    //Streaming mode: ./Convert --stream <file|-> <input_type> <output_type> [--stats] [--gzip|--zstd] [--balance]
+    if (argc >= 5 && argc <= 8 && strcmp(argv[1], "--stream") == 0) {
+        bool stats = false, balance = false;
+        int codec = CODEC_NONE;
+        for (int i = 5; i < argc; i++) {
+            if (strcmp(argv[i], "--stats") == 0) {
+                stats = true;
+            } else if (strcmp(argv[i], "--balance") == 0) {
+                balance = true;
+            } else if (strcmp(argv[i], "--gzip") == 0 || strcmp(argv[i], "--zstd") == 0) {
+                codec = codecOf(argv[i] + 2);
+                if (codec < 0) {
+                    printf("Error: %s output is not compiled in; build with -DCONVERT_WITH_%s\n",
+                           argv[i] + 2, strcmp(argv[i], "--gzip") == 0 ? "ZLIB -lz" : "ZSTD -lzstd");
+                    return 1;
+                }
+            } else {
+                printf("Error: Unknown option '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        return convertStream(argv[2], argv[3], argv[4], codec, balance, stats);
+    }
+
+    //Gather mode: ./Convert --gather <file|-> <input_type> <output_type> [--stats]
+    if ((argc == 5 || (argc == 6 && strcmp(argv[5], "--stats") == 0)) && strcmp(argv[1], "--gather") == 0) {
+        return convertGathered(argv[2], argv[3], argv[4], argc == 6);
+    }
+
+    //Counter mode: ./Convert --perf <file|-> <input_type> <output_type> [runs]
+    if ((argc == 5 || argc == 6) && strcmp(argv[1], "--perf") == 0) {
+        return convertWithCounters(argv[2], argv[3], argv[4], argc == 6 ? atoi(argv[5]) : 5);
+    }
+
+    //Push-parser mode: ./Convert --push <file|-> <input_type> <output_type> [chunk_bytes]
+    if ((argc == 5 || argc == 6) && strcmp(argv[1], "--push") == 0) {
+        return convertPushed(argv[2], argv[3], argv[4], argc == 6 ? (size_t)atol(argv[5]) : 4096);
+    }
+
+    //Profile mode: ./Convert --profile <file|-> <input_type>
+    if (argc == 4 && strcmp(argv[1], "--profile") == 0) {
+        return profileCorpus(argv[2], argv[3]);
+    }
+
+    //Shared batch mode: ./Convert --share <file|-> <input_type> <output_type> [--let] [--stats]
+    if (argc >= 5 && argc <= 7 && strcmp(argv[1], "--share") == 0) {
+        bool factored = false, stats = false;
+        for (int i = 5; i < argc; i++) {
+            if (strcmp(argv[i], "--let") == 0) {
+                factored = true;
+            } else if (strcmp(argv[i], "--stats") == 0) {
+                stats = true;
+            } else {
+                printf("Error: Unknown option '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        return convertShared(argv[2], argv[3], argv[4], factored, stats);
+    }
+
+    //Cache compaction: ./Convert --cache-compact <file> [max_MB]
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--cache-compact") == 0) {
+        return compactCacheFile(argv[2], argc == 4 ? atoll(argv[3]) : 0);
+    }
+
+    //Bulk mode: ./Convert --bulk-dir <dir|list> <input_type> <output_type> <out_dir> [uring|blocking|compare] [threads]
+    if (argc >= 6 && argc <= 8 && strcmp(argv[1], "--bulk-dir") == 0) {
+        return convertBulk(argv[2], argv[3], argv[4], argv[5], argc >= 7 ? argv[6] : "uring",
+                           argc == 8 ? atoi(argv[7]) : defaultThreads());
+    }
+
+    //Indexed output: ./Convert --index-build <file|-> <input_type> <output_type> <indexed_file>
+    if (argc == 6 && strcmp(argv[1], "--index-build") == 0) {
+        return buildIndexedOutput(argv[2], argv[3], argv[4], argv[5]);
+    }
+
+    //Indexed lookup: ./Convert --index-get <indexed_file> <line> [count]
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "--index-get") == 0) {
+        return lookupIndexed(argv[2], atoll(argv[3]), argc == 5 ? atoll(argv[4]) : 1);
+    }
+
+    //Scheduled mode: ./Convert --schedule <file|-> <input_type> <output_type> [threads] [huge_tokens]
+    if (argc >= 5 && argc <= 7 && strcmp(argv[1], "--schedule") == 0) {
+        return convertScheduled(argv[2], argv[3], argv[4], argc >= 6 ? atoi(argv[5]) : defaultThreads(),
+                                argc == 7 ? atoll(argv[6]) : SCHED_HUGE_TOKENS);
+    }
+
+    //Output benchmark: ./Convert --bench-render [max_tokens] > /dev/null
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--bench-render") == 0) {
+        return benchRender(argc == 3 ? atoll(argv[2]) : 10000000LL);
+    }
+
+    //Parse benchmark: ./Convert --bench-parse <file> <input_type> [max_threads]
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "--bench-parse") == 0) {
+        return benchParse(argv[2], argv[3], argc == 5 ? atoi(argv[4]) : defaultThreads());
+    }
+
+    if (argc != 4) {
+        printf("\nHi, To convert a Notation please Enter \"--guide\" or \"--help\".\n");
+        printf("\nFor Linux:");
+        printf("\n\tUsage: ./<program_name> \"--help\".\n");
+        printf("\t\t---> For user error and format rules\n");
+        printf("\tUsage: ./<program_name> \"--guide\".\n");
+        printf("\t\t---> How to run this program\n");
+
+        printf("\nFor Windows:");
+        printf("\n\tUsage: <program_name.exe> \"--help\".\n");
+        printf("\t\t---> For user error and format rules\n");
+        printf("\tUsage: <program_name.exe> \"--guide\".\n");
+        printf("\t\t---> How to run this program\n");
+
+        printf("\nHelpful Tip:\n");
+        printf("\n\tRead the help and guide first to properly run this program. Thank you!!\n");
+        return 1;
+    }
+
+    char input[256];
+    strncpy(input, argv[1], sizeof(input) - 1);
+    input[sizeof(input) - 1] = '\0';
+
+    const char* inputType = argv[2];
+    const char* outputType = argv[3];
+    Token tokens[100];
+    int tokenCount;
+
+    Node* root = parseExpression(input, inputType, tokens, 100, &tokenCount);
+    if (!root) return 1;
+
+    //Output conversion based on user's choice
+    bool printed = printExpression(root, outputType);
+
+    // Cleanup
+    freeTree(root);
+    freeTokens(tokens, tokenCount);
+    return printed ? 0 : 1;
+}
+#endif
@@ -0,0 +1,479 @@
+//MICROBENCHMARKS FOR THE HOT KERNELS OF Convert.c
+//
+//Separate build target; it compiles Convert.c in with its main() left out:
+//    gcc -O2 -o bench bench_main.c -lpthread
+//    ./bench [--filter <kernel>] [--samples N] [--max-tokens N] > results.jsonl
+//
+//Every kernel is run on trees of several sizes and shapes. Each result is
+//one JSON object per line on stdout; a readable table goes to stderr.
+
+#define CONVERT_NO_MAIN
+#include "Convert.c"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#endif
+
+#define BENCH_SAMPLES 31             //Timed samples per kernel, size and shape
+#define BENCH_SAMPLE_NS 1000000.0    //Each sample runs the kernel for about 1 ms
+#define BENCH_WARMUP_NS 50000000.0   //Untimed runs before the samples (50 ms)
+#define BENCH_NEST_DEPTH 40          //Operands per nested group
+
+//Results are added here so the compiler cannot drop a kernel's work
+volatile size_t benchSink;
+
+//One generated expression in every form the kernels take
+typedef struct {
+    const char* shape;
+    int tokens;
+    Node* tree;
+    char* text[3];          //The expression in each notation, NUL-terminated
+    size_t textLen[3];
+    char* scratch;          //Copy for kernels that modify their input
+    Token* prefixTokens;
+    Token* postfixTokens;
+    Token* scratchTokens;
+    Node** nodes;           //Operands for the stack kernel
+    char* out;              //Render buffer, room for all three notations
+    size_t slice;           //Room for one notation in out
+} BenchInput;
+
+typedef struct {
+    const char* name;
+    void (*run)(BenchInput* in);
+    bool printsToStdout;    //Timed with stdout sent to /dev/null
+} Kernel;
+
+// ----------- Timing -----------
+
+//Monotonic clock in nanoseconds; RAW is not slewed by NTP
+static double benchNow(void) {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//Keeps the benchmark on one CPU so samples are not split across cores
+//with different clocks and caches
+static void pinToCpu(void) {
+#ifdef __linux__
+    cpu_set_t set;
+    int cpu = sched_getcpu();
+    if (cpu < 0) return;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
+
+//Busy work until the clock governor has raised the core to a steady speed
+static void spinUp(double ns) {
+    double end = benchNow() + ns;
+    size_t x = 1;
+    while (benchNow() < end) {
+        for (int i = 0; i < 10000; i++) x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    benchSink += x;
+}
+
+static int compareNs(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// ----------- Inputs -----------
+
+//Left-deep chain a + b - c + ... of + and -, so the infix form needs no
+//parentheses and postfix keeps only two operands on the stack
+static Node* leftDeepTree(int operands) {
+    static const char* names[] = {"a", "b1", "x", "X99", "42", "count", "y7", "z"};
+    Node* root = createNode(names[0]);
+    for (int i = 1; i < operands; i++) {
+        Node* op = createNode(i % 2 ? "+" : "-");
+        op->left = root;
+        op->right = createNode(names[i % 8]);
+        root = op;
+    }
+    return root;
+}
+
+//Groups of BENCH_NEST_DEPTH operands nested to the right,
+//"( a * ( b1 + ( x - ... ) ) )", joined by + and - at the top level, so
+//parentheses nest deep and unwind often
+static char* nestedText(int operands, size_t* length) {
+    static const char* names[] = {"a", "b1", "x", "X99", "42", "count", "y7", "z"};
+    static const char ops[] = "*+-/";
+    char* text = (char*)malloc((size_t)operands * 16 + 1); //"( count * " and " )" and " + "
+    if (!text) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    char* p = text;
+    for (int i = 0; i < operands; i += BENCH_NEST_DEPTH) {
+        int group = operands - i < BENCH_NEST_DEPTH ? operands - i : BENCH_NEST_DEPTH;
+        if (i > 0) p += sprintf(p, " %c ", (i / BENCH_NEST_DEPTH) % 2 ? '+' : '-');
+        for (int j = 0; j < group - 1; j++) p += sprintf(p, "( %s %c ", names[(i + j) % 8], ops[j % 4]);
+        p += sprintf(p, "%s", names[(i + group - 1) % 8]);
+        for (int j = 0; j < group - 1; j++) p += sprintf(p, " )");
+    }
+    *length = (size_t)(p - text);
+    return text;
+}
+
+//Copies a tree with explicit stacks, so a left-deep chain of any length
+//copies like a balanced tree
+static Node* copyTree(Node* root) {
+    Stack from, to;         //Nodes whose children are still to copy, and their copies
+    initStack(&from);
+    initStack(&to);
+    Node* copy = createNode(root->value);
+    push(&from, root);
+    push(&to, copy);
+    while (!isEmpty(&from)) {
+        Node* source = pop(&from);
+        Node* node = pop(&to);
+        if (source->left) {
+            node->left = createNode(source->left->value);
+            push(&from, source->left);
+            push(&to, node->left);
+        }
+        if (source->right) {
+            node->right = createNode(source->right->value);
+            push(&from, source->right);
+            push(&to, node->right);
+        }
+    }
+    freeStack(&from);
+    freeStack(&to);
+    return copy;
+}
+
+//Renders a notation as a NUL-terminated string without the trailing space
+static char* renderText(Node* root, int notation, size_t* length) {
+    char* text = (char*)malloc(renderedSize(root, notation) + 1);
+    if (!text) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    char* end = renderTree(root, notation, text);
+    if (end > text && end[-1] == ' ') end--;
+    *end = '\0';
+    *length = (size_t)(end - text);
+    return text;
+}
+
+//Splits a copy of text into tokens that stay valid with the input
+static Token* tokensOf(const char* text, size_t length, int count) {
+    char* copy = (char*)malloc(length + 1);
+    Token* tokens = (Token*)malloc(sizeof(Token) * (size_t)count);
+    if (!copy || !tokens) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    memcpy(copy, text, length + 1);
+    char* save;
+    int i = 0;
+    for (char* tok = strtok_r(copy, " ", &save); tok && i < count; tok = strtok_r(NULL, " ", &save)) {
+        tokens[i].value = tok;
+        tokens[i++].isOperator = isOperator(tok);
+    }
+    return tokens;
+}
+
+static void initInput(BenchInput* in, const char* shape, int tokens) {
+    memset(in, 0, sizeof(*in));
+    in->shape = shape;
+    in->tokens = tokens;
+    srand(1);
+    if (strcmp(shape, "nested") == 0) {
+        //The nested text is the input; the other notations come from its tree
+        size_t length;
+        char* text = nestedText((tokens + 1) / 2, &length);
+        in->tree = buildTreeFromInfixPratt(text);
+        for (int n = NOTATION_PREFIX; n <= NOTATION_POSTFIX; n++) {
+            in->text[n] = n == NOTATION_INFIX ? text : renderText(in->tree, n, &in->textLen[n]);
+        }
+        in->textLen[NOTATION_INFIX] = length;
+    } else {
+        in->tree = strcmp(shape, "balanced") == 0 ? randomTree((tokens + 1) / 2) : leftDeepTree((tokens + 1) / 2);
+        for (int n = NOTATION_PREFIX; n <= NOTATION_POSTFIX; n++) {
+            in->text[n] = renderText(in->tree, n, &in->textLen[n]);
+        }
+    }
+    in->slice = renderedSize(in->tree, NOTATION_INFIX) + 1; //The longest notation
+    //The left-deep infix text is the flat chain; the parser rebuilds the same tree
+    if (strcmp(shape, "left") == 0) {
+        char* flat = in->text[NOTATION_INFIX];
+        size_t j = 0;
+        for (size_t i = 0; i < in->textLen[NOTATION_INFIX]; i++) {
+            if (flat[i] == '(' || flat[i] == ')') i++; //The bracket and its space
+            else flat[j++] = flat[i];
+        }
+        while (j > 0 && flat[j - 1] == ' ') j--;
+        flat[j] = '\0';
+        in->textLen[NOTATION_INFIX] = j;
+    }
+    in->prefixTokens = tokensOf(in->text[NOTATION_PREFIX], in->textLen[NOTATION_PREFIX], tokens);
+    in->postfixTokens = tokensOf(in->text[NOTATION_POSTFIX], in->textLen[NOTATION_POSTFIX], tokens);
+    in->scratch = (char*)malloc(in->slice);
+    in->scratchTokens = (Token*)malloc(sizeof(Token) * (size_t)tokens);
+    in->nodes = (Node**)malloc(sizeof(Node*) * (size_t)tokens);
+    in->out = (char*)malloc(3 * in->slice);
+    if (!in->scratch || !in->scratchTokens || !in->nodes || !in->out) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < tokens; i++) in->nodes[i] = in->tree;
+}
+
+static void freeInput(BenchInput* in) {
+    freeTree(in->tree);
+    for (int n = NOTATION_PREFIX; n <= NOTATION_POSTFIX; n++) free(in->text[n]);
+    free(in->prefixTokens[0].value); //The tokens point into one copy
+    free(in->postfixTokens[0].value);
+    free(in->prefixTokens);
+    free(in->postfixTokens);
+    free(in->scratch);
+    free(in->scratchTokens);
+    free(in->nodes);
+    free(in->out);
+}
+
+// ----------- Kernels -----------
+
+//tokenize destroys its input, so each run restores it from the original
+static void runTokenize(BenchInput* in) {
+    memcpy(in->scratch, in->text[NOTATION_PREFIX], in->textLen[NOTATION_PREFIX] + 1);
+    int count = tokenize(in->scratch, in->scratchTokens, in->tokens);
+    benchSink += (size_t)count;
+    freeTokens(in->scratchTokens, count);
+}
+
+static void runIsOperator(BenchInput* in) {
+    for (int i = 0; i < in->tokens; i++) benchSink += isOperator(in->prefixTokens[i].value);
+}
+
+static void runIsOperand(BenchInput* in) {
+    for (int i = 0; i < in->tokens; i++) benchSink += isOperand(in->prefixTokens[i].value);
+}
+
+static void runIsValidToken(BenchInput* in) {
+    for (int i = 0; i < in->tokens; i++) benchSink += isValidToken(in->prefixTokens[i].value);
+}
+
+static void runPrecedence(BenchInput* in) {
+    for (int i = 0; i < in->tokens; i++) benchSink += (size_t)precedence(in->prefixTokens[i].value[0]);
+}
+
+//One push and one pop per token, in runs that fit the inline slots
+static void runPushPop(BenchInput* in) {
+    Stack s;
+    initStack(&s);
+    for (int i = 0; i < in->tokens; i += MAX - 1) {
+        int run = in->tokens - i < MAX - 1 ? in->tokens - i : MAX - 1;
+        for (int j = 0; j < run; j++) push(&s, in->nodes[i + j]);
+        for (int j = 0; j < run; j++) benchSink += (size_t)pop(&s)->value[0];
+    }
+}
+
+static void runCreateFree(BenchInput* in) {
+    Node* copy = copyTree(in->tree);
+    benchSink += (size_t)copy->value[0];
+    freeTree(copy);
+}
+
+static void runValidatePrefix(BenchInput* in) {
+    benchSink += (size_t)validatePrefix(in->prefixTokens, in->tokens);
+}
+
+static void runValidatePostfix(BenchInput* in) {
+    benchSink += (size_t)validatePostfix(in->postfixTokens, in->tokens);
+}
+
+static void runBuildPrefix(BenchInput* in) {
+    int index = 0;
+    Node* root = buildTreeFromPrefix(in->prefixTokens, &index, in->tokens);
+    benchSink += (size_t)index;
+    freeTree(root);
+}
+
+static void runBuildPostfix(BenchInput* in) {
+    Node* root = buildTreeFromPostfix(in->postfixTokens, in->tokens);
+    benchSink += (size_t)root->value[0];
+    freeTree(root);
+}
+
+static void runBuildInfix(BenchInput* in) {
+    Node* root = buildTreeFromInfix(in->text[NOTATION_INFIX]);
+    benchSink += (size_t)root->value[0];
+    freeTree(root);
+}
+
+static void runBuildInfixPratt(BenchInput* in) {
+    Node* root = buildTreeFromInfixPratt(in->text[NOTATION_INFIX]);
+    benchSink += (size_t)root->value[0];
+    freeTree(root);
+}
+
+static void runRenderedSize(BenchInput* in) {
+    benchSink += renderedSize(in->tree, NOTATION_INFIX);
+}
+
+static void runRenderPrefix(BenchInput* in) {
+    benchSink += (size_t)(renderTree(in->tree, NOTATION_PREFIX, in->out) - in->out);
+}
+
+static void runRenderInfix(BenchInput* in) {
+    benchSink += (size_t)(renderTree(in->tree, NOTATION_INFIX, in->out) - in->out);
+}
+
+static void runRenderPostfix(BenchInput* in) {
+    benchSink += (size_t)(renderTree(in->tree, NOTATION_POSTFIX, in->out) - in->out);
+}
+
+static void runRenderAll(BenchInput* in) {
+    char* prefix = in->out;
+    char* infix = prefix + in->slice;
+    char* postfix = infix + in->slice;
+    renderAll(in->tree, &prefix, &infix, &postfix);
+    benchSink += (size_t)(postfix - in->out);
+}
+
+static void runPreorder(BenchInput* in) {
+    printTraversal(in->tree, NOTATION_PREFIX);
+    fflush(stdout);
+}
+
+static void runInorder(BenchInput* in) {
+    printTraversal(in->tree, NOTATION_INFIX);
+    fflush(stdout);
+}
+
+static void runPostorder(BenchInput* in) {
+    printTraversal(in->tree, NOTATION_POSTFIX);
+    fflush(stdout);
+}
+
+static const Kernel kernels[] = {
+    {"tokenize", runTokenize, false},
+    {"isOperator", runIsOperator, false},
+    {"isOperand", runIsOperand, false},
+    {"isValidToken", runIsValidToken, false},
+    {"precedence", runPrecedence, false},
+    {"push_pop", runPushPop, false},
+    {"createNode_freeTree", runCreateFree, false},
+    {"validatePrefix", runValidatePrefix, false},
+    {"validatePostfix", runValidatePostfix, false},
+    {"buildTreeFromPrefix", runBuildPrefix, false},
+    {"buildTreeFromPostfix", runBuildPostfix, false},
+    {"buildTreeFromInfix", runBuildInfix, false},
+    {"buildTreeFromInfixPratt", runBuildInfixPratt, false},
+    {"renderedSize", runRenderedSize, false},
+    {"renderTree_prefix", runRenderPrefix, false},
+    {"renderTree_infix", runRenderInfix, false},
+    {"renderTree_postfix", runRenderPostfix, false},
+    {"renderAll", runRenderAll, false},
+    {"preorder_printf", runPreorder, true},
+    {"inorder_printf", runInorder, true},
+    {"postorder_printf", runPostorder, true},
+};
+
+// ----------- Runner -----------
+
+//Times one kernel on one input: warmup, then samples of enough runs to
+//last about BENCH_SAMPLE_NS each. Prints a JSON line and a table row.
+static void measure(const Kernel* kernel, BenchInput* in, int samples) {
+    int savedStdout = -1;
+    if (kernel->printsToStdout) {
+        fflush(stdout);
+        savedStdout = dup(1);
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, 1);
+        close(devNull);
+    }
+
+    //Warm up and find how many runs fill one sample
+    long long iterations = 1;
+    double start = benchNow(), elapsed = 0;
+    for (;;) {
+        double begin = benchNow();
+        for (long long i = 0; i < iterations; i++) kernel->run(in);
+        elapsed = benchNow() - begin;
+        if (elapsed >= BENCH_SAMPLE_NS && benchNow() - start >= BENCH_WARMUP_NS) break;
+        if (elapsed < BENCH_SAMPLE_NS) iterations *= 2;
+    }
+
+    double* ns = (double*)malloc(sizeof(double) * (size_t)samples);
+    double* deviation = (double*)malloc(sizeof(double) * (size_t)samples);
+    if (!ns || !deviation) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    for (int s = 0; s < samples; s++) {
+        double begin = benchNow();
+        for (long long i = 0; i < iterations; i++) kernel->run(in);
+        ns[s] = (benchNow() - begin) / (double)iterations;
+    }
+    if (kernel->printsToStdout) {
+        fflush(stdout);
+        dup2(savedStdout, 1);
+        close(savedStdout);
+    }
+
+    qsort(ns, (size_t)samples, sizeof(double), compareNs);
+    double median = ns[samples / 2];
+    for (int s = 0; s < samples; s++) deviation[s] = ns[s] > median ? ns[s] - median : median - ns[s];
+    qsort(deviation, (size_t)samples, sizeof(double), compareNs);
+    double mad = deviation[samples / 2];
+    //A few dozen samples hold no p99, so the slowest one stands for the tail
+    double max = ns[samples - 1];
+
+    printf("{\"kernel\":\"%s\",\"shape\":\"%s\",\"tokens\":%d,\"iterations\":%lld,\"samples\":%d,"
+           "\"median_ns\":%.1f,\"mad_ns\":%.1f,\"min_ns\":%.1f,\"max_ns\":%.1f,\"ns_per_token\":%.3f}\n",
+           kernel->name, in->shape, in->tokens, iterations, samples, median, mad, ns[0], max,
+           median / in->tokens);
+    fflush(stdout);
+    fprintf(stderr, "%-23s %-9s %8d %14.1f %10.1f %14.1f %10.3f\n", kernel->name, in->shape, in->tokens,
+            median, mad, max, median / in->tokens);
+    free(ns);
+    free(deviation);
+}
+
+int main(int argc, char* argv[]) {
+    const char* filter = NULL;
+    int samples = BENCH_SAMPLES;
+    int maxTokens = 65535;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) filter = argv[++i];
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) samples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-tokens") == 0 && i + 1 < argc) maxTokens = atoi(argv[++i]);
+        else {
+            printf("Usage: %s [--filter <kernel>] [--samples N] [--max-tokens N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (samples < 3) samples = 3;
+
+    pinToCpu();
+    spinUp(300e6);
+    fprintf(stderr, "%-23s %-9s %8s %14s %10s %14s %10s\n", "kernel", "shape", "tokens", "median ns",
+            "MAD ns", "max ns", "ns/token");
+
+    static const char* shapes[] = {"balanced", "left", "nested"};
+    for (int shape = 0; shape < 3; shape++) {
+        for (int tokens = 15; tokens <= maxTokens; tokens = tokens * 16 + 15) {
+            BenchInput in;
+            initInput(&in, shapes[shape], tokens);
+            for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+                if (filter && !strstr(kernels[k].name, filter)) continue;
+                measure(&kernels[k], &in, samples);
+            }
+            freeInput(&in);
+        }
+    }
+    return benchSink == 42 ? 1 : 0;
+}
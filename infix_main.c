@@ -1,265 +1,465 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include <stdbool.h>
-
-
-#define MAX 100
-
-// ===============================
-// Node for the Expression Tree
-// ===============================
-typedef struct Node {
-    char value[10];         // The operator or operand value (e.g., "+", "a", "42")
-    struct Node* left;      // Left child
-    struct Node* right;     // Right child
-} Node;
-
-// ===============================
-// Stack for Nodes
-// ===============================
-typedef struct Stack {
-    Node* data[MAX];        // Array to hold stack elements
-    int top;                // Index of the top element
-} Stack;
-
-// Initialize the stack
-void initStack(Stack* s) { s->top = -1; }
-
-// Check if the stack is empty
-bool isEmpty(Stack* s) { return s->top == -1; }
-
-// Push a node onto the stack
-void push(Stack* s, Node* node) {
-    if (s->top >= MAX - 1) {
-        printf("Error: Stack overflow\n");
-        exit(1);
-    }
-    s->data[++(s->top)] = node;
-}
-
-// Pop a node from the stack
-Node* pop(Stack* s) {
-    if (isEmpty(s)) {
-        printf("Error: Stack underflow\n");
-        exit(1);
-    }
-    return s->data[(s->top)--];
-}
-
-// Peek at the top node without popping
-Node* peek(Stack* s) {
-    return isEmpty(s) ? NULL : s->data[s->top];
-}
-
-// Create a new node with a given value
-Node* createNode(const char* val) {
-    Node* node = (Node*)malloc(sizeof(Node));
-    if (!node) {
-        printf("Error: Memory allocation failed\n");
-        exit(1);
-    }
-    strcpy(node->value, val);
-    node->left = node->right = NULL;
-    return node;
-}
-
-// ===============================
-// Helper Functions for Parsing
-// ===============================
-
-// Check if token is an operator
-bool isOperator(const char* token) {
-    return strlen(token) == 1 && strchr("+-*/", token[0]);
-}
-
-// Check if token is an operand (variable or number)
-bool isOperand(const char* token) {
-    for (int i = 0; token[i]; i++) {
-        if (!isalnum(token[i])) return false;
-    }
-    return strlen(token) > 0;
-}
-
-// Check if token is valid (operator or operand)
-bool isValidToken(const char* token) {
-    return isOperand(token) || isOperator(token);
-}
-
-// Get precedence of operators
-int precedence(char op) {
-    if (op == '+' || op == '-') return 1;
-    if (op == '*' || op == '/') return 2;
-    return 0;
-}
-
-// =====================================
-// Build Expression Tree from Infix
-// =====================================
-Node* buildTreeFromInfix(const char* expr) {
-    Stack ops, nodes;
-    initStack(&ops);
-    initStack(&nodes);
-
-    // Make a copy of the input expression to tokenize
-    char exprCopy[256];
-    strncpy(exprCopy, expr, sizeof(exprCopy) - 1);
-    exprCopy[sizeof(exprCopy) - 1] = '\0';
-
-    char* tok = strtok(exprCopy, " ");
-    while (tok) {
-        // Validate token
-        if (!isValidToken(tok) && strcmp(tok, "(") != 0 && strcmp(tok, ")") != 0) {
-            printf("Error: Invalid token '%s'\n", tok);
-            return NULL;
-        }
-
-        if (isOperand(tok)) {
-            // Operand: create node and push to nodes stack
-            push(&nodes, createNode(tok));
-        } else if (strcmp(tok, "(") == 0) {
-            // Left parenthesis: push to ops stack
-            push(&ops, createNode(tok));
-        } else if (strcmp(tok, ")") == 0) {
-            // Right parenthesis: pop until matching "("
-            while (!isEmpty(&ops) && strcmp(peek(&ops)->value, "(") != 0) {
-                Node* op = pop(&ops);
-                Node* right = pop(&nodes);
-                Node* left = pop(&nodes);
-                if (!left || !right) {
-                    printf("Error: Stack underflow\n");
-                    return NULL;
-                }
-                op->left = left;
-                op->right = right;
-                push(&nodes, op);
-            }
-            if (isEmpty(&ops)) {
-                printf("Error: Mismatched parentheses\n");
-                return NULL;
-            }
-            pop(&ops); // discard '('
-        } else if (isOperator(tok)) {
-            // Operator: pop from ops while precedence is higher or equal
-            while (!isEmpty(&ops) && isOperator(peek(&ops)->value) &&
-                   precedence(peek(&ops)->value[0]) >= precedence(tok[0])) {
-                Node* op = pop(&ops);
-                Node* right = pop(&nodes);
-                Node* left = pop(&nodes);
-                if (!left || !right) {
-                    printf("Error: Stack underflow\n");
-                    return NULL;
-                }
-                op->left = left;
-                op->right = right;
-                push(&nodes, op);
-            }
-            push(&ops, createNode(tok));
-        }
-
-        tok = strtok(NULL, " ");
-    }
-
-    // Process any remaining operators in ops stack
-    while (!isEmpty(&ops)) {
-        Node* op = pop(&ops);
-        Node* right = pop(&nodes);
-        Node* left = pop(&nodes);
-        if (!left || !right) {
-            printf("Error: Stack underflow\n");
-            return NULL;
-        }
-        op->left = left;
-        op->right = right;
-        push(&nodes, op);
-    }
-
-    // At this point, nodes stack should have exactly one node (the root)
-    if (nodes.top != 0) {
-        printf("Error: Mismatched expression\n");
-        return NULL;
-    }
-
-    return pop(&nodes);
-}
-
-// =====================================
-// Tree Traversal Functions
-// =====================================
-
-// Pre-order traversal: root -> left -> right (used for prefix)
-void preorder(Node* root) {
-    if (!root) return;
-    printf("%s ", root->value);
-    preorder(root->left);
-    preorder(root->right);
-}
-
-// Post-order traversal: left -> right -> root (used for postfix)
-void postorder(Node* root) {
-    if (!root) return;
-    postorder(root->left);
-    postorder(root->right);
-    printf("%s ", root->value);
-}
-
-// In-order traversal: (left -> root -> right), with brackets
-void inorder(Node* root) {
-    if (!root) return;
-    if (root->left && root->right) printf("( ");
-    inorder(root->left);
-    printf("%s ", root->value);
-    inorder(root->right);
-    if (root->left && root->right) printf(") ");
-}
-
-// Recursively free memory used by tree
-void freeTree(Node* root) {
-    if (!root) return;
-    freeTree(root->left);
-    freeTree(root->right);
-    free(root);
-}
-
-// =====================================
-// Main Program Entry Point of Infix
-// =====================================
-
-int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        printf("Error: Please provide an infix expression and conversion type\n");
-        printf("Usage: %s \"<infix_expression>\" <conversion_type>\n", argv[0]);
-        printf("Conversion types: 'postfix' or 'prefix'\n");
-        return 1;
-    }
-
-    const char* inputExpr = argv[1];     // Infix expression from user
-    const char* conversion = argv[2];    // Desired output format
-
-    // Build expression tree from input
-    Node* root = buildTreeFromInfix(inputExpr);
-    if (!root) {
-        printf("Failed to build expression tree.\n");
-        return 1;
-    }
-
-    printf("\n");
-    // Convert based on user input
-    if (strcmp(conversion, "postfix") == 0) {
-        printf("Postfix Expression: ");
-        postorder(root);
-    } else if (strcmp(conversion, "prefix") == 0) {
-        printf("Prefix Expression: ");
-        preorder(root);
-    } else {
-        printf("Error: Invalid conversion type. Use 'postfix' or 'prefix'\n");
-        freeTree(root);
-        return 1;
-    }
-    printf("\n");
-
-    // Clean up
-    freeTree(root);
-    return 0;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+
+
+#define MAX 100
+
+// ===============================
+// Node for the Expression Tree
+// ===============================
+typedef struct Node {
+    char value[10];         // The operator or operand value (e.g., "+", "a", "42")
+    struct Node* left;      // Left child
+    struct Node* right;     // Right child
+} Node;
+
+// ===============================
+// Stack for Nodes
+// ===============================
+typedef struct Stack {
+    Node* data[MAX];        // Array to hold stack elements
+    int top;                // Index of the top element
+} Stack;
+
+// Initialize the stack
+void initStack(Stack* s) { s->top = -1; }
+
+// Check if the stack is empty
+bool isEmpty(Stack* s) { return s->top == -1; }
+
+// Push a node onto the stack
+void push(Stack* s, Node* node) {
+    if (s->top >= MAX - 1) {
+        printf("Error: Stack overflow\n");
+        exit(1);
+    }
+    s->data[++(s->top)] = node;
+}
+
+// Pop a node from the stack
+Node* pop(Stack* s) {
+    if (isEmpty(s)) {
+        printf("Error: Stack underflow\n");
+        exit(1);
+    }
+    return s->data[(s->top)--];
+}
+
+// Peek at the top node without popping
+Node* peek(Stack* s) {
+    return isEmpty(s) ? NULL : s->data[s->top];
+}
+
+// Create a new node with a given value
+Node* createNode(const char* val) {
+    Node* node = (Node*)malloc(sizeof(Node));
+    if (!node) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    strncpy(node->value, val, sizeof(node->value) - 1);
+    node->value[sizeof(node->value) - 1] = '\0';
+    node->left = node->right = NULL;
+    return node;
+}
+
+// ===============================
+// Helper Functions for Parsing
+// ===============================
+
+// Check if token is an operator
+bool isOperator(const char* token) {
+    return strlen(token) == 1 && strchr("+-*/", token[0]);
+}
+
+// Check if token is an operand (variable or number)
+bool isOperand(const char* token) {
+    for (int i = 0; token[i]; i++) {
+        if (!isalnum(token[i])) return false;
+    }
+    return strlen(token) > 0;
+}
+
+// Check if token is valid (operator or operand)
+bool isValidToken(const char* token) {
+    return isOperand(token) || isOperator(token);
+}
+
+void freeTree(Node* root);
+
+// Get precedence of operators
+int precedence(char op) {
+    if (op == '+' || op == '-') return 1;
+    if (op == '*' || op == '/') return 2;
+    return 0;
+}
+
+// =====================================
+// Build Expression Tree from Infix
+// =====================================
+Node* buildTreeFromInfix(const char* expr) {
+    Stack ops, nodes;
+    initStack(&ops);
+    initStack(&nodes);
+
+    // Make a copy of the input expression to tokenize
+    char exprCopy[256];
+    strncpy(exprCopy, expr, sizeof(exprCopy) - 1);
+    exprCopy[sizeof(exprCopy) - 1] = '\0';
+
+    char* tok = strtok(exprCopy, " ");
+    while (tok) {
+        // Validate token
+        if (!isValidToken(tok) && strcmp(tok, "(") != 0 && strcmp(tok, ")") != 0) {
+            printf("Error: Invalid token '%s'\n", tok);
+            goto fail;
+        }
+
+        if (isOperand(tok)) {
+            // Operand: create node and push to nodes stack
+            push(&nodes, createNode(tok));
+        } else if (strcmp(tok, "(") == 0) {
+            // Left parenthesis: push to ops stack
+            push(&ops, createNode(tok));
+        } else if (strcmp(tok, ")") == 0) {
+            // Right parenthesis: pop until matching "("
+            while (!isEmpty(&ops) && strcmp(peek(&ops)->value, "(") != 0) {
+                Node* op = pop(&ops);
+                Node* right = pop(&nodes);
+                Node* left = pop(&nodes);
+                if (!left || !right) {
+                    printf("Error: Stack underflow\n");
+                    free(op);
+                    freeTree(left);
+                    freeTree(right);
+                    goto fail;
+                }
+                op->left = left;
+                op->right = right;
+                push(&nodes, op);
+            }
+            if (isEmpty(&ops)) {
+                printf("Error: Mismatched parentheses\n");
+                goto fail;
+            }
+            free(pop(&ops)); // discard '('
+        } else if (isOperator(tok)) {
+            // Operator: pop from ops while precedence is higher or equal
+            while (!isEmpty(&ops) && isOperator(peek(&ops)->value) &&
+                   precedence(peek(&ops)->value[0]) >= precedence(tok[0])) {
+                Node* op = pop(&ops);
+                Node* right = pop(&nodes);
+                Node* left = pop(&nodes);
+                if (!left || !right) {
+                    printf("Error: Stack underflow\n");
+                    free(op);
+                    freeTree(left);
+                    freeTree(right);
+                    goto fail;
+                }
+                op->left = left;
+                op->right = right;
+                push(&nodes, op);
+            }
+            push(&ops, createNode(tok));
+        }
+
+        tok = strtok(NULL, " ");
+    }
+
+    // Process any remaining operators in ops stack
+    while (!isEmpty(&ops)) {
+        Node* op = pop(&ops);
+        Node* right = pop(&nodes);
+        Node* left = pop(&nodes);
+        if (!left || !right) {
+            printf("Error: Stack underflow\n");
+            free(op);
+            freeTree(left);
+            freeTree(right);
+            goto fail;
+        }
+        op->left = left;
+        op->right = right;
+        push(&nodes, op);
+    }
+
+    // At this point, nodes stack should have exactly one node (the root)
+    if (nodes.top != 0) {
+        printf("Error: Mismatched expression\n");
+        goto fail;
+    }
+
+    return pop(&nodes);
+
+fail:
+    // Free the partial trees and pending operators
+    while (!isEmpty(&ops)) free(pop(&ops));
+    while (!isEmpty(&nodes)) freeTree(pop(&nodes));
+    return NULL;
+}
+
+// =====================================
+// Precedence climbing (Pratt parsing): a pending operator or "(" is a
+// frame on a growable stack, so parentheses are never allocated as nodes,
+// nesting is not limited by MAX and partial trees are freed on errors
+// =====================================
+typedef struct {
+    Node* left;             // Left operand, NULL for "("
+    char op;                // The operator, or '(' for a parenthesis
+    int minPower;           // Binding power the enclosing expression needed
+} Frame;
+
+// Create a node from the token text[0..len), cut to fit value
+Node* createNodeN(const char* text, size_t len) {
+    Node* node = createNode("");
+    if (len > sizeof(node->value) - 1) len = sizeof(node->value) - 1;
+    memcpy(node->value, text, len);
+    node->value[len] = '\0';
+    return node;
+}
+
+// Why the Pratt parser rejected an expression; printed by buildTree
+typedef struct {
+    const char* message;    // Message line, or NULL for an invalid token
+    const char* token;      // The invalid token, len bytes of the input
+    int len;
+} ParseError;
+
+Node* buildTreeFromInfixPratt(const char* expr, ParseError* error) {
+    int top = 0, capacity = 16;
+    Frame* frames = (Frame*)malloc(sizeof(Frame) * capacity);
+    if (!frames) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    Node* operand = NULL;   // Finished left-hand side, if any
+    int minPower = 0;
+    const char* p = expr;
+
+    for (;;) {
+        // Next token, read in place
+        while (*p == ' ') p++;
+        const char* tok = p;
+        while (*p && *p != ' ') p++;
+        size_t len = (size_t)(p - tok);
+        char c = len == 1 ? tok[0] : 0;
+        bool isOp = c && strchr("+-*/", c);
+
+        if (len > 0 && !isOp && c != '(' && c != ')') {
+            for (size_t i = 0; i < len; i++) {
+                if (!isalnum((unsigned char)tok[i])) {
+                    error->message = NULL;
+                    error->token = tok;
+                    error->len = (int)len;
+                    goto fail;
+                }
+            }
+        }
+
+        if (!operand) {
+            // An operand or "(" must come next
+            if (len > 0 && !isOp && c != '(' && c != ')') {
+                operand = createNodeN(tok, len);
+                continue;
+            }
+            if (c == '(') {
+                if (top == capacity) {
+                    capacity *= 2;
+                    Frame* grown = (Frame*)realloc(frames, sizeof(Frame) * capacity);
+                    if (!grown) {
+                        printf("Error: Memory allocation failed\n");
+                        exit(1);
+                    }
+                    frames = grown;
+                }
+                frames[top].left = NULL;
+                frames[top].op = '(';
+                frames[top++].minPower = minPower;
+                minPower = 0;
+                continue;
+            }
+            if (isOp || (top > 0 && frames[top - 1].op != '(')) {
+                error->message = "Error: Stack underflow\n";
+            } else if (c == ')') {
+                error->message = "Error: Mismatched expression\n";
+            } else {
+                error->message = "Error: Mismatched parentheses\n";
+            }
+            goto fail;
+        }
+
+        if (len > 0 && !isOp && c != ')') {
+            error->message = "Error: Mismatched expression\n";
+            goto fail;
+        }
+        // Operator, ")" or the end: finish the pending operators that bind
+        // at least as tightly (all of them before a ")" or the end)
+        int power = isOp ? precedence(c) : 0;
+        while (top > 0 && frames[top - 1].op != '(' && (!isOp || power < minPower)) {
+            Frame* f = &frames[--top];
+            char text[2] = {f->op, '\0'};
+            Node* node = createNode(text);
+            node->left = f->left;
+            node->right = operand;
+            operand = node;
+            minPower = f->minPower;
+        }
+        if (isOp) {
+            if (top == capacity) {
+                capacity *= 2;
+                Frame* grown = (Frame*)realloc(frames, sizeof(Frame) * capacity);
+                if (!grown) {
+                    printf("Error: Memory allocation failed\n");
+                    exit(1);
+                }
+                frames = grown;
+            }
+            frames[top].left = operand;
+            frames[top].op = c;
+            frames[top++].minPower = minPower;
+            minPower = power + 1;   // Equal operators group to the left
+            operand = NULL;
+        } else if (c == ')') {
+            if (top == 0) {
+                error->message = "Error: Mismatched parentheses\n";
+                goto fail;
+            }
+            minPower = frames[--top].minPower;
+        } else {
+            if (top > 0) {
+                error->message = "Error: Mismatched parentheses\n";
+                goto fail;
+            }
+            free(frames);
+            return operand;
+        }
+    }
+
+fail:
+    freeTree(operand);
+    while (top > 0) freeTree(frames[--top].left);
+    free(frames);
+    return NULL;
+}
+
+// Build the tree with the Pratt parser. An expression it rejects that
+// buildTreeFromInfix read whole (shorter than its 256-byte copy) is rerun
+// there, so it gets the same result as before: its error message, or a
+// tree for the few inputs that builder accepts. Longer ones were cut short
+// by that copy, so the Pratt error stands
+Node* buildTree(const char* expr) {
+    ParseError error;
+    Node* root = buildTreeFromInfixPratt(expr, &error);
+    if (root) return root;
+    if (strlen(expr) < 256) return buildTreeFromInfix(expr);
+
+    if (!error.message) {
+        printf("Error: Invalid token '%.*s'\n", error.len, error.token);
+        return NULL;
+    }
+    printf("%s", error.message);
+    if (strcmp(error.message, "Error: Stack underflow\n") == 0) exit(1);   // As pop does
+    return NULL;
+}
+
+// =====================================
+// Tree Rendering Functions
+// Output is sized first and rendered into one buffer, so the whole
+// result goes out in a single write instead of one printf per token
+// =====================================
+
+// Copy a token and its trailing space, return the next write position
+char* putToken(char* out, const char* value) {
+    size_t len = strlen(value);
+    memcpy(out, value, len);
+    out[len] = ' ';
+    return out + len + 1;
+}
+
+// Length of prefix or postfix output: every token plus a space
+size_t tokensLength(Node* root) {
+    if (!root) return 0;
+    return strlen(root->value) + 1 + tokensLength(root->left) + tokensLength(root->right);
+}
+
+// Pre-order traversal: root -> left -> right (used for prefix)
+char* preorderRender(Node* root, char* out) {
+    if (!root) return out;
+    out = putToken(out, root->value);
+    out = preorderRender(root->left, out);
+    return preorderRender(root->right, out);
+}
+
+// Post-order traversal: left -> right -> root (used for postfix)
+char* postorderRender(Node* root, char* out) {
+    if (!root) return out;
+    out = postorderRender(root->left, out);
+    out = postorderRender(root->right, out);
+    return putToken(out, root->value);
+}
+
+// Print "\n<header><expression>\n" with one write
+void printRendered(const char* header, Node* root, char* (*render)(Node*, char*)) {
+    size_t headerLen = strlen(header);
+    size_t total = 1 + headerLen + tokensLength(root) + 1;
+    char* out = (char*)malloc(total);
+    if (!out) {
+        printf("Error: Memory allocation failed\n");
+        exit(1);
+    }
+    out[0] = '\n';
+    memcpy(out + 1, header, headerLen);
+    *render(root, out + 1 + headerLen) = '\n';
+    fwrite(out, 1, total, stdout);
+    free(out);
+}
+
+// Recursively free memory used by tree
+void freeTree(Node* root) {
+    if (!root) return;
+    freeTree(root->left);
+    freeTree(root->right);
+    free(root);
+}
+
+// =====================================
+// Main Program Entry Point of Infix
+// =====================================
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        printf("Error: Please provide an infix expression and conversion type\n");
+        printf("Usage: %s \"<infix_expression>\" <conversion_type>\n", argv[0]);
+        printf("Conversion types: 'postfix' or 'prefix'\n");
+        return 1;
+    }
+
+    const char* inputExpr = argv[1];     // Infix expression from user
+    const char* conversion = argv[2];    // Desired output format
+
+    // Build expression tree from input
+    Node* root = buildTree(inputExpr);
+    if (!root) {
+        printf("Failed to build expression tree.\n");
+        return 1;
+    }
+
+    // Convert based on user input
+    if (strcmp(conversion, "postfix") == 0) {
+        printRendered("Postfix Expression: ", root, postorderRender);
+    } else if (strcmp(conversion, "prefix") == 0) {
+        printRendered("Prefix Expression: ", root, preorderRender);
+    } else {
+        printf("\nError: Invalid conversion type. Use 'postfix' or 'prefix'\n");
+        freeTree(root);
+        return 1;
+    }
+
+    // Clean up
+    freeTree(root);
+    return 0;
+}
@@ -1,125 +1,369 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include <string.h>
-
-// Define structure of a tree node
-typedef struct Node {
-    char data;
-    struct Node *left, *right;
-} Node;
-
-// Stack for tree nodes
-typedef struct Stack {
-    Node* data[100];
-    int top;
-} Stack;
-
-// Initialize stack
-void initStack(Stack *s) {
-    s->top = -1;
-}
-
-// Push node onto stack
-void push(Stack *s, Node* node) {
-    s->data[++(s->top)] = node;
-}
-
-// Pop node from stack
-Node* pop(Stack *s) {
-    return s->data[(s->top)--];
-}
-
-// Check if character is operator
-int isOperator(char c) {
-    return (c == '+' || c == '-' || c == '*' || c == '/');
-}
-
-// Create a new node
-Node* createNode(char data) {
-    Node* node = (Node*)malloc(sizeof(Node));
-    node->data = data;
-    node->left = node->right = NULL;
-    return node;
-}
-
-// Build expression tree from postfix expression
-Node* buildTree(char postfix[]) {
-    Stack s;
-    initStack(&s);
-
-    for (int i = 0; postfix[i] != '\0'; i++) {
-        char c = postfix[i];
-
-        // If operand, create node and push
-        if (isalnum(c)) {
-            Node* node = createNode(c);
-            push(&s, node);
-        }
-        // If operator, pop two nodes and create new node
-        else if (isOperator(c)) {
-            Node* node = createNode(c);
-            node->right = pop(&s);
-            node->left = pop(&s);
-            push(&s, node);
-        }
-    }
-
-    return pop(&s);  // Root of the expression tree
-}
-
-// Traversal functions
-void inorder(Node* root) {
-    if (root) {
-        if (isOperator(root->data)) printf("(");
-        inorder(root->left);
-        printf("%c", root->data);
-        inorder(root->right);
-        if (isOperator(root->data)) printf(")");
-    }
-}
-
-void preorder(Node* root) {
-    if (root) {
-        printf("%c", root->data);
-        preorder(root->left);
-        preorder(root->right);
-    }
-}
-
-void postorder(Node* root) {
-    if (root) {
-        postorder(root->left);
-        postorder(root->right);
-        printf("%c", root->data);
-    }
-}
-
-// Free memory
-void freeTree(Node* root) {
-    if (root) {
-        freeTree(root->left);
-        freeTree(root->right);
-        free(root);
-    }
-}
-
-int main() {
-    char postfix[100];
-    printf("Enter postfix expression (single characters, no spaces): ");
-    scanf("%s", postfix);
-
-    Node* root = buildTree(postfix);
-
-    printf("\nInfix Expression: ");
-    inorder(root);
-
-    printf("\nPrefix Expression: ");
-    preorder(root);
-
-    printf("\nPostfix Expression: ");
-    postorder(root);
-
-    freeTree(root);
-    return 0;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdbool.h>
+
+// Define structure of a tree node
+typedef struct Node {
+    char data;
+    struct Node *left, *right;
+} Node;
+
+// Stack for tree nodes
+typedef struct Stack {
+    Node* data[100];
+    int top;
+} Stack;
+
+// Initialize stack
+void initStack(Stack *s) {
+    s->top = -1;
+}
+
+// Push node onto stack
+void push(Stack *s, Node* node) {
+    s->data[++(s->top)] = node;
+}
+
+// Pop node from stack
+Node* pop(Stack *s) {
+    return s->data[(s->top)--];
+}
+
+// Check if character is operator
+int isOperator(char c) {
+    return (c == '+' || c == '-' || c == '*' || c == '/');
+}
+
+// Create a new node
+Node* createNode(char data) {
+    Node* node = (Node*)malloc(sizeof(Node));
+    node->data = data;
+    node->left = node->right = NULL;
+    return node;
+}
+
+// Build expression tree from postfix expression
+Node* buildTree(char postfix[]) {
+    Stack s;
+    initStack(&s);
+
+    for (int i = 0; postfix[i] != '\0'; i++) {
+        char c = postfix[i];
+
+        // If operand, create node and push
+        if (isalnum(c)) {
+            Node* node = createNode(c);
+            push(&s, node);
+        }
+        // If operator, pop two nodes and create new node
+        else if (isOperator(c)) {
+            Node* node = createNode(c);
+            node->right = pop(&s);
+            node->left = pop(&s);
+            push(&s, node);
+        }
+    }
+
+    return pop(&s);  // Root of the expression tree
+}
+
+// Traversal functions
+// The sizes of all three notations come from one counting walk, and one
+// rendering walk writes prefix on entry, infix between the subtrees and
+// postfix on exit, each into its own slice of a single output buffer
+
+// Count the characters (prefix and postfix length) and the operators
+// (each adds a pair of parentheses to infix) in one walk
+void countTree(Node* root, size_t* nodes, size_t* operators) {
+    if (root) {
+        (*nodes)++;
+        if (isOperator(root->data)) (*operators)++;
+        countTree(root->left, nodes, operators);
+        countTree(root->right, nodes, operators);
+    }
+}
+
+void renderAll(Node* root, char** infix, char** prefix, char** postfix) {
+    if (root) {
+        *(*prefix)++ = root->data;
+        if (isOperator(root->data)) *(*infix)++ = '(';
+        renderAll(root->left, infix, prefix, postfix);
+        *(*infix)++ = root->data;
+        renderAll(root->right, infix, prefix, postfix);
+        if (isOperator(root->data)) *(*infix)++ = ')';
+        *(*postfix)++ = root->data;
+    }
+}
+
+// Copy a header into the output buffer
+char* putText(char* out, const char* text) {
+    size_t len = strlen(text);
+    memcpy(out, text, len);
+    return out + len;
+}
+
+// Free memory
+void freeTree(Node* root) {
+    if (root) {
+        freeTree(root->left);
+        freeTree(root->right);
+        free(root);
+    }
+}
+
+// ==========================================================
+// Bulk mode: byte-level engine for many expressions per run
+// One expression per input line. Characters are classified with a
+// 256-entry table, the tree lives in flat int arrays indexed by the
+// character's position in the postfix string (no malloc per node),
+// and every output character is written straight to its final place.
+// ==========================================================
+
+enum { CHAR_SKIP, CHAR_OPERAND, CHAR_OPERATOR };
+
+static unsigned char charClass[256];
+
+void initCharClass(void) {
+    for (int c = 0; c < 256; c++) {
+        if (isalnum(c)) charClass[c] = CHAR_OPERAND;
+        else if (isOperator(c)) charClass[c] = CHAR_OPERATOR;
+        else charClass[c] = CHAR_SKIP;
+    }
+}
+
+// Working arrays, reused for every line and grown to the longest one
+typedef struct {
+    char* expr;     // Operand/operator characters of the line, in postfix order
+    int* left;      // Position of each operator's left child (the right child is i - 1)
+    int* size;      // Nodes in the subtree that ends at position i
+    int* width;     // Infix characters of that subtree, parentheses included
+    int* start;     // Top-down pass: prefix depth, then infix start offset
+    int* stack;
+    size_t capacity;
+} Kernel;
+
+void growKernel(Kernel* k, size_t n) {
+    if (n <= k->capacity) return;
+    k->capacity = n * 2;
+    k->expr = (char*)realloc(k->expr, k->capacity);
+    k->left = (int*)realloc(k->left, k->capacity * sizeof(int));
+    k->size = (int*)realloc(k->size, k->capacity * sizeof(int));
+    k->width = (int*)realloc(k->width, k->capacity * sizeof(int));
+    k->start = (int*)realloc(k->start, k->capacity * sizeof(int));
+    k->stack = (int*)realloc(k->stack, k->capacity * sizeof(int));
+    if (!k->expr || !k->left || !k->size || !k->width || !k->start || !k->stack) {
+        printf("Memory allocation failed\n");
+        exit(1);
+    }
+}
+
+// Link operators to their children and size every subtree, bottom-up.
+// Returns 0 if the line is not a valid postfix expression.
+int linkKernel(Kernel* k, int n) {
+    int top = 0;
+    for (int i = 0; i < n; i++) {
+        if (charClass[(unsigned char)k->expr[i]] == CHAR_OPERAND) {
+            k->size[i] = k->width[i] = 1;
+        } else {
+            if (top < 2) return 0;
+            int right = k->stack[--top];
+            int left = k->stack[--top];
+            k->left[i] = left;
+            k->size[i] = 1 + k->size[left] + k->size[right];
+            k->width[i] = 3 + k->width[left] + k->width[right];
+        }
+        k->stack[top++] = i;
+    }
+    return top == 1;
+}
+
+// Prefix: a node's subtree starts at i - size + 1 in postfix and is shifted
+// right by one for every ancestor, so its prefix position is that plus depth
+char* renderPrefix(Kernel* k, int n, char* out) {
+    k->start[n - 1] = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        if (charClass[(unsigned char)k->expr[i]] == CHAR_OPERATOR)
+            k->start[i - 1] = k->start[k->left[i]] = k->start[i] + 1;
+        out[i - k->size[i] + 1 + k->start[i]] = k->expr[i];
+    }
+    return out + n;
+}
+
+// Infix: "(" left op right ")", placed from each subtree's start offset
+char* renderInfix(Kernel* k, int n, char* out) {
+    k->start[n - 1] = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        int at = k->start[i];
+        if (charClass[(unsigned char)k->expr[i]] == CHAR_OPERAND) {
+            out[at] = k->expr[i];
+            continue;
+        }
+        int left = k->left[i];
+        int op = at + 1 + k->width[left];
+        out[at] = '(';
+        k->start[left] = at + 1;
+        out[op] = k->expr[i];
+        k->start[i - 1] = op + 1;
+        out[at + k->width[i] - 1] = ')';
+    }
+    return out + k->width[n - 1];
+}
+
+// Output buffer flushed to stdout in large writes
+typedef struct {
+    char* data;
+    size_t used;
+    size_t capacity;
+} OutBuffer;
+
+char* reserveOutput(OutBuffer* b, size_t n) {
+    if (b->used + n > b->capacity) {
+        fwrite(b->data, 1, b->used, stdout);
+        b->used = 0;
+        if (n > b->capacity) {
+            b->capacity = n;
+            b->data = (char*)realloc(b->data, b->capacity);
+            if (!b->data) {
+                printf("Memory allocation failed\n");
+                exit(1);
+            }
+        }
+    }
+    return b->data + b->used;
+}
+
+// Output selection for bulk mode ("all" prints all three, tab-separated)
+enum { OUT_INFIX = 1, OUT_PREFIX = 2, OUT_POSTFIX = 4, OUT_ALL = 7 };
+
+// Convert one line into the selected notations
+void convertLine(Kernel* k, OutBuffer* b, const char* line, size_t len, int mode) {
+    growKernel(k, len + 1);
+    int n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (charClass[(unsigned char)line[i]] != CHAR_SKIP) k->expr[n++] = line[i];
+    }
+    if (n == 0 || !linkKernel(k, n)) {
+        static const char error[] = "Error: Invalid postfix expression\n";
+        memcpy(reserveOutput(b, sizeof(error) - 1), error, sizeof(error) - 1);
+        b->used += sizeof(error) - 1;
+        return;
+    }
+
+    bool all = mode == OUT_ALL;
+    char* out = reserveOutput(b, (size_t)k->width[n - 1] + 2 * (size_t)n + 3);
+    char* p = out;
+    if (mode & OUT_INFIX) {
+        p = renderInfix(k, n, p);
+        if (all) *p++ = '\t';
+    }
+    if (mode & OUT_PREFIX) {
+        p = renderPrefix(k, n, p);
+        if (all) *p++ = '\t';
+    }
+    if (mode & OUT_POSTFIX) {
+        memcpy(p, k->expr, (size_t)n);
+        p += n;
+    }
+    *p++ = '\n';
+    b->used += (size_t)(p - out);
+}
+
+// Stream stdin line by line through the engine
+int runBulk(const char* type) {
+    int mode;
+    if (strcmp(type, "infix") == 0) mode = OUT_INFIX;
+    else if (strcmp(type, "prefix") == 0) mode = OUT_PREFIX;
+    else if (strcmp(type, "postfix") == 0) mode = OUT_POSTFIX;
+    else if (strcmp(type, "all") == 0) mode = OUT_ALL;
+    else {
+        printf("Error: Unknown output type '%s'\n", type);
+        return 1;
+    }
+    initCharClass();
+    Kernel k = {0};
+    OutBuffer out = {0};
+    out.capacity = 1 << 20;
+    out.data = (char*)malloc(out.capacity);
+    size_t capacity = 1 << 20, used = 0, n;
+    char* in = (char*)malloc(capacity);
+    if (!out.data || !in) {
+        printf("Memory allocation failed\n");
+        return 1;
+    }
+
+    for (;;) {
+        n = fread(in + used, 1, capacity - used, stdin);
+        used += n;
+        size_t lineStart = 0;
+        for (;;) {
+            char* nl = (char*)memchr(in + lineStart, '\n', used - lineStart);
+            if (!nl) break;
+            convertLine(&k, &out, in + lineStart, (size_t)(nl - (in + lineStart)), mode);
+            lineStart = (size_t)(nl - in) + 1;
+        }
+        // Keep the unfinished line; grow the buffer if it fills it
+        memmove(in, in + lineStart, used - lineStart);
+        used -= lineStart;
+        if (n == 0) break;
+        if (used == capacity) {
+            capacity *= 2;
+            in = (char*)realloc(in, capacity);
+            if (!in) {
+                printf("Memory allocation failed\n");
+                return 1;
+            }
+        }
+    }
+    if (used > 0) convertLine(&k, &out, in, used, mode);
+    fwrite(out.data, 1, out.used, stdout);
+
+    free(in);
+    free(out.data);
+    free(k.expr);
+    free(k.left);
+    free(k.size);
+    free(k.width);
+    free(k.start);
+    free(k.stack);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    // Bulk mode: ./notaion --bulk [infix|prefix|postfix|all] < input > output
+    if (argc >= 2 && strcmp(argv[1], "--bulk") == 0) {
+        return runBulk(argc >= 3 ? argv[2] : "all");
+    }
+
+    char postfix[100];
+    printf("Enter postfix expression (single characters, no spaces): ");
+    scanf("%s", postfix);
+
+    Node* root = buildTree(postfix);
+
+    const char* infixHeader = "\nInfix Expression: ";
+    const char* prefixHeader = "\nPrefix Expression: ";
+    const char* postfixHeader = "\nPostfix Expression: ";
+    size_t nodes = 0, operators = 0;
+    countTree(root, &nodes, &operators);
+    size_t total = strlen(infixHeader) + nodes + 2 * operators +
+                   strlen(prefixHeader) + nodes + strlen(postfixHeader) + nodes;
+    char* output = (char*)malloc(total);
+    if (!output) {
+        printf("Memory allocation failed\n");
+        freeTree(root);
+        return 1;
+    }
+
+    char* infixOut = putText(output, infixHeader);
+    char* prefixOut = putText(infixOut + nodes + 2 * operators, prefixHeader);
+    char* postfixOut = putText(prefixOut + nodes, postfixHeader);
+    renderAll(root, &infixOut, &prefixOut, &postfixOut);
+
+    fwrite(output, 1, total, stdout);
+    free(output);
+
+    freeTree(root);
+    return 0;
+}